@@ -45,6 +45,7 @@ BOOL ConsoleView_SaveMemoryDump();
 const LPCTSTR MESSAGE_UNKNOWN_COMMAND = _T("  Unknown command.\r\n");
 const LPCTSTR MESSAGE_WRONG_VALUE = _T("  Wrong value.\r\n");
 const LPCTSTR MESSAGE_INVALID_REGNUM = _T("  Invalid register number, 0..7 expected.\r\n");
+const LPCTSTR MESSAGE_CONDITION_EXPECTED = _T("  Condition expected after 'if'.\r\n");
 
 
 //////////////////////////////////////////////////////////////////////
@@ -187,8 +188,8 @@ LRESULT CALLBACK ConsoleEditWndProc(HWND hWnd, UINT message, WPARAM wParam, LPAR
         }
         if (wParam == VK_ESCAPE)
         {
-            TCHAR command[32];
-            GetWindowText(m_hwndConsoleEdit, command, 32);
+            TCHAR command[64];
+            GetWindowText(m_hwndConsoleEdit, command, 64);
             if (*command == 0)  // If command is empty
                 SetFocus(g_hwndScreen);
             else
@@ -436,6 +437,10 @@ int ConsoleView_PrintDisassemble(CProcessor* pProc, WORD address, BOOL okOneInst
 void ConsoleView_TraceLog(DWORD value)
 {
     g_pBoard->SetTrace(value);
+    if ((value & TRACE_CPU) == 0)
+        Emulator_StopCPUTrace();
+    else if (!Emulator_StartCPUTrace(_T("trace.bin")))
+        ConsoleView_Print(_T("  Failed to create trace.bin file.\r\n"));
     if (value != TRACE_NONE)
         ConsoleView_PrintFormat(_T("  Trace ON, trace flags %06o\r\n"), (uint16_t)g_pBoard->GetTrace());
     else
@@ -455,6 +460,7 @@ struct ConsoleCommandParams
     LPCTSTR     commandText;
     int         paramReg1;
     uint16_t    paramOct1, paramOct2;
+    LPCTSTR     paramText;
 };
 
 void ConsoleView_CmdShowHelp(const ConsoleCommandParams& /*params*/)
@@ -475,15 +481,21 @@ void ConsoleView_CmdShowHelp(const ConsoleCommandParams& /*params*/)
             _T("  so         Step Over; executes and stops after the current instruction\r\n")
             _T("  b          List all breakpoints\r\n")
             _T("  bXXXXXX    Set breakpoint at address XXXXXX\r\n")
+            _T("  bXXXXXX if C  Set conditional breakpoint, e.g. C = r0==177 && @1000!=0 && hits>=10.\r\n")
             _T("  bcXXXXXX   Remove breakpoint at address XXXXXX\r\n")
             _T("  bc         Remove all breakpoints\r\n")
             _T("  w          List all watches\r\n")
             _T("  wXXXXXX    Set watch at address XXXXXX\r\n")
             _T("  wcXXXXXX   Remove watch at address XXXXXX\r\n")
+            _T("  wwXXXXXX   Stop on write to address XXXXXX; wr - on read, wx - on fetch\r\n")
+            _T("  wwXXXXXX-YYYYYY  Stop on write to the address range; wr, wx too\r\n")
             _T("  wc         Remove all watches\r\n")
             _T("  u          Save memory dump to file memdump.bin\r\n")
+            _T("  p          Profiling on/off; counts cycles by instruction address and call path\r\n")
+            _T("  ps         Save profile report to profile.txt, call stacks to profile.folded;\r\n")
+            _T("             symbols come from the subtitles\r\n")
 #if !defined(PRODUCT)
-            _T("  t          Tracing on/off to trace.log file\r\n")
+            _T("  t          Tracing on/off; instructions to trace.bin, events to trace.log\r\n")
             _T("  tXXXXXX    Set tracing flags\r\n")
             _T("  tc         Clear trace.log file\r\n")
 #endif
@@ -629,7 +641,11 @@ void ConsoleView_CmdPrintAllBreakpoints(const ConsoleCommandParams& /*params*/)
     {
         while (*pbps != 0177777)
         {
-            ConsoleView_PrintFormat(_T("  %06ho\r\n"), *pbps);
+            LPCTSTR condition = Emulator_GetCPUBreakpointCondition(*pbps);
+            if (condition == nullptr)
+                ConsoleView_PrintFormat(_T("  %06ho\r\n"), *pbps);
+            else
+                ConsoleView_PrintFormat(_T("  %06ho  if %s\r\n"), *pbps, condition);
             pbps++;
         }
     }
@@ -645,7 +661,7 @@ void ConsoleView_CmdSetBreakpointAtAddress(const ConsoleCommandParams& params)
 {
     uint16_t address = params.paramOct1;
 
-    bool result = Emulator_AddCPUBreakpoint(address);
+    bool result = Emulator_AddCPUBreakpoint(address, params.paramText);
     if (!result)
         ConsoleView_Print(_T("  Failed to add breakpoint.\r\n"));
 
@@ -684,6 +700,15 @@ void ConsoleView_CmdPrintAllWatches(const ConsoleCommandParams& /*params*/)
             pws++;
         }
     }
+
+    const CWatchpointList* pWatches = Emulator_GetWatchpoints();
+    for (int i = 0; i < pWatches->GetCount(); i++)
+    {
+        uint8_t flags = pWatches->GetFlags(i);
+        ConsoleView_PrintFormat(_T("  Stop on %c%c%c  %06ho-%06ho\r\n"),
+                (flags & WATCH_READ) ? _T('r') : _T('-'), (flags & WATCH_WRITE) ? _T('w') : _T('-'), (flags & WATCH_EXEC) ? _T('x') : _T('-'),
+                pWatches->GetStart(i), pWatches->GetEnd(i));
+    }
 }
 void ConsoleView_CmdSetWatchAtAddress(const ConsoleCommandParams& params)
 {
@@ -694,6 +719,23 @@ void ConsoleView_CmdSetWatchAtAddress(const ConsoleCommandParams& params)
         ConsoleView_Print(_T("  Failed to add the watch.\r\n"));
     DebugView_Redraw();
 }
+// Watch command letter after "w" gives the access kind: r, w or x
+void ConsoleView_SetWatchpoint(LPCTSTR command, uint16_t start, uint16_t end)
+{
+    uint8_t flags = (command[1] == _T('r')) ? WATCH_READ : (command[1] == _T('x')) ? WATCH_EXEC : WATCH_WRITE;
+    bool result = Emulator_SetWatchpoint(start, end, flags);
+    if (!result)
+        ConsoleView_Print(_T("  Failed to add the watch.\r\n"));
+    DebugView_Redraw();
+}
+void ConsoleView_CmdSetWatchpointAtAddress(const ConsoleCommandParams& params)
+{
+    ConsoleView_SetWatchpoint(params.commandText, params.paramOct1, params.paramOct1);
+}
+void ConsoleView_CmdSetWatchpointRange(const ConsoleCommandParams& params)
+{
+    ConsoleView_SetWatchpoint(params.commandText, params.paramOct1, params.paramOct2);
+}
 void ConsoleView_CmdRemoveWatchAtAddress(const ConsoleCommandParams& params)
 {
     uint16_t address = params.paramOct1;
@@ -709,6 +751,27 @@ void ConsoleView_CmdRemoveAllWatches(const ConsoleCommandParams& /*params*/)
     DebugView_Redraw();
 }
 
+void ConsoleView_CmdProfileOnOff(const ConsoleCommandParams& /*params*/)
+{
+    if (Emulator_IsProfiling())
+    {
+        Emulator_StopProfile();
+        ConsoleView_Print(_T("  Profiling OFF.\r\n"));
+    }
+    else
+    {
+        Emulator_StartProfile();
+        ConsoleView_Print(_T("  Profiling ON, counters cleared.\r\n"));
+    }
+}
+void ConsoleView_CmdSaveProfile(const ConsoleCommandParams& /*params*/)
+{
+    if (!Emulator_SaveProfile(_T("profile.txt"), _T("profile.folded"), DisasmView_GetSubtitlesFileName()))
+        ConsoleView_Print(_T("  Failed to save profile files.\r\n"));
+    else
+        ConsoleView_Print(_T("  Profile saved to profile.txt and profile.folded.\r\n"));
+}
+
 #if !defined(PRODUCT)
 void ConsoleView_CmdClearTraceLog(const ConsoleCommandParams& /*params*/)
 {
@@ -736,6 +799,7 @@ enum ConsoleCommandArgInfo
     ARGINFO_OCT,      // Octal value
     ARGINFO_REG_OCT,  // Register number, octal value
     ARGINFO_OCT_OCT,  // Octal value, octal value
+    ARGINFO_OCT_TEXT, // Octal value, the rest of the command text after a space; pattern ends with %n
 };
 
 typedef void(*CONSOLE_COMMAND_CALLBACK)(const ConsoleCommandParams& params);
@@ -765,16 +829,25 @@ static ConsoleCommands[] =
     { _T("d"), ARGINFO_NONE, ConsoleView_CmdPrintDisassembleAtPC },
     { _T("D"), ARGINFO_NONE, ConsoleView_CmdPrintDisassembleAtPC },
     { _T("u"), ARGINFO_NONE, ConsoleView_CmdSaveMemoryDump },
+    { _T("p"), ARGINFO_NONE, ConsoleView_CmdProfileOnOff },
+    { _T("ps"), ARGINFO_NONE, ConsoleView_CmdSaveProfile },
     { _T("m%ho"), ARGINFO_OCT, ConsoleView_CmdPrintMemoryDumpAtAddress },
     { _T("mr%d"), ARGINFO_REG, ConsoleView_CmdPrintMemoryDumpAtRegister },
     { _T("m"), ARGINFO_NONE, ConsoleView_CmdPrintMemoryDumpAtPC },
     { _T("g%ho"), ARGINFO_OCT, ConsoleView_CmdRunToAddress },
     { _T("g"), ARGINFO_NONE, ConsoleView_CmdRun },
+    { _T("b%ho if%n"), ARGINFO_OCT_TEXT, ConsoleView_CmdSetBreakpointAtAddress },
     { _T("b%ho"), ARGINFO_OCT, ConsoleView_CmdSetBreakpointAtAddress },
     { _T("b"), ARGINFO_NONE, ConsoleView_CmdPrintAllBreakpoints },
     { _T("bc%ho"), ARGINFO_OCT, ConsoleView_CmdRemoveBreakpointAtAddress },
     { _T("bc"), ARGINFO_NONE, ConsoleView_CmdRemoveAllBreakpoints },
     { _T("w%ho"), ARGINFO_OCT, ConsoleView_CmdSetWatchAtAddress },
+    { _T("wr%ho-%ho"), ARGINFO_OCT_OCT, ConsoleView_CmdSetWatchpointRange },
+    { _T("ww%ho-%ho"), ARGINFO_OCT_OCT, ConsoleView_CmdSetWatchpointRange },
+    { _T("wx%ho-%ho"), ARGINFO_OCT_OCT, ConsoleView_CmdSetWatchpointRange },
+    { _T("wr%ho"), ARGINFO_OCT, ConsoleView_CmdSetWatchpointAtAddress },
+    { _T("ww%ho"), ARGINFO_OCT, ConsoleView_CmdSetWatchpointAtAddress },
+    { _T("wx%ho"), ARGINFO_OCT, ConsoleView_CmdSetWatchpointAtAddress },
     { _T("w"), ARGINFO_NONE, ConsoleView_CmdPrintAllWatches },
     { _T("wc%ho"), ARGINFO_OCT, ConsoleView_CmdRemoveWatchAtAddress },
     { _T("wc"), ARGINFO_NONE, ConsoleView_CmdRemoveAllWatches },
@@ -786,17 +859,25 @@ static ConsoleCommands[] =
 };
 const size_t ConsoleCommandsCount = sizeof(ConsoleCommands) / sizeof(ConsoleCommands[0]);
 
+// Only spaces up to the end of the text
+static bool ConsoleView_IsBlank(const TCHAR* text)
+{
+    while (*text == _T(' ') || *text == _T('\t'))
+        text++;
+    return *text == 0;
+}
+
 void ConsoleView_DoConsoleCommand()
 {
     // Get command text
-    TCHAR command[32];
-    GetWindowText(m_hwndConsoleEdit, command, 32);
+    TCHAR command[64];
+    GetWindowText(m_hwndConsoleEdit, command, 64);
     SendMessage(m_hwndConsoleEdit, WM_SETTEXT, 0, (LPARAM)_T(""));  // Clear command
 
     if (command[0] == 0) return;  // Nothing to do
 
     // Echo command to the log
-    TCHAR buffer[36];
+    TCHAR buffer[72];
     ::GetWindowText(m_hwndConsolePrompt, buffer, 14);
     ConsoleView_Print(buffer);
     _sntprintf(buffer, sizeof(buffer) / sizeof(TCHAR) - 1, _T(" %s\r\n"), command);
@@ -807,6 +888,7 @@ void ConsoleView_DoConsoleCommand()
     params.paramReg1 = -1;
     params.paramOct1 = 0;
     params.paramOct2 = 0;
+    params.paramText = nullptr;
 
     // Find matching console command from the list, parse and execute the command
     bool parsedOkay = false, parseError = false;
@@ -821,7 +903,7 @@ void ConsoleView_DoConsoleCommand()
             parsedOkay = (_tcscmp(command, cmd.pattern) == 0);
             break;
         case ARGINFO_REG:
-            paramsParsed = _sntscanf_s(command, 32, cmd.pattern, &params.paramReg1);
+            paramsParsed = _sntscanf_s(command, 64, cmd.pattern, &params.paramReg1);
             parsedOkay = (paramsParsed == 1);
             if (parsedOkay && params.paramReg1 < 0 || params.paramReg1 > 7)
             {
@@ -830,11 +912,18 @@ void ConsoleView_DoConsoleCommand()
             }
             break;
         case ARGINFO_OCT:
-            paramsParsed = _sntscanf_s(command, 32, cmd.pattern, &params.paramOct1);
-            parsedOkay = (paramsParsed == 1);
+            {
+                // The whole command should be consumed, trailing spaces are allowed
+                TCHAR pattern[32];
+                _sntprintf(pattern, sizeof(pattern) / sizeof(TCHAR) - 1, _T("%s%%n"), cmd.pattern);
+                pattern[sizeof(pattern) / sizeof(TCHAR) - 1] = 0;
+                int endOffset = -1;
+                paramsParsed = _sntscanf_s(command, 64, pattern, &params.paramOct1, &endOffset);
+                parsedOkay = (paramsParsed == 1 && endOffset > 0 && ConsoleView_IsBlank(command + endOffset));
+            }
             break;
         case ARGINFO_REG_OCT:
-            paramsParsed = _sntscanf_s(command, 32, cmd.pattern, &params.paramReg1, &params.paramOct1);
+            paramsParsed = _sntscanf_s(command, 64, cmd.pattern, &params.paramReg1, &params.paramOct1);
             parsedOkay = (paramsParsed == 2);
             if (parsedOkay && params.paramReg1 < 0 || params.paramReg1 > 7)
             {
@@ -843,9 +932,29 @@ void ConsoleView_DoConsoleCommand()
             }
             break;
         case ARGINFO_OCT_OCT:
-            paramsParsed = _sntscanf_s(command, 32, cmd.pattern, &params.paramOct1, &params.paramOct2);
+            paramsParsed = _sntscanf_s(command, 64, cmd.pattern, &params.paramOct1, &params.paramOct2);
             parsedOkay = (paramsParsed == 2);
             break;
+        case ARGINFO_OCT_TEXT:
+            {
+                int textOffset = -1;
+                paramsParsed = _sntscanf_s(command, 64, cmd.pattern, &params.paramOct1, &textOffset);
+                if (paramsParsed != 1 || textOffset <= 0)
+                    break;  // No match, try the next patterns
+                // The prefix matched: the text should follow after a space, and it should not be empty
+                const TCHAR* text = command + textOffset;
+                if ((*text != _T(' ') && *text != _T('\t')) || ConsoleView_IsBlank(text))
+                {
+                    ConsoleView_Print(MESSAGE_CONDITION_EXPECTED);
+                    parseError = true;
+                    break;
+                }
+                while (*text == _T(' ') || *text == _T('\t'))
+                    text++;
+                params.paramText = text;
+                parsedOkay = true;
+            }
+            break;
         }
 
         if (parseError)
@@ -72,6 +72,7 @@ int m_nDisasmSelectedLineIndex  = -1;  // Line selected by user
 
 bool m_okDisasmSubtitles = false;
 TCHAR* m_strDisasmSubtitles = nullptr;
+TCHAR m_strDisasmSubtitlesFileName[MAX_PATH];  // Also the symbols for the profiler, see DisasmView_GetSubtitlesFileName()
 std::vector<DisasmSubtitleItem> m_SubtitleItems;
 
 const int MAX_DISASMLINECOUNT = 50;
@@ -361,6 +362,11 @@ void DisasmView_AddSubtitle(uint16_t addr, int type, LPCTSTR pCommentText)
     m_SubtitleItems.push_back(item);
 }
 
+LPCTSTR DisasmView_GetSubtitlesFileName()
+{
+    return m_okDisasmSubtitles ? m_strDisasmSubtitlesFileName : nullptr;
+}
+
 void DisasmView_LoadUnloadSubtitles()
 {
     if (m_okDisasmSubtitles)  // Reset subtitles
@@ -413,6 +419,7 @@ void DisasmView_LoadUnloadSubtitles()
     }
 
     m_okDisasmSubtitles = TRUE;
+    _tcscpy_s(m_strDisasmSubtitlesFileName, MAX_PATH, bufFileName);
     DisasmView_UpdateWindowText();
     DisasmView_OnUpdate();  // We have to re-build the list of lines to show
 }
@@ -26,11 +26,13 @@ CMotherboard* g_pBoard = nullptr;
 int g_nEmulatorConfiguration;  // Current configuration
 bool g_okEmulatorRunning = false;
 
-int m_wEmulatorCPUBpsCount = 0;
-uint16_t m_EmulatorCPUBps[MAX_BREAKPOINTCOUNT + 1];
+CBreakpointList m_EmulatorCPUBps;
 uint16_t m_wEmulatorTempCPUBreakpoint = 0177777;
 int m_wEmulatorWatchesCount = 0;
 uint16_t m_EmulatorWatches[MAX_BREAKPOINTCOUNT + 1];
+CWatchpointList m_EmulatorWatchpoints;  // Watches that stop the execution, see Emulator_SetWatchpoint()
+CTraceWriter m_EmulatorTraceWriter;  // CPU instruction trace, see Emulator_StartCPUTrace()
+CProfiler* m_pEmulatorProfiler = nullptr;  // See Emulator_StartProfile()
 
 bool m_okEmulatorSound = false;
 uint16_t m_wEmulatorSoundSpeed = 100;
@@ -56,18 +58,6 @@ uint16_t g_wEmulatorPrevCpuPC = 0177777;  // Previous PC value
 void CALLBACK Emulator_SoundGenCallback(unsigned short L, unsigned short R);
 
 //////////////////////////////////////////////////////////////////////
-//Прототип функции преобразования экрана
-// Input:
-//   pVideoBuffer   Исходные данные, биты экрана БК
-//   pPalette       Палитра
-//   pImageBits     Результат, 32-битный цвет, размер для каждой функции свой
-typedef void (CALLBACK* PREPARE_SCREEN_CALLBACK)(const uint8_t* pVideoBuffer, const uint32_t* pPalette, void* pImageBits);
-
-void CALLBACK Emulator_PrepareScreenBW512x256(const uint8_t* pVideoBuffer, const uint32_t* palette, void* pImageBits);
-void CALLBACK Emulator_PrepareScreenBW512x312(const uint8_t* pVideoBuffer, const uint32_t* palette, void* pImageBits);
-void CALLBACK Emulator_PrepareScreenBW768x468(const uint8_t* pVideoBuffer, const uint32_t* palette, void* pImageBits);
-void CALLBACK Emulator_PrepareScreenBW896x624(const uint8_t* pVideoBuffer, const uint32_t* palette, void* pImageBits);
-void CALLBACK Emulator_PrepareScreenBW1024x624(const uint8_t* pVideoBuffer, const uint32_t* palette, void* pImageBits);
 
 struct ScreenModeStruct
 {
@@ -129,22 +119,31 @@ bool Emulator_Init()
 {
     ASSERT(g_pBoard == nullptr);
 
-    CProcessor::Init();
-
-    m_wEmulatorCPUBpsCount = 0;
-    for (int i = 0; i <= MAX_BREAKPOINTCOUNT; i++)
+    m_EmulatorCPUBps.RemoveAll();
+    for (int i = 0; i < MAX_BREAKPOINTCOUNT; i++)
     {
         uint16_t address = Settings_GetDebugBreakpoint(i);
-        m_EmulatorCPUBps[i] = address;
-        if (address != 0177777) m_wEmulatorCPUBpsCount = i + 1;
+        if (address != 0177777)
+        {
+            TCHAR condition[BPCOND_MAXLENGTH];
+            Settings_GetDebugBreakpointCondition(i, condition);
+            if (!m_EmulatorCPUBps.Add(address, condition))
+            {
+                // The saved condition does not compile any more, keep the breakpoint unconditional
+                DebugLogFormat(_T("Breakpoint %06ho: wrong condition '%s' dropped\r\n"), address, condition);
+                m_EmulatorCPUBps.Add(address);
+            }
+        }
     }
     m_wEmulatorWatchesCount = 0;
     for (int i = 0; i <= MAX_WATCHPOINTCOUNT; i++)
     {
         m_EmulatorWatches[i] = 0177777;
     }
+    m_EmulatorWatchpoints.RemoveAll();
 
     g_pBoard = new CMotherboard();
+    g_pBoard->SetWatchpoints(&m_EmulatorWatchpoints);
 
     // Allocate memory for old RAM values
     g_pEmulatorRam = static_cast<uint8_t*>(::calloc(128 * 1024, 1));
@@ -165,11 +164,15 @@ void Emulator_Done()
 {
     ASSERT(g_pBoard != nullptr);
 
-    // Save breakpoints
+    // Save breakpoints with their conditions, first MAX_BREAKPOINTCOUNT of them
+    Emulator_SetTempCPUBreakpoint(0177777);
+    const uint16_t* pbps = m_EmulatorCPUBps.GetList();
     for (int i = 0; i < MAX_BREAKPOINTCOUNT; i++)
-        Settings_SetDebugBreakpoint(i, i < m_wEmulatorCPUBpsCount ? m_EmulatorCPUBps[i] : 0177777);
-
-    CProcessor::Done();
+    {
+        Settings_SetDebugBreakpoint(i, *pbps);
+        Settings_SetDebugBreakpointCondition(i, *pbps != 0177777 ? m_EmulatorCPUBps.GetCondition(*pbps) : nullptr);
+        if (*pbps != 0177777) pbps++;
+    }
 
     g_pBoard->SetSoundGenCallback(nullptr);
     SoundGen_Finalize();
@@ -181,6 +184,10 @@ void Emulator_Done()
         m_hEmulatorComPort = INVALID_HANDLE_VALUE;
     }
 
+    Emulator_StopCPUTrace();
+    Emulator_StopProfile();
+    delete m_pEmulatorProfiler;  m_pEmulatorProfiler = nullptr;
+
     delete g_pBoard;
     g_pBoard = nullptr;
 
@@ -269,7 +276,7 @@ void Emulator_Start()
     m_dwTickCount = GetTickCount();
 
     // For proper breakpoint processing
-    if (m_wEmulatorCPUBpsCount != 0)
+    if (m_EmulatorCPUBps.GetCount() != 0)
         g_pBoard->GetCPU()->ClearInternalTick();
 }
 void Emulator_Stop()
@@ -303,100 +310,38 @@ void Emulator_Reset()
     MainWindow_UpdateAllViews();
 }
 
-bool Emulator_AddCPUBreakpoint(uint16_t address)
+bool Emulator_AddCPUBreakpoint(uint16_t address, LPCTSTR condition)
 {
-    if (m_wEmulatorCPUBpsCount == MAX_BREAKPOINTCOUNT - 1 || address == 0177777)
-        return false;
-    for (int i = 0; i < m_wEmulatorCPUBpsCount; i++)  // Check if the BP exists
-    {
-        if (m_EmulatorCPUBps[i] == address)
-            return false;  // Already in the list
-    }
-    for (int i = 0; i < MAX_BREAKPOINTCOUNT; i++)  // Put in the first empty cell
-    {
-        if (m_EmulatorCPUBps[i] > address)  // found the place
-        {
-            memcpy(m_EmulatorCPUBps + i + 1, m_EmulatorCPUBps + i, sizeof(uint16_t) * (m_wEmulatorCPUBpsCount - i));
-            m_EmulatorCPUBps[i] = address;
-            break;
-        }
-        if (m_EmulatorCPUBps[i] == 0177777)  // found empty place
-        {
-            m_EmulatorCPUBps[i] = address;
-            break;
-        }
-    }
-    m_wEmulatorCPUBpsCount++;
-    return true;
+    return m_EmulatorCPUBps.Add(address, condition);
 }
 bool Emulator_RemoveCPUBreakpoint(uint16_t address)
 {
-    if (m_wEmulatorCPUBpsCount == 0 || address == 0177777)
-        return false;
-    for (int i = 0; i < MAX_BREAKPOINTCOUNT; i++)
-    {
-        if (m_EmulatorCPUBps[i] == address)
-        {
-            m_EmulatorCPUBps[i] = 0177777;
-            m_wEmulatorCPUBpsCount--;
-            if (m_wEmulatorCPUBpsCount > i)  // fill the hole
-            {
-                memcpy(m_EmulatorCPUBps + i, m_EmulatorCPUBps + i + 1, sizeof(uint16_t) * (m_wEmulatorCPUBpsCount - i));
-                m_EmulatorCPUBps[m_wEmulatorCPUBpsCount] = 0177777;
-            }
-            return true;
-        }
-    }
-    return false;
+    return m_EmulatorCPUBps.Remove(address);
 }
 void Emulator_SetTempCPUBreakpoint(uint16_t address)
 {
     if (m_wEmulatorTempCPUBreakpoint != 0177777)
-        Emulator_RemoveCPUBreakpoint(m_wEmulatorTempCPUBreakpoint);
-    if (address == 0177777)
-    {
-        m_wEmulatorTempCPUBreakpoint = 0177777;
-        return;
-    }
-    for (int i = 0; i < MAX_BREAKPOINTCOUNT; i++)
-    {
-        if (m_EmulatorCPUBps[i] == address)
-            return;  // We have regular breakpoint with the same address
-    }
+        m_EmulatorCPUBps.Remove(m_wEmulatorTempCPUBreakpoint);
+    m_wEmulatorTempCPUBreakpoint = 0177777;
+    if (address == 0177777 || m_EmulatorCPUBps.IsBreakpoint(address))
+        return;  // We have regular breakpoint with the same address
+    m_EmulatorCPUBps.Add(address);
     m_wEmulatorTempCPUBreakpoint = address;
-    m_EmulatorCPUBps[m_wEmulatorCPUBpsCount] = address;
-    m_wEmulatorCPUBpsCount++;
 }
-const uint16_t* Emulator_GetCPUBreakpointList() { return m_EmulatorCPUBps; }
+const uint16_t* Emulator_GetCPUBreakpointList() { return m_EmulatorCPUBps.GetList(); }
+LPCTSTR Emulator_GetCPUBreakpointCondition(uint16_t address) { return m_EmulatorCPUBps.GetCondition(address); }
 bool Emulator_IsBreakpoint()
 {
-    uint16_t address = g_pBoard->GetCPU()->GetPC();
-    if (m_wEmulatorCPUBpsCount > 0)
-    {
-        for (int i = 0; i < m_wEmulatorCPUBpsCount; i++)
-        {
-            if (address == m_EmulatorCPUBps[i])
-                return true;
-        }
-    }
-    return false;
+    return m_EmulatorCPUBps.IsBreakpoint(g_pBoard->GetCPU()->GetPC());
 }
 bool Emulator_IsBreakpoint(uint16_t address)
 {
-    if (m_wEmulatorCPUBpsCount == 0)
-        return false;
-    for (int i = 0; i < m_wEmulatorCPUBpsCount; i++)
-    {
-        if (address == m_EmulatorCPUBps[i])
-            return true;
-    }
-    return false;
+    return m_EmulatorCPUBps.IsBreakpoint(address);
 }
 void Emulator_RemoveAllBreakpoints()
 {
-    for (int i = 0; i < MAX_BREAKPOINTCOUNT; i++)
-        m_EmulatorCPUBps[i] = 0177777;
-    m_wEmulatorCPUBpsCount = 0;
+    m_EmulatorCPUBps.RemoveAll();
+    m_wEmulatorTempCPUBreakpoint = 0177777;
 }
 
 bool Emulator_AddWatchpoint(uint16_t address)
@@ -420,10 +365,22 @@ bool Emulator_AddWatchpoint(uint16_t address)
     return true;
 }
 const uint16_t* Emulator_GetWatchpointList() { return m_EmulatorWatches; }
+bool Emulator_SetWatchpoint(uint16_t start, uint16_t end, uint8_t flags)
+{
+    if (!m_EmulatorWatchpoints.Add(start, end, flags))
+        return false;
+    g_pBoard->SetWatchpoints(&m_EmulatorWatchpoints);
+    Emulator_AddWatchpoint(start);  // Show the value in the debug view as well
+    return true;
+}
+const CWatchpointList* Emulator_GetWatchpoints() { return &m_EmulatorWatchpoints; }
 bool Emulator_RemoveWatchpoint(uint16_t address)
 {
+    bool removed = m_EmulatorWatchpoints.Remove(address);
+    if (removed)
+        g_pBoard->SetWatchpoints(&m_EmulatorWatchpoints);
     if (m_wEmulatorWatchesCount == 0 || address == 0177777)
-        return false;
+        return removed;
     for (int i = 0; i < MAX_WATCHPOINTCOUNT; i++)
     {
         if (m_EmulatorWatches[i] == address)
@@ -438,13 +395,59 @@ bool Emulator_RemoveWatchpoint(uint16_t address)
             return true;
         }
     }
-    return false;
+    return removed;
 }
 void Emulator_RemoveAllWatchpoints()
 {
     for (int i = 0; i < MAX_WATCHPOINTCOUNT; i++)
         m_EmulatorWatches[i] = 0177777;
     m_wEmulatorWatchesCount = 0;
+    m_EmulatorWatchpoints.RemoveAll();
+    g_pBoard->SetWatchpoints(&m_EmulatorWatchpoints);
+}
+
+bool Emulator_StartCPUTrace(LPCTSTR sFileName)
+{
+    if (!m_EmulatorTraceWriter.IsOpen() && !m_EmulatorTraceWriter.Open(sFileName))
+        return false;
+    g_pBoard->SetTraceWriter(&m_EmulatorTraceWriter);
+    return true;
+}
+
+void Emulator_StopCPUTrace()
+{
+    g_pBoard->SetTraceWriter(nullptr);
+    m_EmulatorTraceWriter.Close();
+}
+
+bool Emulator_IsProfiling()
+{
+    return m_pEmulatorProfiler != nullptr && g_pBoard->GetCPU()->GetProfiler() != nullptr;
+}
+
+void Emulator_StartProfile()
+{
+    if (m_pEmulatorProfiler == nullptr)
+        m_pEmulatorProfiler = new CProfiler();
+    m_pEmulatorProfiler->Clear();
+    g_pBoard->GetCPU()->SetProfiler(m_pEmulatorProfiler);
+}
+
+void Emulator_StopProfile()
+{
+    g_pBoard->GetCPU()->SetProfiler(nullptr);
+}
+
+bool Emulator_SaveProfile(LPCTSTR sFileName, LPCTSTR sStacksFileName, LPCTSTR sSymbolsFileName)
+{
+    if (m_pEmulatorProfiler == nullptr)
+        return false;
+
+    CSymbolTable symbols;
+    if (sSymbolsFileName != nullptr)
+        symbols.LoadListing(sSymbolsFileName);
+    return m_pEmulatorProfiler->SaveReport(sFileName, &symbols, 100) &&
+            m_pEmulatorProfiler->SaveCollapsedStacks(sStacksFileName, &symbols);
 }
 
 void Emulator_SetSpeed(uint16_t realspeed)
@@ -609,13 +612,22 @@ void Emulator_SetParallel(bool parallelOnOff)
 
 bool Emulator_SystemFrame()
 {
-    g_pBoard->SetCPUBreakpoints(m_wEmulatorCPUBpsCount > 0 ? m_EmulatorCPUBps : nullptr);
+    g_pBoard->SetCPUBreakpoints(&m_EmulatorCPUBps);
 
     ScreenView_ScanKeyboard();
     ScreenView_ProcessKeyboard();
 
     if (!g_pBoard->SystemFrame())
+    {
+        const WatchpointHit* pHit = g_pBoard->GetWatchpointHit();
+        if (pHit != nullptr)
+        {
+            LPCTSTR access = (pHit->access == WATCH_READ) ? _T("read") : (pHit->access == WATCH_WRITE) ? _T("write") : _T("fetch");
+            ConsoleView_PrintFormat(_T("  Watchpoint: PC=%06ho %s %s %06ho: %06ho -> %06ho\r\n"),
+                    pHit->pc, access, pHit->okByte ? _T("byte") : _T("word"), pHit->address, pHit->oldvalue, pHit->newvalue);
+        }
         return false;
+    }
 
     // Calculate frames per second
     m_nFrameCount++;
@@ -736,140 +748,6 @@ const uint32_t * Emulator_GetPalette()
     return ScreenView_Palette;
 }
 
-#define AVERAGERGB(a, b)  ( (((a) & 0xfefefeffUL) + ((b) & 0xfefefeffUL)) >> 1 )
-
-void CALLBACK Emulator_PrepareScreenBW512x256(const uint8_t* pVideoBuffer, const uint32_t* palette, void* pImageBits)
-{
-    for (int y = 0; y < 256; y++)
-    {
-        const uint16_t* pVideo = (uint16_t*)(pVideoBuffer + y * 512 / 4);
-        uint32_t* pBits = static_cast<uint32_t*>(pImageBits) + (256 - 1 - y) * 512;
-        for (int x = 0; x < 512 / 8; x++)
-        {
-            uint16_t src = *pVideo;
-
-            for (int bit = 0; bit < 8; bit++)
-            {
-                int colorindex = (src & 0x80) >> 7 | (src & 0x8000) >> 14;
-                uint32_t color = palette[colorindex];
-                *pBits = color;
-                pBits++;
-                src = src << 1;
-            }
-
-            pVideo++;
-        }
-    }
-}
-
-void CALLBACK Emulator_PrepareScreenBW512x312(const uint8_t* pVideoBuffer, const uint32_t* palette, void* pImageBits)
-{
-    uint32_t * pImageStart = static_cast<uint32_t*>(pImageBits) + 512 * 28;
-    Emulator_PrepareScreenBW512x256(pVideoBuffer, palette, pImageStart);
-}
-
-void CALLBACK Emulator_PrepareScreenBW768x468(const uint8_t* pVideoBuffer, const uint32_t* palette, void* pImageBits)
-{
-    for (int y = 0; y < 256; y += 2)
-    {
-        const uint16_t* psrc1 = (uint16_t*)(pVideoBuffer + y * 512 / 4);
-        const uint16_t* psrc2 = (uint16_t*)(pVideoBuffer + (y + 1) * 512 / 4);
-        uint32_t* pdest1 = static_cast<uint32_t*>(pImageBits) + (426 - 1 - y / 2 * 3) * 768;
-        uint32_t* pdest2 = pdest1 - 768;
-        uint32_t* pdest3 = pdest2 - 768;
-        for (int x = 0; x < 512 / 8; x++)
-        {
-            uint16_t src1 = *psrc1;
-            uint16_t src2 = *psrc2;
-            for (int bit = 0; bit < 4; bit++)
-            {
-                int colorindex1a = (src1 & 0x80) >> 7 | (src1 & 0x8000) >> 14;  src1 = src1 << 1;
-                int colorindex1b = (src1 & 0x80) >> 7 | (src1 & 0x8000) >> 14;  src1 = src1 << 1;
-                uint32_t c1a = palette[colorindex1a];
-                uint32_t c1b = palette[colorindex1b];
-                int colorindex2a = (src2 & 0x80) >> 7 | (src2 & 0x8000) >> 14;  src2 = src2 << 1;
-                int colorindex2b = (src2 & 0x80) >> 7 | (src2 & 0x8000) >> 14;  src2 = src2 << 1;
-                uint32_t c2a = palette[colorindex2a];
-                uint32_t c2b = palette[colorindex2b];
-
-                uint32_t c1ab = AVERAGERGB(c1a, c1b);
-                uint32_t c2ab = AVERAGERGB(c2a, c2b);
-                uint32_t c12a = AVERAGERGB(c1a, c2a);
-                uint32_t c12b = AVERAGERGB(c1b, c2b);
-                uint32_t c12ab = AVERAGERGB(c1ab, c2ab);
-
-                (*pdest1++) = c1a;   (*pdest1++) = c1ab;  (*pdest1++) = c1b;
-                (*pdest2++) = c12a;  (*pdest2++) = c12ab; (*pdest2++) = c12b;
-                (*pdest3++) = c2a;   (*pdest3++) = c2ab;  (*pdest3++) = c2b;
-            }
-            psrc1++;
-            psrc2++;
-        }
-    }
-}
-
-void CALLBACK Emulator_PrepareScreenBW896x624(const uint8_t* pVideoBuffer, const uint32_t* palette, void* pImageBits)
-{
-    for (int y = 0; y < 256; y++)
-    {
-        const uint16_t* psrc1 = (uint16_t*)(pVideoBuffer + y * 512 / 4);
-        uint32_t* pdest1 = static_cast<uint32_t*>(pImageBits) + (568 - 1 - y * 2) * 896;
-        uint32_t* pdest2 = pdest1 - 896;
-        for (int x = 0; x < 512 / 8; x++)
-        {
-            uint16_t src1 = *psrc1;
-            for (int bit = 0; bit < 2; bit++)
-            {
-                int colorindex1 = (src1 & 0x80) >> 7 | (src1 & 0x8000) >> 14;  src1 = src1 << 1;
-                int colorindex2 = (src1 & 0x80) >> 7 | (src1 & 0x8000) >> 14;  src1 = src1 << 1;
-                int colorindex3 = (src1 & 0x80) >> 7 | (src1 & 0x8000) >> 14;  src1 = src1 << 1;
-                int colorindex4 = (src1 & 0x80) >> 7 | (src1 & 0x8000) >> 14;  src1 = src1 << 1;
-                uint32_t c1 = palette[colorindex1];
-                uint32_t c2 = palette[colorindex2];
-                uint32_t c3 = palette[colorindex3];
-                uint32_t c4 = palette[colorindex4];
-                *(pdest1++) = *(pdest2++) = c1;
-                *(pdest1++) = *(pdest2++) = AVERAGERGB(c1, c2);
-                *(pdest1++) = *(pdest2++) = c2;
-                *(pdest1++) = *(pdest2++) = AVERAGERGB(c2, c3);
-                *(pdest1++) = *(pdest2++) = c3;
-                *(pdest1++) = *(pdest2++) = AVERAGERGB(c3, c4);
-                *(pdest1++) = *(pdest2++) = c4;
-            }
-            psrc1++;
-        }
-    }
-}
-
-void CALLBACK Emulator_PrepareScreenBW1024x624(const uint8_t* pVideoBuffer, const uint32_t* palette, void* pImageBits)
-{
-    for (int y = 0; y < 256; y++)
-    {
-        const uint16_t* pVideo = (uint16_t*)(pVideoBuffer + y * 512 / 4);
-        uint32_t* pBits1 = static_cast<uint32_t*>(pImageBits) + (568 - 1 - y * 2) * 1024;
-        uint32_t* pBits2 = pBits1 - 1024;
-        for (int x = 0; x < 512 / 8; x++)
-        {
-            uint16_t src = *pVideo;
-
-            for (int bit = 0; bit < 8; bit++)
-            {
-                int colorindex = (src & 0x80) >> 7 | (src & 0x8000) >> 14;
-                uint32_t color = palette[colorindex];
-
-                (*pBits1++) = color;  (*pBits1++) = color;
-                (*pBits2++) = color;  (*pBits2++) = color;
-
-                src = src << 1;
-            }
-
-            pVideo++;
-        }
-    }
-}
-
-
-
 //////////////////////////////////////////////////////////////////////
 //
 // Emulator image format - see CMotherboard::SaveToImage()
@@ -27,7 +27,7 @@ enum EmulatorConfiguration
 
 //////////////////////////////////////////////////////////////////////
 
-const int MAX_BREAKPOINTCOUNT = 16;
+const int MAX_BREAKPOINTCOUNT = 16;  // Breakpoints kept in the settings; the list itself is not limited
 const int MAX_WATCHPOINTCOUNT = 16;
 
 extern CMotherboard* g_pBoard;
@@ -48,19 +48,32 @@ bool Emulator_InitConfiguration(uint16_t configuration);
 LPCTSTR Emulator_GetConfigurationName();
 void Emulator_Done();
 
-bool Emulator_AddCPUBreakpoint(uint16_t address);
+bool Emulator_AddCPUBreakpoint(uint16_t address, LPCTSTR condition = nullptr);
 bool Emulator_RemoveCPUBreakpoint(uint16_t address);
 void Emulator_SetTempCPUBreakpoint(uint16_t address);
 const uint16_t* Emulator_GetCPUBreakpointList();
+LPCTSTR Emulator_GetCPUBreakpointCondition(uint16_t address);  // nullptr for unconditional breakpoint
 bool Emulator_IsBreakpoint();
 bool Emulator_IsBreakpoint(uint16_t address);
 void Emulator_RemoveAllBreakpoints();
 
 bool Emulator_AddWatchpoint(uint16_t address);
+bool Emulator_SetWatchpoint(uint16_t start, uint16_t end, uint8_t flags);  // Stop on access, see WATCH_Xxx flags
+const CWatchpointList* Emulator_GetWatchpoints();
 const uint16_t* Emulator_GetWatchpointList();
 bool Emulator_RemoveWatchpoint(uint16_t address);
 void Emulator_RemoveAllWatchpoints();
 
+// CPU instruction trace goes to the binary file, see CTraceWriter; other trace events go to trace.log
+bool Emulator_StartCPUTrace(LPCTSTR sFileName);
+void Emulator_StopCPUTrace();
+// Count CPU instructions and cycles per address and per call path, see CProfiler; the report keeps the counts since the start
+bool Emulator_IsProfiling();
+void Emulator_StartProfile();
+void Emulator_StopProfile();
+// Write the hot spots report and the collapsed call stacks; symbols from the listing, can be nullptr
+bool Emulator_SaveProfile(LPCTSTR sFileName, LPCTSTR sStacksFileName, LPCTSTR sSymbolsFileName);
+
 void Emulator_SetSound(bool soundOnOff);
 bool Emulator_SetSerial(bool serialOnOff, LPCTSTR serialPort);
 void Emulator_SetParallel(bool parallelOnOff);
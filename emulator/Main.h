@@ -139,6 +139,8 @@ void Settings_GetDebugFontName(LPTSTR buffer);
 void Settings_SetDebugFontName(LPCTSTR sFontName);
 WORD Settings_GetDebugBreakpoint(int bpno);
 void Settings_SetDebugBreakpoint(int bpno, WORD address);
+void Settings_GetDebugBreakpointCondition(int bpno, LPTSTR buffer);  // Buffer of 64 characters, empty = no condition
+void Settings_SetDebugBreakpointCondition(int bpno, LPCTSTR condition);
 void Settings_SetDebugMemoryMode(WORD mode);
 WORD Settings_GetDebugMemoryMode();
 void Settings_SetDebugMemoryAddress(WORD address);
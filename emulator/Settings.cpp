@@ -332,6 +332,20 @@ WORD Settings_GetDebugBreakpoint(int bpno)
     Settings_LoadDwordValue(bufValueName, &dwValue);
     return (WORD)dwValue;
 }
+void Settings_SetDebugBreakpointCondition(int bpno, LPCTSTR condition)
+{
+    TCHAR bufValueName[16];
+    lstrcpy(bufValueName, _T("DebugBreakptIf0"));
+    bufValueName[14] = bpno < 10 ? _T('0') + (TCHAR)bpno : _T('A') + (TCHAR)(bpno - 10);
+    Settings_SaveStringValue(bufValueName, condition);  // NULL deletes the value
+}
+void Settings_GetDebugBreakpointCondition(int bpno, LPTSTR buffer)
+{
+    TCHAR bufValueName[16];
+    lstrcpy(bufValueName, _T("DebugBreakptIf0"));
+    bufValueName[14] = bpno < 10 ? _T('0') + (TCHAR)bpno : _T('A') + (TCHAR)(bpno - 10);
+    Settings_LoadStringValue(bufValueName, buffer, 64);
+}
 
 SETTINGS_GETSET_DWORD(DebugMemoryMode, _T("DebugMemoryMode"), WORD, 3);
 SETTINGS_GETSET_DWORD(DebugMemoryAddress, _T("DebugMemoryAddress"), WORD, 0);
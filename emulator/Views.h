@@ -91,6 +91,7 @@ LRESULT CALLBACK DisasmViewWndProc(HWND, UINT, WPARAM, LPARAM);
 LRESULT CALLBACK DisasmViewViewerWndProc(HWND, UINT, WPARAM, LPARAM);
 void DisasmView_OnUpdate();
 void DisasmView_LoadUnloadSubtitles();
+LPCTSTR DisasmView_GetSubtitlesFileName();  // nullptr if no subtitles loaded
 
 
 //////////////////////////////////////////////////////////////////////
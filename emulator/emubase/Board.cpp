@@ -13,9 +13,7 @@ NEMIGABTL. If not, see <http://www.gnu.org/licenses/>. */
 
 #include "stdafx.h"
 #include "Emubase.h"
-
-void TraceInstruction(const CProcessor* pProc, const CMotherboard* pBoard, uint16_t address, uint32_t dwTrace);
-
+#include <chrono>
 
 //////////////////////////////////////////////////////////////////////
 
@@ -30,7 +28,19 @@ CMotherboard::CMotherboard() :
     m_okTimer50OnOff = false;
     m_okSoundOnOff = false;
     m_Timer1 = m_Timer1div = m_Timer2 = 0;
-    m_CPUbps = nullptr;
+    m_Timer1cycle = 0;
+    m_EventCount = 0;
+    m_FrameCycle = 0;
+    m_SerialTxCount = 0;
+    m_pCPUbps = nullptr;
+    m_pTraceWriter = nullptr;
+    m_okTracePending = false;
+    ::memset(&m_Counters, 0, sizeof(m_Counters));
+    m_okHostTiming = false;
+    m_HostTimingEvents = 0;
+    m_HostClockCost = 0;
+    m_pWatches = nullptr;
+    m_okWatchHit = false;
 
     // Allocate memory for RAM and ROM
     m_pRAM = static_cast<uint8_t*>(::calloc(128 * 1024, 1));
@@ -70,6 +80,7 @@ void CMotherboard::SetConfiguration(uint16_t conf)
     // Clean RAM/ROM
     ::memset(m_pRAM, 0, 128 * 1024);
     ::memset(m_pROM, 0, 4 * 1024);
+    m_pCPU->InvalidateDecodedAll();
 
     //// Pre-fill RAM with "uninitialized" values
     //uint16_t * pMemory = (uint16_t *) m_pRAM;
@@ -93,6 +104,8 @@ void CMotherboard::SetConfiguration(uint16_t conf)
     //{
     //    delete m_pFloppyCtl;  m_pFloppyCtl = nullptr;
     //}
+
+    UpdateMemoryMap();
 }
 
 void CMotherboard::SetTrace(uint32_t dwTrace)
@@ -102,6 +115,57 @@ void CMotherboard::SetTrace(uint32_t dwTrace)
         m_pFloppyCtl->SetTrace((dwTrace & TRACE_FLOPPY) != 0);
 }
 
+void CMotherboard::SetTraceWriter(CTraceWriter* pWriter)
+{
+    if (m_okTracePending)  // Flush the last instruction to the old writer
+    {
+        m_pTraceWriter->Add(m_TraceRecord);
+        m_okTracePending = false;
+    }
+    m_pTraceWriter = pWriter;
+    UpdateMemoryMap();
+}
+
+const BoardCounters& CMotherboard::GetCounters()
+{
+    if (m_pFloppyCtl != nullptr)
+    {
+        m_Counters.trackloads = m_pFloppyCtl->GetTrackLoadCount();
+        m_Counters.trackflushes = m_pFloppyCtl->GetTrackFlushCount();
+    }
+    return m_Counters;
+}
+
+void CMotherboard::ResetCounters()
+{
+    ::memset(&m_Counters, 0, sizeof(m_Counters));
+    if (m_pFloppyCtl != nullptr)
+        m_pFloppyCtl->ResetCounters();
+    m_pCPU->ResetCounters();
+}
+
+static inline uint64_t GetHostNanoseconds()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void CMotherboard::SetHostTiming(bool okOnOff)
+{
+    m_okHostTiming = okOnOff;
+    if (!okOnOff)
+        return;
+    // The shortest of some back-to-back clock reads
+    m_HostClockCost = UINT64_MAX;
+    for (int i = 0; i < 16; i++)
+    {
+        uint64_t hostTime = GetHostNanoseconds();
+        uint64_t cost = GetHostNanoseconds() - hostTime;
+        if (cost < m_HostClockCost)
+            m_HostClockCost = cost;
+    }
+}
+
 void CMotherboard::Reset()
 {
     m_pCPU->Stop();
@@ -130,6 +194,7 @@ void CMotherboard::Reset()
 void CMotherboard::LoadROM(const uint8_t* pBuffer)
 {
     memcpy(m_pROM, pBuffer, 4096);
+    m_pCPU->InvalidateDecodedAll();
 }
 
 void CMotherboard::LoadRAM(int startbank, const uint8_t* pBuffer, int length)
@@ -139,6 +204,7 @@ void CMotherboard::LoadRAM(int startbank, const uint8_t* pBuffer, int length)
     int address = 8192 * startbank;
     ASSERT(address + length <= 128 * 1024);
     ::memcpy(m_pRAM + address, pBuffer, length);
+    m_pCPU->InvalidateDecodedAll();
 }
 
 
@@ -212,20 +278,24 @@ uint8_t CMotherboard::GetHIRAMByte(uint16_t offset) const
 void CMotherboard::SetRAMWord(uint16_t offset, uint16_t word) const
 {
     *reinterpret_cast<uint16_t*>(m_pRAM + offset) = word;
+    m_pCPU->InvalidateDecoded(offset >> 1);
 }
 void CMotherboard::SetHIRAMWord(uint16_t offset, uint16_t word)
 {
     uint32_t dwOffset = static_cast<uint32_t>(0x10000) + static_cast<uint32_t>(offset);
     *reinterpret_cast<uint16_t*>(m_pRAM + dwOffset) = word;
+    m_pCPU->InvalidateDecoded(dwOffset >> 1);
 }
 void CMotherboard::SetRAMByte(uint16_t offset, uint8_t byte) const
 {
     m_pRAM[offset] = byte;
+    m_pCPU->InvalidateDecoded(offset >> 1);
 }
 void CMotherboard::SetHIRAMByte(uint16_t offset, uint8_t byte)
 {
     uint32_t dwOffset = static_cast<uint32_t>(0x10000) + static_cast<uint32_t>(offset);
     m_pRAM[dwOffset] = byte;
+    m_pCPU->InvalidateDecoded(dwOffset >> 1);
 }
 
 uint16_t CMotherboard::GetROMWord(uint16_t offset) const
@@ -245,6 +315,8 @@ uint8_t CMotherboard::GetROMByte(uint16_t offset) const
 
 void CMotherboard::ResetDevices()
 {
+    m_pCPU->BreakIdleLoop();
+
     if (m_pFloppyCtl != nullptr)
         m_pFloppyCtl->Reset();
 
@@ -254,6 +326,7 @@ void CMotherboard::ResetDevices()
     m_Port170006 = 0;
     m_Port170006wr = 0;
     m_Port177574 = 0;
+    UpdateMemoryMap();
     //m_pCPU->FireHALT();
 
     // Reset ports
@@ -270,6 +343,7 @@ void CMotherboard::ResetHALT()
 
 void CMotherboard::RegisterHaltRq(uint8_t flags)
 {
+    m_pCPU->BreakIdleLoop();
     m_Port170007acc |= flags;
     if ((m_Port170006wr & 3) == 0)
         m_pCPU->FireHALT();
@@ -324,30 +398,61 @@ void CMotherboard::Tick50()  // 50 Hz timer
     }
 }
 
-void CMotherboard::TimerTick() // Timer Tick, 8 MHz
+// Timer 1 works on the CPU clock, 8 MHz; the state is calculated on demand, before the timer is read or reprogrammed.
+// The result is the same as counting every tick: the subcounter counts down from 2^octave, then the counter decrements.
+void CMotherboard::UpdateTimer(uint64_t cycle)
 {
-    if (m_Timer1 == 0 || m_Timer1div == 0)
+    if (m_Timer1cycle >= cycle)
+        return;
+    uint64_t ticks = cycle - m_Timer1cycle;
+    m_Timer1cycle = cycle;
+
+    uint16_t octave = m_Port170030 & 7;  // Октава 1..7
+    uint16_t divider = static_cast<uint16_t>(1 << octave);
+    while (ticks > 0)
     {
-        // Если разряды 2 и 3 равны 1 1, то запуск первого счётчика происходит по тактовому входу С1
-        if ((m_Port170020 & 014) == 014)
+        if (m_Timer1 == 0 || m_Timer1div == 0)
         {
-            uint16_t octave = m_Port170030 & 7;  // Октава 1..7
-            m_Timer1div = (1 << octave);
+            // Если разряды 2 и 3 равны 1 1, то запуск первого счётчика происходит по тактовому входу С1
+            if ((m_Port170020 & 014) != 014)
+                return;  // Timer stopped
+            m_Timer1div = divider;
             m_Timer1 = m_Port170022;
+            ticks--;
+            if (m_Timer1 == 0)
+                return;  // Zero counter reloads the same values every tick
+            continue;
         }
-        return;
-    }
-
-    m_Timer1div--;
-    if (m_Timer1div == 0)
-    {
-        uint16_t octave = m_Port170030 & 7;  // Октава 1..7
-        m_Timer1div = (1 << octave);
 
+        if (ticks < m_Timer1div)
+        {
+            m_Timer1div -= static_cast<uint16_t>(ticks);
+            return;
+        }
+        ticks -= m_Timer1div;
+        m_Timer1div = divider;
         m_Timer1--;
         if (m_Timer1 == 0)
         {
             m_Timer1 = m_Port170022;
+            if (m_Timer1 == 0)
+                continue;
+        }
+
+        // Whole subcounter periods, the counter goes down to 1 then reloads
+        uint64_t periods = ticks / divider;
+        if (periods > 0)
+        {
+            if (periods < m_Timer1)
+                m_Timer1 -= static_cast<uint16_t>(periods);
+            else if (m_Port170022 == 0)
+            {
+                periods = m_Timer1;
+                m_Timer1 = 0;
+            }
+            else
+                m_Timer1 = static_cast<uint16_t>(m_Port170022 - (periods - m_Timer1) % m_Port170022);
+            ticks -= periods * divider;
         }
     }
 }
@@ -356,6 +461,7 @@ void CMotherboard::DebugTicks()
 {
     m_pCPU->ClearInternalTick();
     m_pCPU->Execute();
+    m_Timer1cycle = m_pCPU->GetCycleCount();  // Debug ticks do not count for the timer
     if (m_pFloppyCtl != nullptr)
         m_pFloppyCtl->Periodic();
 }
@@ -363,6 +469,7 @@ void CMotherboard::DebugTicks()
 void CMotherboard::ExecuteCPU()
 {
     m_pCPU->Execute();
+    m_Timer1cycle = m_pCPU->GetCycleCount();
 }
 
 /*
@@ -376,50 +483,215 @@ void CMotherboard::ExecuteCPU()
 */
 bool CMotherboard::SystemFrame()
 {
-    const int frameProcTicks = 16;
-    const int audioticks = 20286 / (SOUNDSAMPLERATE / 25);
-    const int floppyTicks = 32;
-    //const int serialOutTicks = 20000 / (9600 / 25);
-    int serialTxCount = 0;
+    bool okTracing = (m_dwTrace & TRACE_CPU) != 0 && m_pTraceWriter != nullptr;
+    bool okBreakpoints = m_pCPUbps != nullptr && m_pCPUbps->GetCount() > 0;
+    m_pCPU->SetBreakpoints(okBreakpoints ? m_pCPUbps : nullptr);
+    if (okBreakpoints)
+        return okTracing ? RunFrame<true, true>() : RunFrame<false, true>();
+    else
+        return okTracing ? RunFrame<true, false>() : RunFrame<false, false>();
+}
+
+template<bool tracing, bool breakpoints>
+bool CMotherboard::RunFrame()
+{
+    m_pCPU->BreakIdleLoop();  // Keyboard, floppies and memory could change between frames
+    m_okWatchHit = false;
+
+    // Every device starts the frame with an event at frame tick 0
+    m_FrameCycle = m_pCPU->GetCycleCount();
+    m_EventCount = 0;
+    m_SerialTxCount = 0;
+    ScheduleEvent(BOARDEVENT_TICK50, 0);
+    ScheduleEvent(BOARDEVENT_FLOPPY, 0);
+    ScheduleEvent(BOARDEVENT_SOUND, 0);
+    if (m_SerialInCallback != nullptr)
+        ScheduleEvent(BOARDEVENT_SERIALIN, 0);
+    if (m_SerialOutCallback != nullptr)
+        ScheduleEvent(BOARDEVENT_SERIALOUT, 0);
+
+    // The CPU runs freely from one event to the next one.
+    // Host timing reads the clock twice per frame and around the sampled events only, the clock is slow
+    // compared to the short CPU runs between the events; the rest of the frame time goes to the CPU.
+    uint64_t hostTimeFrame = m_okHostTiming ? GetHostNanoseconds() : 0;
+    uint64_t hostTimeDevices = 0;
+    bool okRun = true;
+    while (m_EventCount > 0)
+    {
+        BoardEvent next = PopEvent();
+        okRun = RunCPU<tracing, breakpoints>(next.cycle);
+        if (!okRun)
+            break;
+
+        int frameticks = static_cast<int>((next.cycle - m_FrameCycle) / FRAME_PROCTICKS) - 1;
+        if (m_okHostTiming && ++m_HostTimingEvents % HOSTTIMING_SAMPLE == 0)
+        {
+            uint64_t hostTime = GetHostNanoseconds();
+            ProcessEvent(next.event, frameticks);
+            uint64_t hostTimeEvent = GetHostNanoseconds() - hostTime;
+            if (hostTimeEvent > m_HostClockCost)
+                hostTimeDevices += (hostTimeEvent - m_HostClockCost) * HOSTTIMING_SAMPLE;
+        }
+        else
+            ProcessEvent(next.event, frameticks);
+    }
+
+    if (okRun)
+        okRun = RunCPU<tracing, breakpoints>(m_FrameCycle + FRAME_TICKS * FRAME_PROCTICKS);
+    if (m_okHostTiming)
+    {
+        uint64_t hostTime = GetHostNanoseconds() - hostTimeFrame;
+        if (hostTimeDevices > hostTime)
+            hostTimeDevices = hostTime;
+        m_Counters.hostdevices += hostTimeDevices;
+        m_Counters.hostcpu += hostTime - hostTimeDevices;
+    }
+    if (!okRun)
+        return false;
+
+    UpdateTimer(m_pCPU->GetCycleCount());
+
+    return true;
+}
 
-    for (int frameticks = 0; frameticks < 20000; frameticks++)
+template<bool tracing, bool breakpoints>
+bool CMotherboard::RunCPU(uint64_t cycle)
+{
+    if (tracing)
     {
-        for (int procticks = 0; procticks < frameProcTicks; procticks++)  // CPU ticks
+        while (m_pCPU->GetCycleCount() < cycle)  // CPU ticks
         {
 #if !defined(PRODUCT)
-            if ((m_dwTrace & TRACE_CPU) && m_pCPU->GetInternalTick() == 0)
-                TraceInstruction(m_pCPU, this, m_pCPU->GetPC(), m_dwTrace);
+            if (tracing && m_pCPU->GetInternalTick() == 0 && !m_pCPU->IsStopped() && !m_pCPU->IsWaitMode())
+                TraceInstruction();
 #endif
             m_pCPU->Execute();
-            if (m_CPUbps != nullptr)  // Check for breakpoints
+            // Check for breakpoints at instruction boundary, when the next tick starts the instruction at PC
+            if (breakpoints && m_pCPU->GetInternalTick() == 0 && !m_pCPU->IsStopped() && !m_pCPU->IsWaitMode())
             {
-                const uint16_t* pbps = m_CPUbps;
-                while (*pbps != 0177777) { if (m_pCPU->GetPC() == *pbps++) return false; }
+                uint16_t pc = m_pCPU->GetPC();
+                if (m_pCPUbps->IsBreakpoint(pc) && m_pCPUbps->Check(pc, m_pCPU, this))
+                {
+                    UpdateTimer(m_pCPU->GetCycleCount());
+                    return false;
+                }
             }
 
-            // Timer 1 ticks
-            TimerTick();
+            if (m_okWatchHit)
+            {
+                UpdateTimer(m_pCPU->GetCycleCount());
+                return false;
+            }
 
             // Update interrupts
             if (m_Port170007acc != 0 && (m_Port170006wr & 3) == 0)
                 m_pCPU->FireHALT();
         }
-
-        if (frameticks == 0 || frameticks == 10000)
+    }
+    else  // CPU ticks in batch, up to the next instruction that writes to port 170006, breakpoints are checked by CPU
+    {
+        while (m_pCPU->GetCycleCount() < cycle)
         {
-            Tick50();  // 1/50 timer event
+            // Update interrupts
+            if (m_Port170007acc != 0 && (m_Port170006wr & 3) == 0)
+                m_pCPU->FireHALT();
+
+            m_pCPU->ExecuteUntil(cycle);
+            if (m_okWatchHit || (breakpoints && m_pCPU->IsBreakpointHit()))
+            {
+                UpdateTimer(m_pCPU->GetCycleCount());
+                return false;
+            }
         }
+    }
+
+    return true;
+}
+
+// Events beyond the current frame are dropped, the next frame starts all the devices again
+void CMotherboard::ScheduleEvent(int event, int frameticks)
+{
+    if (frameticks >= FRAME_TICKS)
+        return;
+
+    BoardEvent ev;
+    ev.cycle = m_FrameCycle + static_cast<uint64_t>(frameticks + 1) * FRAME_PROCTICKS;
+    ev.event = event;
+
+    // Sift up
+    int index = m_EventCount++;
+    while (index > 0)
+    {
+        int parent = (index - 1) / 2;
+        const BoardEvent& evp = m_Events[parent];
+        if (evp.cycle < ev.cycle || (evp.cycle == ev.cycle && evp.event < ev.event))
+            break;
+        m_Events[index] = evp;
+        index = parent;
+    }
+    m_Events[index] = ev;
+}
 
-        if (frameticks % floppyTicks == 0)  // FDD tick, every 64 uS
+CMotherboard::BoardEvent CMotherboard::PopEvent()
+{
+    BoardEvent top = m_Events[0];
+    BoardEvent ev = m_Events[--m_EventCount];
+
+    // Sift down
+    int index = 0;
+    for (;;)
+    {
+        int child = index * 2 + 1;
+        if (child >= m_EventCount)
+            break;
+        if (child + 1 < m_EventCount)
         {
-            if (m_pFloppyCtl != nullptr)
-                m_pFloppyCtl->Periodic();
+            const BoardEvent& evl = m_Events[child];
+            const BoardEvent& evr = m_Events[child + 1];
+            if (evr.cycle < evl.cycle || (evr.cycle == evl.cycle && evr.event < evl.event))
+                child++;
         }
+        const BoardEvent& evc = m_Events[child];
+        if (ev.cycle < evc.cycle || (ev.cycle == evc.cycle && ev.event < evc.event))
+            break;
+        m_Events[index] = evc;
+        index = child;
+    }
+    m_Events[index] = ev;
+
+    return top;
+}
+
+void CMotherboard::ProcessEvent(int event, int frameticks)
+{
+    const int audioticks = 20286 / (SOUNDSAMPLERATE / 25);
+    const int floppyTicks = 32;
+    //const int serialOutTicks = 20000 / (9600 / 25);
+    const int serialTicks = 52;
+
+    if (event != BOARDEVENT_SOUND)  // Sound does not change anything the CPU can see
+        m_pCPU->BreakIdleLoop();
+
+    switch (event)
+    {
+    case BOARDEVENT_TICK50:  // 1/50 timer event
+        Tick50();
+        ScheduleEvent(BOARDEVENT_TICK50, frameticks + FRAME_TICKS / 2);
+        break;
 
-        if (frameticks % audioticks == 0)  // AUDIO tick
-            DoSound();
+    case BOARDEVENT_FLOPPY:  // FDD tick, every 64 uS
+        if (m_pFloppyCtl != nullptr)
+            m_pFloppyCtl->Periodic();
+        ScheduleEvent(BOARDEVENT_FLOPPY, frameticks + floppyTicks);
+        break;
+
+    case BOARDEVENT_SOUND:  // AUDIO tick
+        UpdateTimer(m_pCPU->GetCycleCount());
+        DoSound();
+        ScheduleEvent(BOARDEVENT_SOUND, frameticks + audioticks);
+        break;
 
-        if (m_SerialInCallback != nullptr && frameticks % 52 == 0)
+    case BOARDEVENT_SERIALIN:
         {
             uint8_t b;
             if (m_SerialInCallback(&b))
@@ -435,44 +707,45 @@ bool CMotherboard::SystemFrame()
                 }
             }
         }
-        if (m_SerialOutCallback != nullptr && frameticks % 52 == 0)
+        ScheduleEvent(BOARDEVENT_SERIALIN, frameticks + serialTicks);
+        break;
+
+    case BOARDEVENT_SERIALOUT:
+        if (m_SerialTxCount > 0)
         {
-            if (serialTxCount > 0)
+            m_SerialTxCount--;
+            if (m_SerialTxCount == 0)  // Translation countdown finished - the byte translated
             {
-                serialTxCount--;
-                if (serialTxCount == 0)  // Translation countdown finished - the byte translated
-                {
-                    (*m_SerialOutCallback)(static_cast<uint8_t>(m_Port176506 & 0xff));
-                    m_Port176504 |= 0200;  // Set Ready flag
-                    if (m_Port176504 & 0100)  // Interrupt?
-                        m_pCPU->InterruptVIRQ(8, 0304);
-                }
-            }
-            else if ((m_Port176504 & 0200) == 0)  // Ready is 0?
-            {
-                serialTxCount = 8;  // Start translation countdown
+                (*m_SerialOutCallback)(static_cast<uint8_t>(m_Port176506 & 0xff));
+                m_Port176504 |= 0200;  // Set Ready flag
+                if (m_Port176504 & 0100)  // Interrupt?
+                    m_pCPU->InterruptVIRQ(8, 0304);
             }
         }
-
-        if (m_ParallelOutCallback != nullptr)
+        else if ((m_Port176504 & 0200) == 0)  // Ready is 0?
         {
-            //if ((m_Port177514 & 0240) == 040)
-            //{
-            //    m_Port177514 |= 0200;  // Set TR flag
-            //    // Now printer waits for a next byte
-            //    if (m_Port177514 & 0100)
-            //        m_pCPU->InterruptVIRQ(5, 0200);
-            //}
-            //else if ((m_Port177514 & 0240) == 0)
-            //{
-            //    // Byte is ready, print it
-            //    (*m_ParallelOutCallback)((uint8_t)(m_Port177516 & 0xff));
-            //    m_Port177514 |= 040;  // Set Printer Acknowledge
-            //}
+            m_SerialTxCount = 8;  // Start translation countdown
         }
+        ScheduleEvent(BOARDEVENT_SERIALOUT, frameticks + serialTicks);
+        break;
     }
 
-    return true;
+    if (m_ParallelOutCallback != nullptr)
+    {
+        //if ((m_Port177514 & 0240) == 040)
+        //{
+        //    m_Port177514 |= 0200;  // Set TR flag
+        //    // Now printer waits for a next byte
+        //    if (m_Port177514 & 0100)
+        //        m_pCPU->InterruptVIRQ(5, 0200);
+        //}
+        //else if ((m_Port177514 & 0240) == 0)
+        //{
+        //    // Byte is ready, print it
+        //    (*m_ParallelOutCallback)((uint8_t)(m_Port177516 & 0xff));
+        //    m_Port177514 |= 040;  // Set Printer Acknowledge
+        //}
+    }
 }
 
 // Key pressed or released
@@ -536,8 +809,17 @@ uint16_t CMotherboard::GetWordView(uint16_t address, bool okHaltMode, bool okExe
 
 uint16_t CMotherboard::GetWord(uint16_t address, bool okHaltMode, bool okExec)
 {
+    int page = address >> 12;
+    if (m_PageFlags[page] & (okExec ? MEMPAGE_EXEC : MEMPAGE_READ))  // Plain RAM or ROM
+        return *reinterpret_cast<const uint16_t*>(m_pPages[page] + (address & m_PageWordMask[page]));
+    if (m_PageWatch[page] & (okExec ? WATCH_EXEC : WATCH_READ))
+        CheckWatchpoint(address, okHaltMode, okExec ? WATCH_EXEC : WATCH_READ, false, 0);
+
     uint16_t offset;
     int addrtype = TranslateAddress(address, okHaltMode, okExec, &offset);
+    m_Counters.addrtypes[addrtype & ADDRTYPE_MASK]++;
+    if (addrtype & (ADDRTYPE_IO | ADDRTYPE_TERM))
+        m_Counters.portreads[(address - 0170000) >> 1]++;
 
     switch (addrtype & ADDRTYPE_MASK)
     {
@@ -575,8 +857,17 @@ uint16_t CMotherboard::GetWord(uint16_t address, bool okHaltMode, bool okExec)
 
 uint8_t CMotherboard::GetByte(uint16_t address, bool okHaltMode)
 {
+    int page = address >> 12;
+    if (m_PageFlags[page] & MEMPAGE_READ)  // Plain RAM or ROM
+        return m_pPages[page][address & 07777];
+    if (m_PageWatch[page] & WATCH_READ)
+        CheckWatchpoint(address, okHaltMode, WATCH_READ, true, 0);
+
     uint16_t offset;
     int addrtype = TranslateAddress(address, okHaltMode, false, &offset);
+    m_Counters.addrtypes[addrtype & ADDRTYPE_MASK]++;
+    if (addrtype & (ADDRTYPE_IO | ADDRTYPE_TERM))
+        m_Counters.portreads[(address - 0170000) >> 1]++;
 
     switch (addrtype & ADDRTYPE_MASK)
     {
@@ -614,9 +905,24 @@ uint8_t CMotherboard::GetByte(uint16_t address, bool okHaltMode)
 
 void CMotherboard::SetWord(uint16_t address, bool okHaltMode, uint16_t word)
 {
-    uint16_t offset;
+    int page = address >> 12;
+    if (m_PageFlags[page] & MEMPAGE_WRITE)  // Plain RAM
+    {
+        uint8_t* pMemory = m_pPages[page] + (address & 07776);
+        *reinterpret_cast<uint16_t*>(pMemory) = word;
+        m_pCPU->InvalidateDecoded(static_cast<int>((pMemory - m_pRAM) >> 1));
+        return;
+    }
+    if (m_PageWatch[page] & WATCH_WRITE)
+        CheckWatchpoint(address, okHaltMode, WATCH_WRITE, false, word);
+    if (m_okTracePending)
+        TraceMemoryWrite(address & ~1, word, false);
 
+    uint16_t offset;
     int addrtype = TranslateAddress(address, okHaltMode, false, &offset);
+    m_Counters.addrtypes[addrtype & ADDRTYPE_MASK]++;
+    if (addrtype & (ADDRTYPE_IO | ADDRTYPE_TERM))
+        m_Counters.portwrites[(address - 0170000) >> 1]++;
 
     switch (addrtype & ADDRTYPE_MASK)
     {
@@ -667,8 +973,24 @@ void CMotherboard::SetWord(uint16_t address, bool okHaltMode, uint16_t word)
 
 void CMotherboard::SetByte(uint16_t address, bool okHaltMode, uint8_t byte)
 {
+    int page = address >> 12;
+    if (m_PageFlags[page] & MEMPAGE_WRITE)  // Plain RAM
+    {
+        uint8_t* pMemory = m_pPages[page] + (address & 07777);
+        *pMemory = byte;
+        m_pCPU->InvalidateDecoded(static_cast<int>((pMemory - m_pRAM) >> 1));
+        return;
+    }
+    if (m_PageWatch[page] & WATCH_WRITE)
+        CheckWatchpoint(address, okHaltMode, WATCH_WRITE, true, byte);
+    if (m_okTracePending)
+        TraceMemoryWrite(address, byte, true);
+
     uint16_t offset;
     int addrtype = TranslateAddress(address, okHaltMode, false, &offset);
+    m_Counters.addrtypes[addrtype & ADDRTYPE_MASK]++;
+    if (addrtype & (ADDRTYPE_IO | ADDRTYPE_TERM))
+        m_Counters.portwrites[(address - 0170000) >> 1]++;
 
     switch (addrtype & ADDRTYPE_MASK)
     {
@@ -776,6 +1098,66 @@ int CMotherboard::TranslateAddress(uint16_t address, bool okHaltMode, bool /*okE
     }
 }
 
+void CMotherboard::UpdateMemoryMap()
+{
+    for (int page = 0; page < 14; page++)  // 000000-157777 -- RAM
+    {
+        uint16_t address = static_cast<uint16_t>(page << 12);
+        uint16_t offset;
+        int addrtype = TranslateAddress(address, false, false, &offset);
+        m_pPages[page] = m_pRAM + offset + ((addrtype == ADDRTYPE_HIRAM) ? 0x10000 : 0);
+        m_PageFlags[page] = MEMPAGE_READ | MEMPAGE_WRITE | MEMPAGE_EXEC;
+        m_PageWordMask[page] = 07776;
+    }
+
+    // 160000-167777 -- ROM
+    m_pPages[14] = m_pROM;
+    m_PageFlags[14] = MEMPAGE_READ | MEMPAGE_EXEC;  // Writing to ROM goes to the slow path: exception
+    m_PageWordMask[14] = 07777;
+
+    // 170000-177777 -- Ports, terminal registers and HALT-mode RAM: slow path only
+    m_pPages[15] = nullptr;
+    m_PageFlags[15] = 0;
+    m_PageWordMask[15] = 0;
+
+    // Watched accesses go to the slow path, see CheckWatchpoint(); so do all writes for the trace, see TraceMemoryWrite()
+    for (int page = 0; page < 16; page++)
+    {
+        m_PageWatch[page] = (m_pWatches != nullptr) ? m_pWatches->GetPageFlags(page) : 0;
+        m_PageFlags[page] &= ~m_PageWatch[page];
+        if (m_pTraceWriter != nullptr)
+            m_PageFlags[page] &= ~MEMPAGE_WRITE;
+    }
+}
+
+void CMotherboard::SetWatchpoints(CWatchpointList* watches)
+{
+    m_pWatches = watches;
+    UpdateMemoryMap();
+}
+
+// Called on the slow path for the watched page; records the first hit and stops the frame after the instruction
+void CMotherboard::CheckWatchpoint(uint16_t address, bool okHaltMode, uint8_t access, bool okByte, uint16_t value)
+{
+    if (!okByte)
+        address &= ~1;
+    if (m_okWatchHit || !m_pWatches->IsWatched(address, okByte ? 1 : 2, access))
+        return;
+
+    int addrtype;
+    uint16_t oldvalue = GetWordView(address & ~1, okHaltMode, access == WATCH_EXEC, &addrtype);
+    if (okByte)
+        oldvalue = (address & 1) ? (oldvalue >> 8) : (oldvalue & 0377);
+    m_WatchHit.pc = m_pCPU->GetInstructionPC();
+    m_WatchHit.address = address;
+    m_WatchHit.oldvalue = oldvalue;
+    m_WatchHit.newvalue = (access == WATCH_WRITE) ? value : oldvalue;
+    m_WatchHit.access = access;
+    m_WatchHit.okByte = okByte;
+    m_okWatchHit = true;
+    m_pCPU->BreakExecution();  // See RunCPU()
+}
+
 uint8_t CMotherboard::GetPortByte(uint16_t address)
 {
     if (address & 1)
@@ -814,12 +1196,14 @@ uint16_t CMotherboard::GetPortWord(uint16_t address)
     case 0170026:  // RgOn -- Sound On
         if (m_dwTrace & TRACE_TIMER) DebugLogFormat(_T("%06o Sound ON\r\n"), m_pCPU->GetPC());
         m_okSoundOnOff = true;
+        m_pCPU->BreakIdleLoop();
         return 0;  //STUB
     case 0170030:  // RgOct
         return m_Port170030;
     case 0170032:  // RgOff -- Sound Off
         if (m_dwTrace & TRACE_TIMER) DebugLogFormat(_T("%06o Sound OFF\r\n"), m_pCPU->GetPC());
         m_okSoundOnOff = !m_okSoundOnOff;
+        m_pCPU->BreakIdleLoop();
         return 0;  //STUB
 
         // Последовательный порт (отсутствует на реальной Немиге)
@@ -841,6 +1225,7 @@ uint16_t CMotherboard::GetPortWord(uint16_t address)
         return m_pFloppyCtl->GetState();
     case 0177102:  // RgData -- Floppy data
         if (m_pFloppyCtl == nullptr) return 0;
+        m_pCPU->BreakIdleLoop();
         return m_pFloppyCtl->GetData();
     case 0177104:  // RgCntrl -- Floppy command
         return 0;  //STUB
@@ -975,6 +1360,8 @@ void CMotherboard::SetPortByte(uint16_t address, uint8_t byte)
 
 void CMotherboard::SetPortWord(uint16_t address, uint16_t word)
 {
+    m_pCPU->BreakIdleLoop();
+
     switch (address)
     {
     case 0170000:
@@ -988,6 +1375,7 @@ void CMotherboard::SetPortWord(uint16_t address, uint16_t word)
             bool oldmode = (m_Port170006wr & 3) != 0;
             bool newmode = (word & 3) != 0;
             m_Port170006wr = word & 0xFF;
+            m_pCPU->BreakExecution();  // HALT requests are checked after the instruction, see SystemFrame()
             if (!oldmode && newmode)  // прерывания отключены (MODE3)
             {
                 //if (m_Port170007 != 0)
@@ -1021,10 +1409,12 @@ void CMotherboard::SetPortWord(uint16_t address, uint16_t word)
 
     case 0170020:  // Timer status
         if (m_dwTrace & TRACE_TIMER) DebugLogFormat(_T("Timer Status SET %06o\r\n"), word);
+        UpdateTimer(m_pCPU->GetCycleCount());  // Timer 1 sees the new value from the current tick
         m_Port170020 = word & 01777;
         break;
     case 0170022:
         if (m_dwTrace & TRACE_TIMER) DebugLogFormat(_T("Timer Freq  SET %06o\r\n"), word);
+        UpdateTimer(m_pCPU->GetCycleCount());
         m_Port170022 = word;
         break;
     case 0170024:
@@ -1037,6 +1427,7 @@ void CMotherboard::SetPortWord(uint16_t address, uint16_t word)
         break;
     case 0170030:
         if (m_dwTrace & TRACE_TIMER) DebugLogFormat(_T("Timer OctVol SET %06o\r\n"), word);
+        UpdateTimer(m_pCPU->GetCycleCount());
         m_Port170030 = word & 037;
         break;
     case 0170032:  // Sound On/Off trigger
@@ -1100,6 +1491,7 @@ void CMotherboard::SetPortWord(uint16_t address, uint16_t word)
         if (m_pCPU->GetInstructionPC() < 0160000)
             DebugLogFormat(_T("WRITE 177574 value %06o PC=%06o\r\n"), word, m_pCPU->GetInstructionPC());
         m_Port177574 = word;
+        UpdateMemoryMap();
         break;
     case 0177576:
         break;  //STUB
@@ -1111,6 +1503,7 @@ void CMotherboard::SetPortWord(uint16_t address, uint16_t word)
         break;
     case 0177570:
         *(uint16_t*)(m_pRAM + m_Port177572 + m_Port177572) = word;
+        m_pCPU->InvalidateDecoded(m_Port177572);
         break;
 
     default:
@@ -1193,6 +1586,7 @@ void CMotherboard::LoadFromImage(const uint8_t* pImage)
     m_Timer1div = *pwImage++;                           //   74
     m_Timer2 = *pwImage++;                              //   76
     m_okSoundOnOff = ((*pwImage++) != 0);               //   78
+    UpdateMemoryMap();
 
     // CPU status
     const uint8_t* pImageCPU = pImage + 160;
@@ -1204,6 +1598,7 @@ void CMotherboard::LoadFromImage(const uint8_t* pImage)
     // RAM
     const uint8_t* pImageRam = pImage + 16384;
     memcpy(m_pRAM, pImageRam, 128 * 1024);
+    m_pCPU->InvalidateDecodedAll();
 }
 
 
@@ -1282,33 +1677,62 @@ void CMotherboard::SetParallelOutCallback(PARALLELOUTCALLBACK outcallback)
 
 //////////////////////////////////////////////////////////////////////
 
+// Called on the slow path of SetWord() and SetByte(), all the writes go there while the trace writer is set
+void CMotherboard::TraceMemoryWrite(uint16_t address, uint16_t value, bool okByte)
+{
+    TraceRecord& record = m_TraceRecord;
+    int index = record.writecount;
+    if (index < TRACERECORD_WRITES)
+    {
+        record.writes[index][0] = address;
+        record.writes[index][1] = value;
+        if (okByte)
+            record.writebytes |= (1 << index);
+    }
+    if (record.writecount < 255)
+        record.writecount++;
+}
+
 #if !defined(PRODUCT)
 
-void TraceInstruction(const CProcessor* pProc, const CMotherboard* pBoard, uint16_t address, uint32_t dwTrace)
+// Add the previous instruction to the binary trace, and start the record for the instruction at PC;
+// TRACE_CPUROM and TRACE_CPURAM flags choose the memory to trace
+void CMotherboard::TraceInstruction()
 {
-    bool okHaltMode = pProc->IsHaltMode();
+    if (m_okTracePending)
+    {
+        m_pTraceWriter->Add(m_TraceRecord);
+        m_okTracePending = false;
+    }
 
-    uint16_t memory[4];
-    int addrtype = ADDRTYPE_RAM;
-    memory[0] = pBoard->GetWordView(address + 0 * 2, okHaltMode, true, &addrtype);
-    if (!(addrtype == ADDRTYPE_RAM && (dwTrace & TRACE_CPURAM)) &&
-        !(addrtype == ADDRTYPE_ROM && (dwTrace & TRACE_CPUROM)))
+    uint16_t address = m_pCPU->GetPC();
+    int page = address >> 12;
+    if ((m_dwTrace & (page == 14 ? TRACE_CPUROM : TRACE_CPURAM)) == 0)
         return;
-    memory[1] = pBoard->GetWordView(address + 1 * 2, okHaltMode, true, &addrtype);
-    memory[2] = pBoard->GetWordView(address + 2 * 2, okHaltMode, true, &addrtype);
-    memory[3] = pBoard->GetWordView(address + 3 * 2, okHaltMode, true, &addrtype);
-
-    TCHAR bufaddr[7];
-    PrintOctalValue(bufaddr, address);
-
-    TCHAR instr[8];
-    TCHAR args[32];
-    DisassembleInstruction(memory, address, instr, args);
-    TCHAR buffer[64];
-    _sntprintf(buffer, sizeof(buffer) / sizeof(TCHAR) - 1, _T("%s: %s\t%s\r\n"), bufaddr, instr, args);
-    //_sntprintf(buffer, sizeof(buffer) / sizeof(TCHAR) - 1, _T("%s %s: %s\t%s\r\n"), pProc->IsHaltMode() ? _T("HALT") : _T("USER"), bufaddr, instr, args);
 
-    DebugLog(buffer);
+    uint8_t* pSnapshot = m_pTraceWriter->GetBlockSnapshot();
+    if (pSnapshot != nullptr)  // The record starts a new block in the trace file
+        m_pCPU->SaveToImage(pSnapshot);
+
+    TraceRecord& record = m_TraceRecord;
+    ::memset(&record, 0, sizeof(record));
+    record.cycle = m_pCPU->GetCycleCount();
+    for (int r = 0; r < 8; r++)
+        record.regs[r] = m_pCPU->GetReg(r);
+    record.psw = m_pCPU->GetPSW();
+    for (int i = 0; i < 3; i++)
+    {
+        uint16_t wordaddr = address + i * 2;
+        page = wordaddr >> 12;
+        if (page < 15)  // RAM or ROM, directly from the page table
+            record.memory[i] = *reinterpret_cast<const uint16_t*>(m_pPages[page] + (wordaddr & m_PageWordMask[page]));
+        else
+        {
+            int addrtype;
+            record.memory[i] = GetWordView(wordaddr, m_pCPU->IsHaltMode(), true, &addrtype);
+        }
+    }
+    m_okTracePending = true;
 }
 
 #endif
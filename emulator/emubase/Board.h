@@ -14,6 +14,7 @@ NEMIGABTL. If not, see <http://www.gnu.org/licenses/>. */
 #pragma once
 
 #include "Defines.h"
+#include "Trace.h"
 
 class CProcessor;
 
@@ -32,6 +33,36 @@ class CProcessor;
 #define ADDRTYPE_DENY  128  // Access denied
 #define ADDRTYPE_MASK  255  // RAM type mask
 
+// Memory page table flags, see CMotherboard::UpdateMemoryMap()
+#define MEMPAGE_READ     1  // Direct read from the page memory
+#define MEMPAGE_WRITE    2  // Direct write to the page memory
+#define MEMPAGE_EXEC     4  // Direct instruction fetch from the page memory
+
+// Watchpoint access flags, the same bits as MEMPAGE_Xxx, see CMotherboard::SetWatchpoints()
+#define WATCH_READ       1  // Data read
+#define WATCH_WRITE      2  // Data write
+#define WATCH_EXEC       4  // Instruction fetch
+
+// Decoded instruction cache indices, see CMotherboard::GetDecodeIndex()
+#define DECODEINDEX_ROM   0200000  // First ROM word; RAM words have index = RAM offset / 2
+#define DECODEINDEX_COUNT (DECODEINDEX_ROM + 4096 / 2)
+
+// Frame timing, see CMotherboard::SystemFrame()
+#define FRAME_TICKS         20000  // Frame ticks per frame, 1 frame tick = 2 uS
+#define FRAME_PROCTICKS        16  // CPU ticks per frame tick
+
+// Device events, see CMotherboard::ScheduleEvent(); events at the same frame tick go in this order
+#define BOARDEVENT_TICK50       0  // 50 Hz timer
+#define BOARDEVENT_FLOPPY       1  // Floppy controller
+#define BOARDEVENT_SOUND        2  // Sound sample
+#define BOARDEVENT_SERIALIN     3  // Serial port receiver
+#define BOARDEVENT_SERIALOUT    4  // Serial port transmitter
+#define BOARDEVENT_COUNT        5
+
+// Performance counters, see CMotherboard::GetCounters()
+#define BOARDCOUNTERS_PORTS  04000  // Port counters for 170000-177777, one per word
+#define HOSTTIMING_SAMPLE       64  // Host timing measures every 64th device event, see SetHostTiming()
+
 // Trace flags
 #define TRACE_NONE         0  // Turn off all tracing
 #define TRACE_CPUROM       1  // Trace CPU instructions from ROM
@@ -76,6 +107,31 @@ typedef bool (CALLBACK* SERIALOUTCALLBACK)(uint8_t byte);
 typedef bool (CALLBACK* PARALLELOUTCALLBACK)(uint8_t byte);
 
 class CFloppyController;
+class CBreakpointList;
+class CWatchpointList;
+
+// Watchpoint hit, see CMotherboard::GetWatchpointHit()
+struct WatchpointHit
+{
+    uint16_t    pc;         // Address of the instruction that made the access
+    uint16_t    address;
+    uint16_t    oldvalue;   // Memory value before the access
+    uint16_t    newvalue;   // Value written; the same as oldvalue for read and fetch
+    uint8_t     access;     // WATCH_READ, WATCH_WRITE or WATCH_EXEC
+    bool        okByte;     // Byte access
+};
+
+// Performance counters; the CPU has its own, see ProcessorCounters
+struct BoardCounters
+{
+    uint64_t    addrtypes[ADDRTYPE_MASK + 1];  // Slow path memory accesses by TranslateAddress() result, ADDRTYPE_Xxx
+    uint64_t    portreads[BOARDCOUNTERS_PORTS];   // I/O and terminal port reads, by (address - 170000) / 2
+    uint64_t    portwrites[BOARDCOUNTERS_PORTS];
+    uint64_t    trackloads;     // Floppy tracks read from the image files
+    uint64_t    trackflushes;   // Floppy tracks written to the image files
+    uint64_t    hostcpu;        // Host nanoseconds spent running the CPU, counted with SetHostTiming() only
+    uint64_t    hostdevices;    // Host nanoseconds spent in the device events, estimated from the sampled events
+};
 
 //////////////////////////////////////////////////////////////////////
 
@@ -107,9 +163,17 @@ public:  // Memory access  //TODO: Make it private
     uint8_t     GetROMByte(uint16_t offset) const;
 public:  // Debug
     void        DebugTicks();  // One Debug CPU tick -- use for debug step or debug breakpoint
-    void        SetCPUBreakpoints(const uint16_t* bps) { m_CPUbps = bps; } // Set CPU breakpoint list
+    void        SetCPUBreakpoints(CBreakpointList* bps) { m_pCPUbps = bps; } // Set CPU breakpoint list, nullptr = no breakpoints
+    void        SetWatchpoints(CWatchpointList* watches);  // Set watchpoint list, nullptr = none; call again after the list changes
+    const WatchpointHit* GetWatchpointHit() const { return m_okWatchHit ? &m_WatchHit : nullptr; }  // Why SystemFrame() stopped
     uint32_t    GetTrace() const { return m_dwTrace; }
     void        SetTrace(uint32_t dwTrace);
+    void        SetTraceWriter(CTraceWriter* pWriter);  // CPU trace goes there, nullptr = no CPU trace
+public:  // Performance counters
+    const BoardCounters& GetCounters();  // Counters since the start or ResetCounters()
+    void        ResetCounters();  // Reset the board and the CPU counters
+    // Measure host time in SystemFrame(): frame time, and device time sampled on every HOSTTIMING_SAMPLE-th event
+    void        SetHostTiming(bool okOnOff);
 public:  // System control
     void        SetConfiguration(uint16_t conf);
     uint16_t    GetConfiguration() const { return m_Configuration; }
@@ -119,7 +183,7 @@ public:  // System control
     void        SetTimer50OnOff(bool okOnOff) { m_okTimer50OnOff = okOnOff; }
     bool        IsTimer50OnOff() const { return m_okTimer50OnOff; }
     void        Tick50();           // Tick 50 Hz - goes to CPU EVNT line
-    void        TimerTick();        // Timer Tick, 31250 Hz, 32uS -- dividers are within timer routine
+    void        UpdateTimer(uint64_t cycle);  // Timer 1 state at the given CPU cycle
     void        ResetDevices();     // INIT signal
     void        ResetHALT();//DEBUG
 public:
@@ -128,6 +192,7 @@ public:
     void        KeyboardEvent(uint8_t scancode, bool okPressed);  // Key pressed or released
     //uint16_t        GetPrinterOutPort() const { return m_Port177714out; }
     void        PreProcessHALT();  // Called by the CPU right before the HALT interrupt processing
+    uint8_t     GetHaltRequests() const { return m_Port170007; }  // HALT request bits taken by PreProcessHALT()
 public:  // Floppy
     bool        AttachFloppyImage(int slot, LPCTSTR sFileName);  // Attach MD image
     bool        AttachFloppyMXImage(int slot, LPCTSTR sFileName);  // Attach MX image
@@ -139,6 +204,7 @@ public:  // Callbacks
     void        SetSoundGenCallback(SOUNDGENCALLBACK callback);
     void        SetSerialCallbacks(SERIALINCALLBACK incallback, SERIALOUTCALLBACK outcallback);
     void        SetParallelOutCallback(PARALLELOUTCALLBACK outcallback);
+    void        DoSound();  // Pass the current sound sample to the sound callback
 public:  // Memory
     // Read command for execution
     uint16_t GetWordExec(uint16_t address, bool okHaltMode) { return GetWord(address, okHaltMode, TRUE); }
@@ -158,13 +224,27 @@ public:  // Memory
     uint16_t GetPortView(uint16_t address) const;
     // Get video buffer address
     const uint8_t* GetVideoBuffer() const;
-private:
+    // Index in the CPU decoded instruction cache for the given address, -1 means not cacheable
+    int GetDecodeIndex(uint16_t address) const;
     // Determine memory type for given address - see ADDRTYPE_Xxx constants
     //   address - the address to use
     //   okHaltMode - processor mode (USER/HALT)
     //   okExec - true: read instruction for execution; false: read memory
     //   pOffset - result - offset in memory plane
     int TranslateAddress(uint16_t address, bool okHaltMode, bool okExec, uint16_t* pOffset) const;
+private:
+    // Rebuild the page table; call it on changes in configuration or in port 177574
+    void UpdateMemoryMap();
+private:  // Memory page table, 4 KB pages; flags are the same for HALT and USER modes
+    uint8_t*    m_pPages[16];       // Host memory for the page start
+    uint8_t     m_PageFlags[16];    // MEMPAGE_Xxx flags; 0 = slow path via TranslateAddress()
+    uint16_t    m_PageWordMask[16]; // Offset mask for word access: RAM words are aligned, ROM words are not
+    uint8_t     m_PageWatch[16];    // WATCH_Xxx flags; these accesses take the slow path, see CheckWatchpoint()
+private:  // Watchpoints
+    CWatchpointList* m_pWatches;
+    bool        m_okWatchHit;
+    WatchpointHit m_WatchHit;
+    void        CheckWatchpoint(uint16_t address, bool okHaltMode, uint8_t access, bool okByte, uint16_t value);
 private:  // Access to I/O ports
     uint16_t    GetPortWord(uint16_t address);
     void        SetPortWord(uint16_t address, uint16_t word);
@@ -194,20 +274,56 @@ private:  // Ports: implementation
     uint16_t    m_Port177514;       // Регистр состояния ИРПР
     uint16_t    m_Port177516;       // Регистр данных ИРПР
 private:
-    const uint16_t* m_CPUbps;  // CPU breakpoint list, ends with 177777 value
+    CBreakpointList* m_pCPUbps;  // CPU breakpoints, checked at instruction boundaries
     uint32_t    m_dwTrace;  // Trace flags
+    CTraceWriter* m_pTraceWriter;  // Binary CPU instruction trace, see TraceInstruction()
+    TraceRecord m_TraceRecord;  // The instruction being executed, added to the trace at the next instruction boundary
+    bool        m_okTracePending;  // m_TraceRecord is filled and collects the memory writes
+    BoardCounters m_Counters;
+    bool        m_okHostTiming;
+    uint32_t    m_HostTimingEvents;  // Device events counted for the host timing sampling
+    uint64_t    m_HostClockCost;     // Nanoseconds between two clock reads, taken off the sampled events
     uint16_t    m_Timer1div;        // Timer 1 subcounter, based on octave value
     uint16_t    m_Timer1;           // Timer 1 counter, initial value copied from m_Port170022
     uint16_t    m_Timer2;           // Timer 2 counter
+    uint64_t    m_Timer1cycle;      // CPU cycle the Timer 1 is counted up to
     bool        m_okSoundOnOff;
+private:  // Device events
+    struct BoardEvent
+    {
+        uint64_t    cycle;          // CPU cycle to process the event at
+        int         event;          // BOARDEVENT_Xxx
+    };
+    BoardEvent  m_Events[BOARDEVENT_COUNT];  // Pending events, min-heap by cycle then by event
+    int         m_EventCount;
+    uint64_t    m_FrameCycle;       // CPU cycle of the current frame start
+    int         m_SerialTxCount;    // Serial transmitter countdown
+    void        ScheduleEvent(int event, int frameticks);  // Schedule the event at the end of the frame tick
+    BoardEvent  PopEvent();
+    void        ProcessEvent(int event, int frameticks);
+    template<bool tracing, bool breakpoints>
+    bool        RunFrame();         // SystemFrame() variant, the debug checks are compiled in only if needed
+    template<bool tracing, bool breakpoints>
+    bool        RunCPU(uint64_t cycle);  // Run the CPU up to the cycle; false = breakpoint or watchpoint
+    void        TraceInstruction();
+    void        TraceMemoryWrite(uint16_t address, uint16_t value, bool okByte);
 private:
     SOUNDGENCALLBACK m_SoundGenCallback;
     SERIALINCALLBACK    m_SerialInCallback;
     SERIALOUTCALLBACK   m_SerialOutCallback;
     PARALLELOUTCALLBACK m_ParallelOutCallback;
-
-    void        DoSound();
 };
 
+// Uses the page table for RAM and ROM; ports, 177600-177777 area and fetch-watched pages are not cached
+inline int CMotherboard::GetDecodeIndex(uint16_t address) const
+{
+    int page = address >> 12;
+    if ((m_PageFlags[page] & MEMPAGE_EXEC) == 0)  // Ports or instruction fetch watchpoint
+        return -1;
+    if (page < 14)  // 000000-157777 -- RAM
+        return static_cast<int>((m_pPages[page] - m_pRAM) + (address & 07776)) >> 1;
+    return DECODEINDEX_ROM + ((address & 07777) >> 1);  // 160000-167777 -- ROM
+}
+
 
 //////////////////////////////////////////////////////////////////////
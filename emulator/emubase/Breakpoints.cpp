@@ -0,0 +1,484 @@
+﻿/*  This file is part of NEMIGABTL.
+    NEMIGABTL is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software Foundation,
+either version 3 of the License, or (at your option) any later version.
+    NEMIGABTL is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU Lesser General Public License for more details.
+    You should have received a copy of the GNU Lesser General Public License along with
+NEMIGABTL. If not, see <http://www.gnu.org/licenses/>. */
+
+// Breakpoints.cpp
+//
+
+#include "stdafx.h"
+#include "Emubase.h"
+
+
+//////////////////////////////////////////////////////////////////////
+
+CBreakpointList::CBreakpointList()
+{
+    memset(m_bits, 0, sizeof(m_bits));
+    m_entries = nullptr;
+    m_count = m_capacity = 0;
+    m_version = 0;
+    m_list = static_cast<uint16_t*>(::malloc(sizeof(uint16_t)));
+    m_list[0] = 0177777;
+}
+
+CBreakpointList::~CBreakpointList()
+{
+    ::free(m_entries);
+    ::free(m_list);
+}
+
+int CBreakpointList::Find(uint16_t address) const
+{
+    int lo = 0, hi = m_count;
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (m_entries[mid].address < address)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo < m_count && m_entries[lo].address == address)
+        return lo;
+    return -(lo + 1);
+}
+
+void CBreakpointList::UpdateList()
+{
+    m_list = static_cast<uint16_t*>(::realloc(m_list, sizeof(uint16_t) * (m_count + 1)));
+    for (int i = 0; i < m_count; i++)
+        m_list[i] = m_entries[i].address;
+    m_list[m_count] = 0177777;
+    m_version++;
+}
+
+bool CBreakpointList::Add(uint16_t address, LPCTSTR condition)
+{
+    if (address == 0177777)
+        return false;
+    int index = Find(address);
+    if (index >= 0)
+        return false;  // Already in the list
+    index = -index - 1;
+
+    Breakpoint bp;
+    bp.address = address;
+    bp.hits = 0;
+    bp.code[0] = BPCODE_END;
+    bp.condition[0] = 0;
+    if (condition != nullptr && *condition != 0)
+    {
+        if (_tcslen(condition) >= BPCOND_MAXLENGTH || !CompileCondition(condition, bp.code))
+            return false;
+        _tcscpy_s(bp.condition, BPCOND_MAXLENGTH, condition);
+    }
+
+    if (m_count == m_capacity)
+    {
+        m_capacity = m_capacity == 0 ? 16 : m_capacity * 2;
+        m_entries = static_cast<Breakpoint*>(::realloc(m_entries, sizeof(Breakpoint) * m_capacity));
+    }
+    memmove(m_entries + index + 1, m_entries + index, sizeof(Breakpoint) * (m_count - index));
+    m_entries[index] = bp;
+    m_count++;
+    m_bits[address >> 5] |= 1u << (address & 31);
+    UpdateList();
+    return true;
+}
+
+bool CBreakpointList::Remove(uint16_t address)
+{
+    int index = Find(address);
+    if (index < 0)
+        return false;
+    m_count--;
+    memmove(m_entries + index, m_entries + index + 1, sizeof(Breakpoint) * (m_count - index));
+    m_bits[address >> 5] &= ~(1u << (address & 31));
+    UpdateList();
+    return true;
+}
+
+void CBreakpointList::RemoveAll()
+{
+    memset(m_bits, 0, sizeof(m_bits));
+    m_count = 0;
+    UpdateList();
+}
+
+LPCTSTR CBreakpointList::GetCondition(uint16_t address) const
+{
+    int index = Find(address);
+    if (index < 0 || m_entries[index].condition[0] == 0)
+        return nullptr;
+    return m_entries[index].condition;
+}
+
+uint32_t CBreakpointList::GetHitCount(uint16_t address) const
+{
+    int index = Find(address);
+    return index < 0 ? 0 : m_entries[index].hits;
+}
+
+bool CBreakpointList::Check(uint16_t address, const CProcessor* pProc, const CMotherboard* pBoard)
+{
+    int index = Find(address);
+    if (index < 0)
+        return false;
+    Breakpoint& bp = m_entries[index];
+    bp.hits++;
+    if (bp.code[0] == BPCODE_END)
+        return true;  // Unconditional breakpoint
+    return Evaluate(bp, pProc, pBoard) != 0;
+}
+
+uint16_t CBreakpointList::Evaluate(const Breakpoint& bp, const CProcessor* pProc, const CMotherboard* pBoard) const
+{
+    uint16_t stack[BPCODE_MAXSTACK];
+    int sp = 0;
+    const uint16_t* pc = bp.code;
+    for (;;)
+    {
+        uint16_t op = *pc++;
+        if (op == BPCODE_END)
+            return stack[sp - 1];
+
+        switch (op)
+        {
+        case BPCODE_CONST:
+            stack[sp++] = *pc++;
+            continue;
+        case BPCODE_REG:
+            stack[sp++] = pProc->GetReg(*pc++);
+            continue;
+        case BPCODE_PSW:
+            stack[sp++] = pProc->GetPSW();
+            continue;
+        case BPCODE_HITS:
+            stack[sp++] = bp.hits > 0177777 ? 0177777 : static_cast<uint16_t>(bp.hits);
+            continue;
+        case BPCODE_MEM:
+            {
+                int addrtype;
+                stack[sp - 1] = pBoard->GetWordView(stack[sp - 1] & ~1, pProc->IsHaltMode(), false, &addrtype);
+            }
+            continue;
+        }
+
+        uint16_t b = stack[--sp];
+        uint16_t a = stack[sp - 1];
+        uint16_t result;
+        switch (op)
+        {
+        case BPCODE_EQ:   result = a == b; break;
+        case BPCODE_NE:   result = a != b; break;
+        case BPCODE_LT:   result = a < b; break;
+        case BPCODE_LE:   result = a <= b; break;
+        case BPCODE_GT:   result = a > b; break;
+        case BPCODE_GE:   result = a >= b; break;
+        case BPCODE_BIT:  result = a & b; break;
+        case BPCODE_LAND: result = a != 0 && b != 0; break;
+        default:          result = a != 0 || b != 0; break;  // BPCODE_LOR
+        }
+        stack[sp - 1] = result;
+    }
+}
+
+
+
+//////////////////////////////////////////////////////////////////////
+
+CWatchpointList::CWatchpointList()
+{
+    m_entries = nullptr;
+    m_count = m_capacity = 0;
+}
+
+CWatchpointList::~CWatchpointList()
+{
+    ::free(m_entries);
+}
+
+bool CWatchpointList::Add(uint16_t start, uint16_t end, uint8_t flags)
+{
+    flags &= WATCH_READ | WATCH_WRITE | WATCH_EXEC;
+    if (end < start || flags == 0)
+        return false;
+
+    Remove(start);
+    if (m_count == m_capacity)
+    {
+        m_capacity = m_capacity == 0 ? 8 : m_capacity * 2;
+        m_entries = static_cast<Watchpoint*>(::realloc(m_entries, sizeof(Watchpoint) * m_capacity));
+    }
+    Watchpoint& wp = m_entries[m_count++];
+    wp.start = start;
+    wp.end = end;
+    wp.flags = flags;
+    return true;
+}
+
+bool CWatchpointList::Remove(uint16_t start)
+{
+    for (int i = 0; i < m_count; i++)
+    {
+        if (m_entries[i].start == start)
+        {
+            m_count--;
+            memmove(m_entries + i, m_entries + i + 1, sizeof(Watchpoint) * (m_count - i));
+            return true;
+        }
+    }
+    return false;
+}
+
+void CWatchpointList::RemoveAll()
+{
+    m_count = 0;
+}
+
+uint8_t CWatchpointList::GetPageFlags(int page) const
+{
+    uint16_t pagestart = static_cast<uint16_t>(page << 12);
+    uint16_t pageend = pagestart + 07777;
+    uint8_t flags = 0;
+    for (int i = 0; i < m_count; i++)
+    {
+        if (m_entries[i].start <= pageend && m_entries[i].end >= pagestart)
+            flags |= m_entries[i].flags;
+    }
+    return flags;
+}
+
+bool CWatchpointList::IsWatched(uint16_t address, int size, uint8_t access) const
+{
+    uint16_t last = address + (size - 1);
+    for (int i = 0; i < m_count; i++)
+    {
+        const Watchpoint& wp = m_entries[i];
+        if ((wp.flags & access) != 0 && address <= wp.end && last >= wp.start)
+            return true;
+    }
+    return false;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Condition compiler
+//
+// Condition examples: "r0 == 177", "@(r5) & 100000", "hits >= 10. && @1000 != 0"
+//   expr    := and { "||" and }
+//   and     := compare { "&&" compare }
+//   compare := bits [ ("==" | "!=" | "<" | "<=" | ">" | ">=") bits ]
+//   bits    := unary { "&" unary }
+//   unary   := "@" unary | "(" expr ")" | r0..r7 | sp | pc | ps | hits | number
+// Numbers are octal; trailing dot means decimal number
+
+struct BreakpointCompiler
+{
+    LPCTSTR     text;
+    uint16_t*   code;
+    int         length;     // Code words emitted
+    int         depth;      // Evaluation stack depth at this point
+    bool        error;
+
+    void SkipSpaces()
+    {
+        while (*text == _T(' ') || *text == _T('\t')) text++;
+    }
+    void Emit(uint16_t word)
+    {
+        if (length >= BPCODE_MAXLENGTH - 1)  // Keep room for BPCODE_END
+            error = true;
+        else
+            code[length++] = word;
+    }
+    void Push()
+    {
+        if (++depth > BPCODE_MAXSTACK) error = true;
+    }
+    // Match the operator token
+    bool Match(LPCTSTR token)
+    {
+        SkipSpaces();
+        int len = static_cast<int>(_tcslen(token));
+        for (int i = 0; i < len; i++)
+        {
+            if (text[i] != token[i]) return false;
+        }
+        text += len;
+        return true;
+    }
+    static bool IsNameChar(TCHAR ch)
+    {
+        return (ch >= _T('0') && ch <= _T('9')) || (ch >= _T('a') && ch <= _T('z')) || (ch >= _T('A') && ch <= _T('Z'));
+    }
+    // Match the case-insensitive name, token is lowercase
+    bool MatchName(LPCTSTR token)
+    {
+        int len = static_cast<int>(_tcslen(token));
+        for (int i = 0; i < len; i++)
+        {
+            TCHAR ch = text[i];
+            if (ch >= _T('A') && ch <= _T('Z')) ch = ch - _T('A') + _T('a');
+            if (ch != token[i]) return false;
+        }
+        if (IsNameChar(text[len])) return false;
+        text += len;
+        return true;
+    }
+
+    void ParseExpr()
+    {
+        ParseAnd();
+        while (!error && Match(_T("||")))
+        {
+            ParseAnd();
+            Emit(BPCODE_LOR);  depth--;
+        }
+    }
+    void ParseAnd()
+    {
+        ParseCompare();
+        while (!error && Match(_T("&&")))
+        {
+            ParseCompare();
+            Emit(BPCODE_LAND);  depth--;
+        }
+    }
+    void ParseCompare()
+    {
+        ParseBits();
+        uint16_t op;
+        if (Match(_T("=="))) op = BPCODE_EQ;
+        else if (Match(_T("!="))) op = BPCODE_NE;
+        else if (Match(_T("<="))) op = BPCODE_LE;
+        else if (Match(_T(">="))) op = BPCODE_GE;
+        else if (Match(_T("<"))) op = BPCODE_LT;
+        else if (Match(_T(">"))) op = BPCODE_GT;
+        else return;
+        ParseBits();
+        Emit(op);  depth--;
+    }
+    void ParseBits()
+    {
+        ParseUnary();
+        for (;;)
+        {
+            SkipSpaces();
+            if (error || text[0] != _T('&') || text[1] == _T('&'))
+                break;
+            text++;
+            ParseUnary();
+            Emit(BPCODE_BIT);  depth--;
+        }
+    }
+    void ParseUnary()
+    {
+        if (error) return;
+        SkipSpaces();
+        if (*text == _T('@'))
+        {
+            text++;
+            ParseUnary();
+            Emit(BPCODE_MEM);
+            return;
+        }
+        if (*text == _T('('))
+        {
+            text++;
+            ParseExpr();
+            if (!Match(_T(")"))) error = true;
+            return;
+        }
+        if ((*text == _T('r') || *text == _T('R')) && text[1] >= _T('0') && text[1] <= _T('7') && !IsNameChar(text[2]))
+        {
+            Emit(BPCODE_REG);  Emit(static_cast<uint16_t>(text[1] - _T('0')));  Push();
+            text += 2;
+            return;
+        }
+        if (MatchName(_T("sp")))
+        {
+            Emit(BPCODE_REG);  Emit(6);  Push();
+            return;
+        }
+        if (MatchName(_T("pc")))
+        {
+            Emit(BPCODE_REG);  Emit(7);  Push();
+            return;
+        }
+        if (MatchName(_T("ps")))
+        {
+            Emit(BPCODE_PSW);  Push();
+            return;
+        }
+        if (MatchName(_T("hits")))
+        {
+            Emit(BPCODE_HITS);  Push();
+            return;
+        }
+        ParseNumber();
+    }
+    void ParseNumber()
+    {
+        uint32_t octal = 0, decimal = 0;
+        bool okOctal = true;
+        LPCTSTR start = text;
+        while (*text >= _T('0') && *text <= _T('9'))
+        {
+            int digit = *text - _T('0');
+            if (digit > 7) okOctal = false;
+            octal = (octal << 3) + digit;
+            decimal = decimal * 10 + digit;
+            if (octal > 0177777) octal = 0200000;  // Saturate, it's an error anyway
+            if (decimal > 0177777) decimal = 0200000;
+            text++;
+        }
+        if (text == start)
+        {
+            error = true;
+            return;
+        }
+        uint32_t value = octal;
+        if (*text == _T('.'))
+        {
+            text++;
+            value = decimal;
+        }
+        else if (!okOctal)
+            value = 0200000;
+        if (value > 0177777 || IsNameChar(*text))
+        {
+            error = true;
+            return;
+        }
+        Emit(BPCODE_CONST);  Emit(static_cast<uint16_t>(value));  Push();
+    }
+};
+
+bool CBreakpointList::CompileCondition(LPCTSTR condition, uint16_t* code)
+{
+    BreakpointCompiler compiler;
+    compiler.text = condition;
+    compiler.code = code;
+    compiler.length = 0;
+    compiler.depth = 0;
+    compiler.error = false;
+
+    compiler.ParseExpr();
+    compiler.SkipSpaces();
+    if (compiler.error || *compiler.text != 0)
+    {
+        code[0] = BPCODE_END;
+        return false;
+    }
+    code[compiler.length] = BPCODE_END;
+    return true;
+}
+
+
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,124 @@
+﻿/*  This file is part of NEMIGABTL.
+    NEMIGABTL is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software Foundation,
+either version 3 of the License, or (at your option) any later version.
+    NEMIGABTL is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU Lesser General Public License for more details.
+    You should have received a copy of the GNU Lesser General Public License along with
+NEMIGABTL. If not, see <http://www.gnu.org/licenses/>. */
+
+// Breakpoints.h
+//
+
+#pragma once
+
+#include "Defines.h"
+
+class CProcessor;
+class CMotherboard;
+
+
+//////////////////////////////////////////////////////////////////////
+
+// Breakpoint condition bytecode, see CBreakpointList::CompileCondition()
+#define BPCODE_END      0  // End of the program, the result is on top of the stack
+#define BPCODE_CONST    1  // Push the next code word
+#define BPCODE_REG      2  // Push the register, the next code word is the register number
+#define BPCODE_PSW      3  // Push PSW
+#define BPCODE_HITS     4  // Push the breakpoint hit count, saturated to 177777
+#define BPCODE_MEM      5  // Replace the address on top of the stack with the memory word
+#define BPCODE_EQ       6  // Binary operations: pop two values, push the result
+#define BPCODE_NE       7
+#define BPCODE_LT       8  // Unsigned compares
+#define BPCODE_LE       9
+#define BPCODE_GT      10
+#define BPCODE_GE      11
+#define BPCODE_BIT     12  // Bitwise AND
+#define BPCODE_LAND    13  // Logical AND
+#define BPCODE_LOR     14  // Logical OR
+
+#define BPCODE_MAXLENGTH  48  // Code words per condition
+#define BPCODE_MAXSTACK    8  // Evaluation stack depth
+#define BPCOND_MAXLENGTH  64  // Condition text length, with the trailing zero
+
+
+// CPU breakpoint list: PC bit set for the check at instruction boundary,
+// and the sorted entries with optional conditions
+class CBreakpointList
+{
+public:
+    CBreakpointList();
+    ~CBreakpointList();
+    // Add the breakpoint; condition is optional, see CompileCondition(); false = already exists or bad condition
+    bool        Add(uint16_t address, LPCTSTR condition = nullptr);
+    bool        Remove(uint16_t address);
+    void        RemoveAll();
+    int         GetCount() const { return m_count; }
+    uint32_t    GetVersion() const { return m_version; }  // Changes on every Add/Remove, see CProcessor::ExecuteUntil()
+    // Sorted breakpoint addresses, ends with 177777 value
+    const uint16_t* GetList() const { return m_list; }
+    bool        IsBreakpoint(uint16_t address) const
+    {
+        return (m_bits[address >> 5] & (1u << (address & 31))) != 0;
+    }
+    // Condition text for the breakpoint, nullptr for unconditional one
+    LPCTSTR     GetCondition(uint16_t address) const;
+    uint32_t    GetHitCount(uint16_t address) const;
+    // Called when the CPU is about to execute the instruction at the breakpoint; true = stop
+    bool        Check(uint16_t address, const CProcessor* pProc, const CMotherboard* pBoard);
+public:
+    // Compile the condition text into the bytecode, see BPCODE_Xxx; false = syntax error
+    static bool CompileCondition(LPCTSTR condition, uint16_t* code);
+private:
+    struct Breakpoint
+    {
+        uint16_t    address;
+        uint32_t    hits;       // How many times the CPU came to the address
+        uint16_t    code[BPCODE_MAXLENGTH];  // Condition bytecode, BPCODE_END only for unconditional breakpoint
+        TCHAR       condition[BPCOND_MAXLENGTH];
+    };
+    uint32_t    m_bits[65536 / 32];  // One bit per address
+    Breakpoint* m_entries;      // Sorted by address
+    uint16_t*   m_list;         // Addresses, ends with 177777 value
+    int         m_count;
+    int         m_capacity;
+    uint32_t    m_version;
+private:
+    int         Find(uint16_t address) const;  // Index of the entry, or insertion point as -(index + 1)
+    void        UpdateList();
+    uint16_t    Evaluate(const Breakpoint& bp, const CProcessor* pProc, const CMotherboard* pBoard) const;
+};
+
+
+// Memory watchpoint list: address ranges with WATCH_Xxx access flags, see CMotherboard::SetWatchpoints()
+class CWatchpointList
+{
+public:
+    CWatchpointList();
+    ~CWatchpointList();
+    // Add the watchpoint for the inclusive address range; the same start replaces the watchpoint
+    bool        Add(uint16_t start, uint16_t end, uint8_t flags);
+    bool        Remove(uint16_t start);
+    void        RemoveAll();
+    int         GetCount() const { return m_count; }
+    uint16_t    GetStart(int index) const { return m_entries[index].start; }
+    uint16_t    GetEnd(int index) const { return m_entries[index].end; }
+    uint8_t     GetFlags(int index) const { return m_entries[index].flags; }
+    // WATCH_Xxx flags of all the watchpoints touching the 4 KB page
+    uint8_t     GetPageFlags(int page) const;
+    // Check the access of 1 byte, or 2 bytes at the even address
+    bool        IsWatched(uint16_t address, int size, uint8_t access) const;
+private:
+    struct Watchpoint
+    {
+        uint16_t    start, end;
+        uint8_t     flags;
+    };
+    Watchpoint* m_entries;
+    int         m_count;
+    int         m_capacity;
+};
+
+
+//////////////////////////////////////////////////////////////////////
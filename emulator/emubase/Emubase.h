@@ -15,6 +15,9 @@ NEMIGABTL. If not, see <http://www.gnu.org/licenses/>. */
 
 #include "Board.h"
 #include "Processor.h"
+#include "Breakpoints.h"
+#include "Profiler.h"
+#include "Trace.h"
 
 
 //////////////////////////////////////////////////////////////////////
@@ -35,6 +38,22 @@ uint16_t DisassembleInstruction(const uint16_t* pMemory, uint16_t addr, TCHAR* s
 
 bool Disasm_CheckForJump(const uint16_t* memory, int* pDelta);
 
+
+//////////////////////////////////////////////////////////////////////
+// Screen rendering, see Screen.cpp
+
+// Screen image preparation function
+//   pVideoBuffer   Video memory bits, see CMotherboard::GetVideoBuffer()
+//   pPalette       Palette, 4 colors
+//   pImageBits     Result, 32-bit color, bottom-up lines; the size is different for every function
+typedef void (CALLBACK* PREPARE_SCREEN_CALLBACK)(const uint8_t* pVideoBuffer, const uint32_t* pPalette, void* pImageBits);
+
+void CALLBACK Emulator_PrepareScreenBW512x256(const uint8_t* pVideoBuffer, const uint32_t* palette, void* pImageBits);
+void CALLBACK Emulator_PrepareScreenBW512x312(const uint8_t* pVideoBuffer, const uint32_t* palette, void* pImageBits);
+void CALLBACK Emulator_PrepareScreenBW768x468(const uint8_t* pVideoBuffer, const uint32_t* palette, void* pImageBits);
+void CALLBACK Emulator_PrepareScreenBW896x624(const uint8_t* pVideoBuffer, const uint32_t* palette, void* pImageBits);
+void CALLBACK Emulator_PrepareScreenBW1024x624(const uint8_t* pVideoBuffer, const uint32_t* palette, void* pImageBits);
+
 bool Disasm_GetJumpConditionHint(
     const uint16_t* memory, const CProcessor * pProc, const CMotherboard * pBoard, LPTSTR buffer);
 
@@ -69,6 +88,12 @@ const uint8_t FLOPPY_TYPE_NONE = 0;
 const uint8_t FLOPPY_TYPE_MD = 1;
 const uint8_t FLOPPY_TYPE_MX = 2;
 
+// Raw track encoding, see Floppy.cpp; MD track is 23 sectors of 128 bytes, MX track is 11 sectors of 256 bytes
+void EncodeTrackData(const uint8_t* pSrc, uint8_t* data, uint16_t track, uint16_t side);
+bool DecodeTrackData(const uint8_t* pRaw, uint8_t* pDest, uint16_t track);
+void EncodeTrackDataMX(const uint8_t* pSrc, uint8_t* data, uint16_t track, uint16_t side);
+bool DecodeTrackDataMX(const uint8_t* pRaw, uint8_t* pDest, uint16_t track);
+
 struct CFloppyDrive
 {
     FILE* fpFile;
@@ -104,6 +129,8 @@ protected:
     uint16_t m_operation;   // Operation code, see FLOPPY_OPER_XXX defines
     int  m_opercount;       // Operation counter - countdown or current operation stage
     bool m_okTrace;         // Trace mode on/off
+    uint64_t m_trackloads;  // Tracks read from the image files, for statistics
+    uint64_t m_trackflushes;  // Tracks written to the image files, for statistics
 
 public:
     CFloppyController();
@@ -127,6 +154,9 @@ public:
     void SetTimer(uint16_t word);   // Writing port 177106 - timer
     void Periodic();            // Rotate disk; call it each 64 us - 15625 times per second
     void SetTrace(bool okTrace) { m_okTrace = okTrace; }  // Set trace mode on/off
+    uint64_t GetTrackLoadCount() const { return m_trackloads; }
+    uint64_t GetTrackFlushCount() const { return m_trackflushes; }
+    void ResetCounters() { m_trackloads = m_trackflushes = 0; }
 
 private:
     void PrepareTrack();
@@ -18,13 +18,6 @@ NEMIGABTL. If not, see <http://www.gnu.org/licenses/>. */
 #include "Emubase.h"
 
 
-//////////////////////////////////////////////////////////////////////
-
-static void EncodeTrackData(const uint8_t* pSrc, uint8_t* data, uint16_t track, uint16_t side);
-static bool DecodeTrackData(const uint8_t* pRaw, uint8_t* pDest, uint16_t track);
-static void EncodeTrackDataMX(const uint8_t* pSrc, uint8_t* data, uint16_t track, uint16_t side);
-static bool DecodeTrackDataMX(const uint8_t* pRaw, uint8_t* pDest, uint16_t track);
-
 //////////////////////////////////////////////////////////////////////
 
 
@@ -59,6 +52,7 @@ CFloppyController::CFloppyController()
     m_trackchanged = false;
     m_status = 0;
     m_okTrace = false;
+    m_trackloads = m_trackflushes = 0;
 }
 
 CFloppyController::~CFloppyController()
@@ -460,6 +454,7 @@ void CFloppyController::PrepareTrack()
     if (m_pDrive->fpFile == nullptr) return;
 
     if (m_okTrace) DebugLogFormat(_T("Floppy%d PREPARE TRACK %d\r\n"), m_drive, m_track);
+    m_trackloads++;
 
     uint32_t count;
 
@@ -527,6 +522,7 @@ void CFloppyController::FlushChanges()
     if (!m_trackchanged) return;
 
     if (m_okTrace) DebugLogFormat(_T("Floppy%d FLUSH\r\n"), m_drive);  //DEBUG
+    m_trackflushes++;
 
     //TCHAR filename[32];  _sntprintf(filename, sizeof(filename) / sizeof(TCHAR) - 1, _T("rawtrack%02d.bin"), (int)m_pDrive->datatrack);
     //FILE* fpTrack = ::_tfopen(filename, _T("w+b"));
@@ -624,7 +620,7 @@ uint16_t CalculateChecksum(const uint8_t* buffer, int length)
 // Fill data array and marker array with marked data
 // pSrc array length is 23 * 128, for track 0 is 22 * 128
 // data array length is 3125 == FLOPPY_RAWTRACKSIZE
-static void EncodeTrackData(const uint8_t* pSrc, uint8_t* data, uint16_t track, uint16_t /*side*/)
+void EncodeTrackData(const uint8_t* pSrc, uint8_t* data, uint16_t track, uint16_t /*side*/)
 {
     memset(data, 0, FLOPPY_RAWTRACKSIZE);
     uint32_t count;
@@ -676,7 +672,7 @@ static void EncodeTrackData(const uint8_t* pSrc, uint8_t* data, uint16_t track,
 // pRaw is array of FLOPPY_RAWTRACKSIZE bytes
 // pDest is array of 128*23 bytes
 // Returns: true - decoded, false - parse error
-static bool DecodeTrackData(const uint8_t* pRaw, uint8_t* pDest, uint16_t track)
+bool DecodeTrackData(const uint8_t* pRaw, uint8_t* pDest, uint16_t track)
 {
     uint16_t dataptr = 0;  // Offset in m_data array
     uint16_t destptr = 0;  // Offset in data array
@@ -718,7 +714,7 @@ static bool DecodeTrackData(const uint8_t* pRaw, uint8_t* pDest, uint16_t track)
 // Fill data array and marker array with marked data for MX disk
 // pSrc array length is 11 * 256
 // data array length is 3125 == FLOPPY_RAWTRACKSIZE
-static void EncodeTrackDataMX(const uint8_t* pSrc, uint8_t* data, uint16_t track, uint16_t /*side*/)
+void EncodeTrackDataMX(const uint8_t* pSrc, uint8_t* data, uint16_t track, uint16_t /*side*/)
 {
     memset(data, 0, FLOPPY_RAWTRACKSIZE);
     uint32_t count;
@@ -758,7 +754,7 @@ static void EncodeTrackDataMX(const uint8_t* pSrc, uint8_t* data, uint16_t track
 // pRaw is array of FLOPPY_RAWTRACKSIZE bytes
 // pDest is array of 11*256 = 2816 bytes
 // Returns: true - decoded, false - parse error
-static bool DecodeTrackDataMX(const uint8_t* pRaw, uint8_t* pDest, uint16_t /*track*/)
+bool DecodeTrackDataMX(const uint8_t* pRaw, uint8_t* pDest, uint16_t /*track*/)
 {
     uint16_t dataptr = 0;  // Offset in m_data array
     uint16_t destptr = 0;  // Offset in data array
@@ -13,6 +13,12 @@ NEMIGABTL. If not, see <http://www.gnu.org/licenses/>. */
 
 #include "stdafx.h"
 #include "Processor.h"
+#include "Profiler.h"
+#include "Breakpoints.h"
+#include <stddef.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 
 // Timings ///////////////////////////////////////////////////////////
@@ -39,8 +45,8 @@ const int TIMING_DS[8]  = { 0, 32, 32, 40, 32, 40, 40, 48 };
 #define TIMING_A1 TIMING_A
 #define TIMING_DJ TIMING_A2
 
-#define TIMING_DST (m_methsrc ? TIMING_AB : TIMING_B)
-#define TIMING_CMP (m_methsrc ? TIMING_A1 : TIMING_A2)
+#define TIMING_DST (METHSRC ? TIMING_AB : TIMING_B)    // for double operand commands only
+#define TIMING_CMP (METHSRC ? TIMING_A1 : TIMING_A2)
 
 uint16_t ASH_TIMING[8] =
 {
@@ -68,117 +74,390 @@ uint16_t DIV_TIMING[8] =
 //////////////////////////////////////////////////////////////////////
 
 
-CProcessor::ExecuteMethodRef* CProcessor::m_pExecuteMethodMap = nullptr;
-
-void CProcessor::Init()
-{
-    ASSERT(m_pExecuteMethodMap == nullptr);
-    m_pExecuteMethodMap = static_cast<CProcessor::ExecuteMethodRef*>(::calloc(65536, sizeof(CProcessor::ExecuteMethodRef)));
-
-    // Сначала заполняем таблицу ссылками на метод ExecuteUNKNOWN
-    RegisterMethodRef( 0000000, 0177777, &CProcessor::ExecuteUNKNOWN );
-
-    RegisterMethodRef( 0000000, 0000000, &CProcessor::ExecuteHALT );
-    RegisterMethodRef( 0000001, 0000001, &CProcessor::ExecuteWAIT );
-    RegisterMethodRef( 0000002, 0000002, &CProcessor::ExecuteRTI );
-    RegisterMethodRef( 0000003, 0000003, &CProcessor::ExecuteBPT );
-    RegisterMethodRef( 0000004, 0000004, &CProcessor::ExecuteIOT );
-    RegisterMethodRef( 0000005, 0000005, &CProcessor::ExecuteRESET );
-    RegisterMethodRef( 0000006, 0000006, &CProcessor::ExecuteRTT );
-    // MFPT            0000007, 0000007
-    // RESERVED:       0000010, 0000077
-    RegisterMethodRef( 0000100, 0000177, &CProcessor::ExecuteJMP );
-    RegisterMethodRef( 0000200, 0000207, &CProcessor::ExecuteRTS );  // RTS / RETURN
-    // RESERVED:       0000210, 0000227
-    // SPL             0000230, 0000237
-    RegisterMethodRef( 0000240, 0000240, &CProcessor::ExecuteNOP );
-    RegisterMethodRef( 0000241, 0000257, &CProcessor::ExecuteCCC );
-    RegisterMethodRef( 0000260, 0000260, &CProcessor::ExecuteNOP );
-    RegisterMethodRef( 0000261, 0000277, &CProcessor::ExecuteSCC );
-    RegisterMethodRef( 0000300, 0000377, &CProcessor::ExecuteSWAB );
-    RegisterMethodRef( 0000400, 0000777, &CProcessor::ExecuteBR );
-    RegisterMethodRef( 0001000, 0001377, &CProcessor::ExecuteBNE );
-    RegisterMethodRef( 0001400, 0001777, &CProcessor::ExecuteBEQ );
-    RegisterMethodRef( 0002000, 0002377, &CProcessor::ExecuteBGE );
-    RegisterMethodRef( 0002400, 0002777, &CProcessor::ExecuteBLT );
-    RegisterMethodRef( 0003000, 0003377, &CProcessor::ExecuteBGT );
-    RegisterMethodRef( 0003400, 0003777, &CProcessor::ExecuteBLE );
-    RegisterMethodRef( 0004000, 0004777, &CProcessor::ExecuteJSR );  // JSR / CALL
-    RegisterMethodRef( 0005000, 0005077, &CProcessor::ExecuteCLR );
-    RegisterMethodRef( 0005100, 0005177, &CProcessor::ExecuteCOM );
-    RegisterMethodRef( 0005200, 0005277, &CProcessor::ExecuteINC );
-    RegisterMethodRef( 0005300, 0005377, &CProcessor::ExecuteDEC );
-    RegisterMethodRef( 0005400, 0005477, &CProcessor::ExecuteNEG );
-    RegisterMethodRef( 0005500, 0005577, &CProcessor::ExecuteADC );
-    RegisterMethodRef( 0005600, 0005677, &CProcessor::ExecuteSBC );
-    RegisterMethodRef( 0005700, 0005777, &CProcessor::ExecuteTST );
-    RegisterMethodRef( 0006000, 0006077, &CProcessor::ExecuteROR );
-    RegisterMethodRef( 0006100, 0006177, &CProcessor::ExecuteROL );
-    RegisterMethodRef( 0006200, 0006277, &CProcessor::ExecuteASR );
-    RegisterMethodRef( 0006300, 0006377, &CProcessor::ExecuteASL );
-    RegisterMethodRef( 0006400, 0006477, &CProcessor::ExecuteMARK );
-    // MFPI            0006500, 0006577
-    // MTPI            0006600, 0006677
-    RegisterMethodRef( 0006700, 0006777, &CProcessor::ExecuteSXT );
-    // RESERVED:       0007000, 0007777
-    RegisterMethodRef( 0010000, 0017777, &CProcessor::ExecuteMOV );
-    RegisterMethodRef( 0020000, 0027777, &CProcessor::ExecuteCMP );
-    RegisterMethodRef( 0030000, 0037777, &CProcessor::ExecuteBIT );
-    RegisterMethodRef( 0040000, 0047777, &CProcessor::ExecuteBIC );
-    RegisterMethodRef( 0050000, 0057777, &CProcessor::ExecuteBIS );
-    RegisterMethodRef( 0060000, 0067777, &CProcessor::ExecuteADD );
-    RegisterMethodRef( 0070000, 0070777, &CProcessor::ExecuteMUL );
-    RegisterMethodRef( 0071000, 0071777, &CProcessor::ExecuteDIV );
-    RegisterMethodRef( 0072000, 0072777, &CProcessor::ExecuteASH );
-    RegisterMethodRef( 0073000, 0073777, &CProcessor::ExecuteASHC );
-    RegisterMethodRef( 0074000, 0074777, &CProcessor::ExecuteXOR );
-    // FADD etc.       0075000, 0075777
-    // RESERVED:       0076000, 0076777
-    RegisterMethodRef( 0077000, 0077777, &CProcessor::ExecuteSOB );
-    RegisterMethodRef( 0100000, 0100377, &CProcessor::ExecuteBPL );
-    RegisterMethodRef( 0100400, 0100777, &CProcessor::ExecuteBMI );
-    RegisterMethodRef( 0101000, 0101377, &CProcessor::ExecuteBHI );
-    RegisterMethodRef( 0101400, 0101777, &CProcessor::ExecuteBLOS );
-    RegisterMethodRef( 0102000, 0102377, &CProcessor::ExecuteBVC );
-    RegisterMethodRef( 0102400, 0102777, &CProcessor::ExecuteBVS );
-    RegisterMethodRef( 0103000, 0103377, &CProcessor::ExecuteBHIS );  // BCC, BHIS
-    RegisterMethodRef( 0103400, 0103777, &CProcessor::ExecuteBLO );   // BCS, BLO
-    RegisterMethodRef( 0104000, 0104377, &CProcessor::ExecuteEMT );
-    RegisterMethodRef( 0104400, 0104777, &CProcessor::ExecuteTRAP );
-    RegisterMethodRef( 0105000, 0105077, &CProcessor::ExecuteCLRB );
-    RegisterMethodRef( 0105100, 0105177, &CProcessor::ExecuteCOMB );
-    RegisterMethodRef( 0105200, 0105277, &CProcessor::ExecuteINCB );
-    RegisterMethodRef( 0105300, 0105377, &CProcessor::ExecuteDECB );
-    RegisterMethodRef( 0105400, 0105477, &CProcessor::ExecuteNEGB );
-    RegisterMethodRef( 0105500, 0105577, &CProcessor::ExecuteADCB );
-    RegisterMethodRef( 0105600, 0105677, &CProcessor::ExecuteSBCB );
-    RegisterMethodRef( 0105700, 0105777, &CProcessor::ExecuteTSTB );
-    RegisterMethodRef( 0106000, 0106077, &CProcessor::ExecuteRORB );
-    RegisterMethodRef( 0106100, 0106177, &CProcessor::ExecuteROLB );
-    RegisterMethodRef( 0106200, 0106277, &CProcessor::ExecuteASRB );
-    RegisterMethodRef( 0106300, 0106377, &CProcessor::ExecuteASLB );
-    RegisterMethodRef( 0106400, 0106477, &CProcessor::ExecuteMTPS );
-    // MFPD            0106500, 0106577
-    // MTPD            0106600, 0106677
-    RegisterMethodRef( 0106700, 0106777, &CProcessor::ExecuteMFPS );
-    RegisterMethodRef( 0110000, 0117777, &CProcessor::ExecuteMOVB );
-    RegisterMethodRef( 0120000, 0127777, &CProcessor::ExecuteCMPB );
-    RegisterMethodRef( 0130000, 0137777, &CProcessor::ExecuteBITB );
-    RegisterMethodRef( 0140000, 0147777, &CProcessor::ExecuteBICB );
-    RegisterMethodRef( 0150000, 0157777, &CProcessor::ExecuteBISB );
-    RegisterMethodRef( 0160000, 0167777, &CProcessor::ExecuteSUB );
-    // FPP             0170000, 0177777
-}
-
-void CProcessor::Done()
-{
-    ::free(m_pExecuteMethodMap);  m_pExecuteMethodMap = nullptr;
-}
-
-void CProcessor::RegisterMethodRef(uint16_t start, uint16_t end, CProcessor::ExecuteMethodRef methodref)
-{
-    for (size_t opcode = start; opcode <= end; opcode++)
-        m_pExecuteMethodMap[opcode] = methodref;
+// Interrupt vectors by INTRQ_Xxx bit number; VIRQ vectors are in m_virq
+static const uint16_t InterruptVectors[11] =
+{
+    0, 0000100, 0000014, 0000010, 0000004, 0000034, 0000030, 0000020, 0000014, 0000002, 0000002
+};
+
+// Number of the highest set bit, the value should be non-zero
+static inline int HighestBit(uint32_t value)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse(&index, value);
+    return static_cast<int>(index);
+#else
+    return 31 - __builtin_clz(value);
+#endif
+}
+
+// Number of the lowest set bit, the value should be non-zero
+static inline int LowestBit(uint32_t value)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, value);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctz(value);
+#endif
+}
+
+
+//////////////////////////////////////////////////////////////////////
+
+
+// Opcode classes, used as the dispatch index in CProcessor::TranslateInstruction()
+enum
+{
+    OPCODE_UNKNOWN = 0,
+    OPCODE_HALT,
+    OPCODE_WAIT,
+    OPCODE_RTI,
+    OPCODE_BPT,
+    OPCODE_IOT,
+    OPCODE_RESET,
+    OPCODE_RTT,
+    OPCODE_JMP,
+    OPCODE_RTS,
+    OPCODE_NOP,
+    OPCODE_CCC,
+    OPCODE_SCC,
+    OPCODE_SWAB,
+    OPCODE_BR,
+    OPCODE_BNE,
+    OPCODE_BEQ,
+    OPCODE_BGE,
+    OPCODE_BLT,
+    OPCODE_BGT,
+    OPCODE_BLE,
+    OPCODE_JSR,
+    OPCODE_CLR,
+    OPCODE_COM,
+    OPCODE_INC,
+    OPCODE_DEC,
+    OPCODE_NEG,
+    OPCODE_ADC,
+    OPCODE_SBC,
+    OPCODE_TST,
+    OPCODE_ROR,
+    OPCODE_ROL,
+    OPCODE_ASR,
+    OPCODE_ASL,
+    OPCODE_MARK,
+    OPCODE_SXT,
+    OPCODE_MOV,
+    OPCODE_CMP,
+    OPCODE_BIT,
+    OPCODE_BIC,
+    OPCODE_BIS,
+    OPCODE_ADD,
+    OPCODE_MUL,
+    OPCODE_DIV,
+    OPCODE_ASH,
+    OPCODE_ASHC,
+    OPCODE_XOR,
+    OPCODE_SOB,
+    OPCODE_BPL,
+    OPCODE_BMI,
+    OPCODE_BHI,
+    OPCODE_BLOS,
+    OPCODE_BVC,
+    OPCODE_BVS,
+    OPCODE_BHIS,
+    OPCODE_BLO,
+    OPCODE_EMT,
+    OPCODE_TRAP,
+    OPCODE_CLRB,
+    OPCODE_COMB,
+    OPCODE_INCB,
+    OPCODE_DECB,
+    OPCODE_NEGB,
+    OPCODE_ADCB,
+    OPCODE_SBCB,
+    OPCODE_TSTB,
+    OPCODE_RORB,
+    OPCODE_ROLB,
+    OPCODE_ASRB,
+    OPCODE_ASLB,
+    OPCODE_MTPS,
+    OPCODE_MFPS,
+    OPCODE_MOVB,
+    OPCODE_CMPB,
+    OPCODE_BITB,
+    OPCODE_BICB,
+    OPCODE_BISB,
+    OPCODE_SUB,
+    OPCODE_COUNT
+};
+
+// Opcode class for the given instruction code; evaluated at compile time only
+constexpr uint8_t GetOpcodeClass(uint16_t opcode)
+{
+    return
+        (opcode == 0000000) ? OPCODE_HALT :
+        (opcode == 0000001) ? OPCODE_WAIT :
+        (opcode == 0000002) ? OPCODE_RTI :
+        (opcode == 0000003) ? OPCODE_BPT :
+        (opcode == 0000004) ? OPCODE_IOT :
+        (opcode == 0000005) ? OPCODE_RESET :
+        (opcode == 0000006) ? OPCODE_RTT :
+        // MFPT            0000007, 0000007
+        // RESERVED:       0000010, 0000077
+        (opcode >= 0000100 && opcode <= 0000177) ? OPCODE_JMP :
+        (opcode >= 0000200 && opcode <= 0000207) ? OPCODE_RTS :  // RTS / RETURN
+        // RESERVED:       0000210, 0000227
+        // SPL             0000230, 0000237
+        (opcode == 0000240) ? OPCODE_NOP :
+        (opcode >= 0000241 && opcode <= 0000257) ? OPCODE_CCC :
+        (opcode == 0000260) ? OPCODE_NOP :
+        (opcode >= 0000261 && opcode <= 0000277) ? OPCODE_SCC :
+        (opcode >= 0000300 && opcode <= 0000377) ? OPCODE_SWAB :
+        (opcode >= 0000400 && opcode <= 0000777) ? OPCODE_BR :
+        (opcode >= 0001000 && opcode <= 0001377) ? OPCODE_BNE :
+        (opcode >= 0001400 && opcode <= 0001777) ? OPCODE_BEQ :
+        (opcode >= 0002000 && opcode <= 0002377) ? OPCODE_BGE :
+        (opcode >= 0002400 && opcode <= 0002777) ? OPCODE_BLT :
+        (opcode >= 0003000 && opcode <= 0003377) ? OPCODE_BGT :
+        (opcode >= 0003400 && opcode <= 0003777) ? OPCODE_BLE :
+        (opcode >= 0004000 && opcode <= 0004777) ? OPCODE_JSR :  // JSR / CALL
+        (opcode >= 0005000 && opcode <= 0005077) ? OPCODE_CLR :
+        (opcode >= 0005100 && opcode <= 0005177) ? OPCODE_COM :
+        (opcode >= 0005200 && opcode <= 0005277) ? OPCODE_INC :
+        (opcode >= 0005300 && opcode <= 0005377) ? OPCODE_DEC :
+        (opcode >= 0005400 && opcode <= 0005477) ? OPCODE_NEG :
+        (opcode >= 0005500 && opcode <= 0005577) ? OPCODE_ADC :
+        (opcode >= 0005600 && opcode <= 0005677) ? OPCODE_SBC :
+        (opcode >= 0005700 && opcode <= 0005777) ? OPCODE_TST :
+        (opcode >= 0006000 && opcode <= 0006077) ? OPCODE_ROR :
+        (opcode >= 0006100 && opcode <= 0006177) ? OPCODE_ROL :
+        (opcode >= 0006200 && opcode <= 0006277) ? OPCODE_ASR :
+        (opcode >= 0006300 && opcode <= 0006377) ? OPCODE_ASL :
+        (opcode >= 0006400 && opcode <= 0006477) ? OPCODE_MARK :
+        // MFPI            0006500, 0006577
+        // MTPI            0006600, 0006677
+        (opcode >= 0006700 && opcode <= 0006777) ? OPCODE_SXT :
+        // RESERVED:       0007000, 0007777
+        (opcode >= 0010000 && opcode <= 0017777) ? OPCODE_MOV :
+        (opcode >= 0020000 && opcode <= 0027777) ? OPCODE_CMP :
+        (opcode >= 0030000 && opcode <= 0037777) ? OPCODE_BIT :
+        (opcode >= 0040000 && opcode <= 0047777) ? OPCODE_BIC :
+        (opcode >= 0050000 && opcode <= 0057777) ? OPCODE_BIS :
+        (opcode >= 0060000 && opcode <= 0067777) ? OPCODE_ADD :
+        (opcode >= 0070000 && opcode <= 0070777) ? OPCODE_MUL :
+        (opcode >= 0071000 && opcode <= 0071777) ? OPCODE_DIV :
+        (opcode >= 0072000 && opcode <= 0072777) ? OPCODE_ASH :
+        (opcode >= 0073000 && opcode <= 0073777) ? OPCODE_ASHC :
+        (opcode >= 0074000 && opcode <= 0074777) ? OPCODE_XOR :
+        // FADD etc.       0075000, 0075777
+        // RESERVED:       0076000, 0076777
+        (opcode >= 0077000 && opcode <= 0077777) ? OPCODE_SOB :
+        (opcode >= 0100000 && opcode <= 0100377) ? OPCODE_BPL :
+        (opcode >= 0100400 && opcode <= 0100777) ? OPCODE_BMI :
+        (opcode >= 0101000 && opcode <= 0101377) ? OPCODE_BHI :
+        (opcode >= 0101400 && opcode <= 0101777) ? OPCODE_BLOS :
+        (opcode >= 0102000 && opcode <= 0102377) ? OPCODE_BVC :
+        (opcode >= 0102400 && opcode <= 0102777) ? OPCODE_BVS :
+        (opcode >= 0103000 && opcode <= 0103377) ? OPCODE_BHIS :  // BCC, BHIS
+        (opcode >= 0103400 && opcode <= 0103777) ? OPCODE_BLO :   // BCS, BLO
+        (opcode >= 0104000 && opcode <= 0104377) ? OPCODE_EMT :
+        (opcode >= 0104400 && opcode <= 0104777) ? OPCODE_TRAP :
+        (opcode >= 0105000 && opcode <= 0105077) ? OPCODE_CLRB :
+        (opcode >= 0105100 && opcode <= 0105177) ? OPCODE_COMB :
+        (opcode >= 0105200 && opcode <= 0105277) ? OPCODE_INCB :
+        (opcode >= 0105300 && opcode <= 0105377) ? OPCODE_DECB :
+        (opcode >= 0105400 && opcode <= 0105477) ? OPCODE_NEGB :
+        (opcode >= 0105500 && opcode <= 0105577) ? OPCODE_ADCB :
+        (opcode >= 0105600 && opcode <= 0105677) ? OPCODE_SBCB :
+        (opcode >= 0105700 && opcode <= 0105777) ? OPCODE_TSTB :
+        (opcode >= 0106000 && opcode <= 0106077) ? OPCODE_RORB :
+        (opcode >= 0106100 && opcode <= 0106177) ? OPCODE_ROLB :
+        (opcode >= 0106200 && opcode <= 0106277) ? OPCODE_ASRB :
+        (opcode >= 0106300 && opcode <= 0106377) ? OPCODE_ASLB :
+        (opcode >= 0106400 && opcode <= 0106477) ? OPCODE_MTPS :
+        // MFPD            0106500, 0106577
+        // MTPD            0106600, 0106677
+        (opcode >= 0106700 && opcode <= 0106777) ? OPCODE_MFPS :
+        (opcode >= 0110000 && opcode <= 0117777) ? OPCODE_MOVB :
+        (opcode >= 0120000 && opcode <= 0127777) ? OPCODE_CMPB :
+        (opcode >= 0130000 && opcode <= 0137777) ? OPCODE_BITB :
+        (opcode >= 0140000 && opcode <= 0147777) ? OPCODE_BICB :
+        (opcode >= 0150000 && opcode <= 0157777) ? OPCODE_BISB :
+        (opcode >= 0160000 && opcode <= 0167777) ? OPCODE_SUB :
+        OPCODE_UNKNOWN;  // There is no such instruction
+}
+
+// Opcode class table, 64K bytes built at compile time
+#define OPCODE_CLASS_1(n)     GetOpcodeClass(n)
+#define OPCODE_CLASS_8(n)     OPCODE_CLASS_1(n), OPCODE_CLASS_1(n + 01), OPCODE_CLASS_1(n + 02), OPCODE_CLASS_1(n + 03), \
+                              OPCODE_CLASS_1(n + 04), OPCODE_CLASS_1(n + 05), OPCODE_CLASS_1(n + 06), OPCODE_CLASS_1(n + 07)
+#define OPCODE_CLASS_64(n)    OPCODE_CLASS_8(n), OPCODE_CLASS_8(n + 010), OPCODE_CLASS_8(n + 020), OPCODE_CLASS_8(n + 030), \
+                              OPCODE_CLASS_8(n + 040), OPCODE_CLASS_8(n + 050), OPCODE_CLASS_8(n + 060), OPCODE_CLASS_8(n + 070)
+#define OPCODE_CLASS_512(n)   OPCODE_CLASS_64(n), OPCODE_CLASS_64(n + 0100), OPCODE_CLASS_64(n + 0200), OPCODE_CLASS_64(n + 0300), \
+                              OPCODE_CLASS_64(n + 0400), OPCODE_CLASS_64(n + 0500), OPCODE_CLASS_64(n + 0600), OPCODE_CLASS_64(n + 0700)
+#define OPCODE_CLASS_4096(n)  OPCODE_CLASS_512(n), OPCODE_CLASS_512(n + 01000), OPCODE_CLASS_512(n + 02000), OPCODE_CLASS_512(n + 03000), \
+                              OPCODE_CLASS_512(n + 04000), OPCODE_CLASS_512(n + 05000), OPCODE_CLASS_512(n + 06000), OPCODE_CLASS_512(n + 07000)
+#define OPCODE_CLASS_32768(n) OPCODE_CLASS_4096(n), OPCODE_CLASS_4096(n + 010000), OPCODE_CLASS_4096(n + 020000), OPCODE_CLASS_4096(n + 030000), \
+                              OPCODE_CLASS_4096(n + 040000), OPCODE_CLASS_4096(n + 050000), OPCODE_CLASS_4096(n + 060000), OPCODE_CLASS_4096(n + 070000)
+
+constexpr uint8_t OpcodeClassTable[65536] =
+{
+    OPCODE_CLASS_32768(0), OPCODE_CLASS_32768(0100000)
+};
+
+#undef OPCODE_CLASS_1
+#undef OPCODE_CLASS_8
+#undef OPCODE_CLASS_64
+#undef OPCODE_CLASS_512
+#undef OPCODE_CLASS_4096
+#undef OPCODE_CLASS_32768
+
+// Double operand commands specialized on the address modes, rows of m_ModeMethodMap
+enum
+{
+    MODEMAP_MOV,
+    MODEMAP_MOVB,
+    MODEMAP_CMP,
+    MODEMAP_CMPB,
+    MODEMAP_BIT,
+    MODEMAP_BITB,
+    MODEMAP_BIC,
+    MODEMAP_BICB,
+    MODEMAP_BIS,
+    MODEMAP_BISB,
+    MODEMAP_ADD,
+    MODEMAP_SUB,
+};
+
+#define MODE_METHODS_8(name, ms) \
+    &CProcessor::name<ms, 0>, &CProcessor::name<ms, 1>, &CProcessor::name<ms, 2>, &CProcessor::name<ms, 3>, \
+    &CProcessor::name<ms, 4>, &CProcessor::name<ms, 5>, &CProcessor::name<ms, 6>, &CProcessor::name<ms, 7>
+#define MODE_METHODS(name) { \
+    MODE_METHODS_8(name, 0), MODE_METHODS_8(name, 1), MODE_METHODS_8(name, 2), MODE_METHODS_8(name, 3), \
+    MODE_METHODS_8(name, 4), MODE_METHODS_8(name, 5), MODE_METHODS_8(name, 6), MODE_METHODS_8(name, 7) }
+
+const CProcessor::ExecuteMethodRef CProcessor::m_ModeMethodMap[12][64] =
+{
+    MODE_METHODS(ExecuteMOV),
+    MODE_METHODS(ExecuteMOVB),
+    MODE_METHODS(ExecuteCMP),
+    MODE_METHODS(ExecuteCMPB),
+    MODE_METHODS(ExecuteBIT),
+    MODE_METHODS(ExecuteBITB),
+    MODE_METHODS(ExecuteBIC),
+    MODE_METHODS(ExecuteBICB),
+    MODE_METHODS(ExecuteBIS),
+    MODE_METHODS(ExecuteBISB),
+    MODE_METHODS(ExecuteADD),
+    MODE_METHODS(ExecuteSUB),
+};
+
+#undef MODE_METHODS_8
+#undef MODE_METHODS
+
+// Double operand commands are in m_ModeMethodMap
+const CProcessor::ExecuteMethodRef CProcessor::m_OpcodeMethodMap[OPCODE_COUNT] =
+{
+    &CProcessor::ExecuteUNKNOWN,  // OPCODE_UNKNOWN
+    &CProcessor::ExecuteHALT,     // OPCODE_HALT
+    &CProcessor::ExecuteWAIT,     // OPCODE_WAIT
+    &CProcessor::ExecuteRTI,      // OPCODE_RTI
+    &CProcessor::ExecuteBPT,      // OPCODE_BPT
+    &CProcessor::ExecuteIOT,      // OPCODE_IOT
+    &CProcessor::ExecuteRESET,    // OPCODE_RESET
+    &CProcessor::ExecuteRTT,      // OPCODE_RTT
+    &CProcessor::ExecuteJMP,      // OPCODE_JMP
+    &CProcessor::ExecuteRTS,      // OPCODE_RTS
+    &CProcessor::ExecuteNOP,      // OPCODE_NOP
+    &CProcessor::ExecuteCCC,      // OPCODE_CCC
+    &CProcessor::ExecuteSCC,      // OPCODE_SCC
+    &CProcessor::ExecuteSWAB,     // OPCODE_SWAB
+    &CProcessor::ExecuteBR,       // OPCODE_BR
+    &CProcessor::ExecuteBNE,      // OPCODE_BNE
+    &CProcessor::ExecuteBEQ,      // OPCODE_BEQ
+    &CProcessor::ExecuteBGE,      // OPCODE_BGE
+    &CProcessor::ExecuteBLT,      // OPCODE_BLT
+    &CProcessor::ExecuteBGT,      // OPCODE_BGT
+    &CProcessor::ExecuteBLE,      // OPCODE_BLE
+    &CProcessor::ExecuteJSR,      // OPCODE_JSR
+    &CProcessor::ExecuteCLR,      // OPCODE_CLR
+    &CProcessor::ExecuteCOM,      // OPCODE_COM
+    &CProcessor::ExecuteINC,      // OPCODE_INC
+    &CProcessor::ExecuteDEC,      // OPCODE_DEC
+    &CProcessor::ExecuteNEG,      // OPCODE_NEG
+    &CProcessor::ExecuteADC,      // OPCODE_ADC
+    &CProcessor::ExecuteSBC,      // OPCODE_SBC
+    &CProcessor::ExecuteTST,      // OPCODE_TST
+    &CProcessor::ExecuteROR,      // OPCODE_ROR
+    &CProcessor::ExecuteROL,      // OPCODE_ROL
+    &CProcessor::ExecuteASR,      // OPCODE_ASR
+    &CProcessor::ExecuteASL,      // OPCODE_ASL
+    &CProcessor::ExecuteMARK,     // OPCODE_MARK
+    &CProcessor::ExecuteSXT,      // OPCODE_SXT
+    nullptr,                      // OPCODE_MOV
+    nullptr,                      // OPCODE_CMP
+    nullptr,                      // OPCODE_BIT
+    nullptr,                      // OPCODE_BIC
+    nullptr,                      // OPCODE_BIS
+    nullptr,                      // OPCODE_ADD
+    &CProcessor::ExecuteMUL,      // OPCODE_MUL
+    &CProcessor::ExecuteDIV,      // OPCODE_DIV
+    &CProcessor::ExecuteASH,      // OPCODE_ASH
+    &CProcessor::ExecuteASHC,     // OPCODE_ASHC
+    &CProcessor::ExecuteXOR,      // OPCODE_XOR
+    &CProcessor::ExecuteSOB,      // OPCODE_SOB
+    &CProcessor::ExecuteBPL,      // OPCODE_BPL
+    &CProcessor::ExecuteBMI,      // OPCODE_BMI
+    &CProcessor::ExecuteBHI,      // OPCODE_BHI
+    &CProcessor::ExecuteBLOS,     // OPCODE_BLOS
+    &CProcessor::ExecuteBVC,      // OPCODE_BVC
+    &CProcessor::ExecuteBVS,      // OPCODE_BVS
+    &CProcessor::ExecuteBHIS,     // OPCODE_BHIS
+    &CProcessor::ExecuteBLO,      // OPCODE_BLO
+    &CProcessor::ExecuteEMT,      // OPCODE_EMT
+    &CProcessor::ExecuteTRAP,     // OPCODE_TRAP
+    &CProcessor::ExecuteCLRB,     // OPCODE_CLRB
+    &CProcessor::ExecuteCOMB,     // OPCODE_COMB
+    &CProcessor::ExecuteINCB,     // OPCODE_INCB
+    &CProcessor::ExecuteDECB,     // OPCODE_DECB
+    &CProcessor::ExecuteNEGB,     // OPCODE_NEGB
+    &CProcessor::ExecuteADCB,     // OPCODE_ADCB
+    &CProcessor::ExecuteSBCB,     // OPCODE_SBCB
+    &CProcessor::ExecuteTSTB,     // OPCODE_TSTB
+    &CProcessor::ExecuteRORB,     // OPCODE_RORB
+    &CProcessor::ExecuteROLB,     // OPCODE_ROLB
+    &CProcessor::ExecuteASRB,     // OPCODE_ASRB
+    &CProcessor::ExecuteASLB,     // OPCODE_ASLB
+    &CProcessor::ExecuteMTPS,     // OPCODE_MTPS
+    &CProcessor::ExecuteMFPS,     // OPCODE_MFPS
+    nullptr,                      // OPCODE_MOVB
+    nullptr,                      // OPCODE_CMPB
+    nullptr,                      // OPCODE_BITB
+    nullptr,                      // OPCODE_BICB
+    nullptr,                      // OPCODE_BISB
+    nullptr,                      // OPCODE_SUB
+};
+
+// Double operand commands: opcode class -> row of m_ModeMethodMap
+static int GetModeMapRow(uint8_t opcodeclass)
+{
+    switch (opcodeclass)
+    {
+    case OPCODE_MOV:  return MODEMAP_MOV;
+    case OPCODE_MOVB: return MODEMAP_MOVB;
+    case OPCODE_CMP:  return MODEMAP_CMP;
+    case OPCODE_CMPB: return MODEMAP_CMPB;
+    case OPCODE_BIT:  return MODEMAP_BIT;
+    case OPCODE_BITB: return MODEMAP_BITB;
+    case OPCODE_BIC:  return MODEMAP_BIC;
+    case OPCODE_BICB: return MODEMAP_BICB;
+    case OPCODE_BIS:  return MODEMAP_BIS;
+    case OPCODE_BISB: return MODEMAP_BISB;
+    case OPCODE_ADD:  return MODEMAP_ADD;
+    case OPCODE_SUB:  return MODEMAP_SUB;
+    default:          return -1;
+    }
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -186,16 +465,22 @@ void CProcessor::RegisterMethodRef(uint16_t start, uint16_t end, CProcessor::Exe
 
 CProcessor::CProcessor(CMotherboard* pBoard)
 {
+    // The hot state is the head of the object and fits in one cache line, see Processor.h
+    static_assert(offsetof(CProcessor, m_R) == 0, "CProcessor hot state should start the object");
+    static_assert(offsetof(CProcessor, m_pBoard) + sizeof(m_pBoard) <= 64, "CProcessor hot state should fit in 64 bytes");
+
     ASSERT(pBoard != nullptr);
     m_pBoard = pBoard;
     ::memset(m_R, 0, sizeof(m_R));
     m_psw = 0340;
+    m_ccLazy = 0;
     m_okStopped = true;
     m_internalTick = 0;
     m_waitmode = false;
     m_stepmode = false;
-    m_RPLYrq = m_RSVDrq = m_TBITrq = m_HALTrq = m_HALTCMDrq = m_RPL2rq = m_EVNTrq = false;
-    m_BPT_rq = m_IOT_rq = m_EMT_rq = m_TRAPrq = false;
+    m_okBlockEnd = false;
+    m_RPLYrq = false;
+    m_intrq = 0;
 
     m_instruction = m_instructionpc = 0;
     m_regsrc = m_methsrc = 0;
@@ -203,8 +488,86 @@ CProcessor::CProcessor(CMotherboard* pBoard)
     m_addrsrc = m_addrdest = 0;
     m_virqrq = 0;
     memset(m_virq, 0, sizeof(m_virq));
+    m_cycleCount = 0;
 
     memset(m_eisregs, 0, sizeof(m_eisregs));
+    m_instructionCount = 0;
+    m_okBreak = false;
+    m_pBreakpoints = nullptr;
+    m_breakpointsVersion = 0;
+    m_okBreakpointHit = false;
+    m_okLoop = m_okLoopClean = false;
+    m_loopPC = m_loopPSW = 0;
+    memset(m_loopR, 0, sizeof(m_loopR));
+    memset(m_loopEisRegs, 0, sizeof(m_loopEisRegs));
+    m_loopCycle = m_loopInstructionCount = 0;
+    m_idleCycleCount = 0;
+    m_pProfiler = nullptr;
+    ResetCounters();
+    m_okHaltEntered = false;
+    m_haltCauses = 0;
+    m_haltEntryCycle = 0;
+
+    m_opcodeclass = 0;
+    m_pDecoded = static_cast<DecodedInstruction*>(::calloc(DECODEINDEX_COUNT, sizeof(DecodedInstruction)));
+    m_pBlocks = static_cast<DecodedBlock*>(::calloc(BLOCKCACHE_COUNT, sizeof(DecodedBlock)));
+    InvalidateDecodedAll();
+}
+
+CProcessor::~CProcessor()
+{
+    ::free(m_pDecoded);
+    ::free(m_pBlocks);
+}
+
+void CProcessor::InvalidateDecodedAll()
+{
+    for (int index = 0; index < DECODEINDEX_COUNT; index++)
+    {
+        m_pDecoded[index].decoded = false;
+        m_pDecoded[index].blockgen = 0;
+    }
+    for (int block = 0; block < BLOCKCACHE_COUNT; block++)
+        m_pBlocks[block].index = -1;
+    m_blockGeneration = 1;
+    m_okBlockEnd = true;
+    m_okLoopClean = false;
+}
+
+// A RAM word under a block is changed; ROM blocks stay
+void CProcessor::InvalidateBlocks()
+{
+    m_okBlockEnd = true;  // The current block could be changed too
+    m_blockGeneration++;
+    if (m_blockGeneration == 0)  // Generation counter wrapped around, forget all the marks
+    {
+        for (int index = 0; index < DECODEINDEX_ROM; index++)
+            m_pDecoded[index].blockgen = 0;
+        for (int block = 0; block < BLOCKCACHE_COUNT; block++)
+        {
+            if (m_pBlocks[block].generation != 0)
+                m_pBlocks[block].index = -1;
+        }
+        m_blockGeneration = 1;
+    }
+}
+
+void CProcessor::ClearBlocks()
+{
+    for (int block = 0; block < BLOCKCACHE_COUNT; block++)
+        m_pBlocks[block].index = -1;
+    m_okBlockEnd = true;
+}
+
+// Blocks end before the breakpoint addresses, so they are built again for the new breakpoints
+void CProcessor::SetBreakpoints(CBreakpointList* pBreakpoints)
+{
+    if (pBreakpoints == m_pBreakpoints)
+        return;
+    m_pBreakpoints = pBreakpoints;
+    if (pBreakpoints != nullptr)
+        m_breakpointsVersion = pBreakpoints->GetVersion();
+    ClearBlocks();
 }
 
 void CProcessor::Start()
@@ -213,16 +576,17 @@ void CProcessor::Start()
 
     m_stepmode = false;
     m_waitmode = false;
-    m_RPLYrq = m_RSVDrq = m_TBITrq = m_HALTrq = m_HALTCMDrq = m_RPL2rq = m_EVNTrq = false;
-    m_BPT_rq = m_IOT_rq = m_EMT_rq = m_TRAPrq = false;
+    m_RPLYrq = false;
+    m_intrq = 0;
     m_virqrq = 0;  memset(m_virq, 0, sizeof(m_virq));
+    m_okHaltEntered = false;
 
     // Simulate 588ВГ1 INIT microcode:
     // Vector fetch at 000024/000026 returns 000000 (588ВА1 disconnected)
     // -> PC=0, PSW=0 -> executes HALT at address 0 -> HALT interrupt fires
     SetPC(0);
     SetPSW(0);
-    m_HALTCMDrq = true;  // simulate HALT instruction at address 0
+    m_intrq |= INTRQ_HALTCMD;  // simulate HALT instruction at address 0
     m_internalTick = 1000000;  // Количество тактов на включение процессора (значение с потолка)
 }
 
@@ -232,20 +596,295 @@ void CProcessor::Stop()
 
     m_stepmode = false;
     m_waitmode = false;
-    m_psw = 0340;
+    SetPSW(0340);
     m_internalTick = 0;
-    m_RPLYrq = m_RSVDrq = m_TBITrq = m_HALTrq = m_HALTCMDrq = m_RPL2rq = m_EVNTrq = false;
-    m_BPT_rq = m_IOT_rq = m_EMT_rq = m_TRAPrq = false;
+    m_RPLYrq = false;
+    m_intrq = 0;
     m_virqrq = 0;  memset(m_virq, 0, sizeof(m_virq));
+    m_okHaltEntered = false;
+}
+
+// Execute ticks in a row: ticks inside the instruction are skipped at once, instruction boundaries go to Execute().
+// Returns at the given cycle, right after the instruction that called BreakExecution(), or at the instruction
+// boundary with a breakpoint at PC, see IsBreakpointHit(). The boundary at the start is not checked, so the
+// next call goes on from the breakpoint.
+int CProcessor::ExecuteUntil(uint64_t cycle)
+{
+    if (m_pBreakpoints != nullptr)
+    {
+        if (m_pBreakpoints->GetVersion() != m_breakpointsVersion)  // Breakpoints changed, blocks could pass them
+        {
+            m_breakpointsVersion = m_pBreakpoints->GetVersion();
+            ClearBlocks();
+        }
+        return (m_pProfiler != nullptr) ? ExecuteCycles<true, true>(cycle) : ExecuteCycles<false, true>(cycle);
+    }
+    return (m_pProfiler != nullptr) ? ExecuteCycles<true, false>(cycle) : ExecuteCycles<false, false>(cycle);
+}
+
+template<bool profiling, bool breakpoints>
+int CProcessor::ExecuteCycles(uint64_t cycle)
+{
+    uint64_t start = m_cycleCount;
+    m_okBreak = false;
+    m_okBreakpointHit = false;
+    while (m_cycleCount < cycle)
+    {
+        if (m_okStopped)  // Processor is stopped - the time goes anyway
+        {
+            m_cycleCount = cycle;
+            break;
+        }
+
+        uint64_t left = cycle - m_cycleCount;
+        if (static_cast<uint64_t>(m_internalTick) >= left)  // No instruction boundary before the cycle
+        {
+            m_internalTick -= static_cast<int>(left);
+            m_cycleCount = cycle;
+            if (breakpoints && m_internalTick == 0)  // The boundary is right at the cycle
+                CheckBreakpoint();
+            break;
+        }
+        m_cycleCount += m_internalTick;
+        m_internalTick = 0;
+        // Instruction boundary; blocks end before the breakpoint addresses, so every one comes here
+        if (breakpoints && m_cycleCount != start && CheckBreakpoint())
+            break;
+
+        bool okWaitPoll = m_waitmode && !m_stepmode;
+        if (m_waitmode || m_stepmode || !ExecuteBlock<profiling>(cycle))
+            Execute();  // Instruction boundary tick
+
+        if (m_okBreak)
+            break;
+
+        if (okWaitPoll && m_waitmode && m_cycleCount < cycle)
+        {
+            // WAIT and no interrupt: the next boundaries poll the same requests, nothing changes until a board event
+            left = cycle - m_cycleCount;
+            if (static_cast<uint64_t>(m_internalTick) < left)
+            {
+                const uint64_t period = TIMING_ILLEGAL + 1;
+                uint64_t rest = (left - m_internalTick - 1) % period;  // Ticks after the last boundary
+                m_internalTick = TIMING_ILLEGAL - static_cast<int>(rest);
+            }
+            else
+                m_internalTick -= static_cast<int>(left);
+            m_cycleCount = cycle;
+            break;
+        }
+
+        if (!m_waitmode && !profiling)  // Skipped loop iterations would be lost for the profiler
+            CheckIdleLoop(cycle);
+    }
+
+    return static_cast<int>(m_cycleCount - start);
+}
+
+bool CProcessor::CheckBreakpoint()
+{
+    uint16_t pc = m_R[7];
+    if (m_okStopped || m_waitmode || !m_pBreakpoints->IsBreakpoint(pc))
+        return false;
+    m_okLoopClean = false;  // Idle loop iterations with a breakpoint are not skipped, the hits are counted
+    if (!m_pBreakpoints->Check(pc, this, m_pBoard))
+        return false;
+    m_okBreakpointHit = true;
+    return true;
+}
+
+// Idle loop: a short backward branch target is reached twice with the same processor state,
+// and there were no memory writes and no device side effects between. Device state changes only
+// on board events, so all the next iterations up to the given cycle are the same, and they are skipped.
+void CProcessor::CheckIdleLoop(uint64_t cycle)
+{
+    const uint16_t maxLoopLength = 040;  // Bytes
+
+    uint16_t pc = m_R[7];
+    uint64_t loopCycle = m_cycleCount + m_internalTick;  // The next instruction starts here
+    if (m_okLoop && pc == m_loopPC)
+    {
+        if (m_okLoopClean && GetPSW() == m_loopPSW &&
+            memcmp(m_R, m_loopR, sizeof(m_R)) == 0 && memcmp(m_eisregs, m_loopEisRegs, sizeof(m_eisregs)) == 0)
+        {
+            uint64_t length = loopCycle - m_loopCycle;
+            if (loopCycle + length <= cycle)
+            {
+                uint64_t count = (cycle - loopCycle) / length;
+                m_instructionCount += count * (m_instructionCount - m_loopInstructionCount);
+                m_cycleCount += count * length;
+                m_idleCycleCount += count * length;
+                m_Counters.modecycles[IsHaltMode() ? 1 : 0] += count * length;
+                loopCycle += count * length;
+            }
+        }
+    }
+    else if (pc <= m_instructionpc && m_instructionpc - pc <= maxLoopLength)  // Short backward branch
+    {
+        m_okLoop = true;
+        m_loopPC = pc;
+    }
+    else
+        return;
+
+    // Save the state at the loop start
+    m_okLoopClean = true;
+    m_loopPSW = GetPSW();
+    memcpy(m_loopR, m_R, sizeof(m_R));
+    memcpy(m_loopEisRegs, m_eisregs, sizeof(m_eisregs));
+    m_loopCycle = loopCycle;
+    m_loopInstructionCount = m_instructionCount;
+}
+
+// Block ends on the instructions that change the control flow or the processor mode
+static bool IsBlockEnd(uint8_t opcodeclass)
+{
+    switch (opcodeclass)
+    {
+    case OPCODE_UNKNOWN: case OPCODE_HALT: case OPCODE_WAIT: case OPCODE_RTI: case OPCODE_BPT:
+    case OPCODE_IOT: case OPCODE_RESET: case OPCODE_RTT: case OPCODE_JMP: case OPCODE_RTS:
+    case OPCODE_BR: case OPCODE_BNE: case OPCODE_BEQ: case OPCODE_BGE: case OPCODE_BLT:
+    case OPCODE_BGT: case OPCODE_BLE: case OPCODE_JSR: case OPCODE_MARK: case OPCODE_SOB:
+    case OPCODE_BPL: case OPCODE_BMI: case OPCODE_BHI: case OPCODE_BLOS: case OPCODE_BVC:
+    case OPCODE_BVS: case OPCODE_BHIS: case OPCODE_BLO: case OPCODE_EMT: case OPCODE_TRAP:
+    case OPCODE_MTPS:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Operand word follows the instruction for modes 6, 7 and for PC modes 2, 3
+static int GetOperandLength(uint8_t meth, uint8_t reg)
+{
+    return (meth >= 6 || ((meth == 2 || meth == 3) && reg == 7)) ? 2 : 0;
+}
+
+// Straight-line run of instructions from the given address up to a block end instruction or a breakpoint,
+// within one 4K page as the next page can be mapped anywhere
+void CProcessor::BuildBlock(DecodedBlock* pBlock, uint16_t pc, int index)
+{
+    pBlock->index = index;
+    pBlock->generation = (index >= DECODEINDEX_ROM) ? 0 : m_blockGeneration;
+    int count = 0;
+    for (;;)
+    {
+        DecodedInstruction* pDecoded = m_pDecoded + index;
+        if (!pDecoded->decoded)
+            DecodeInstruction(pDecoded, pc);
+        if (index < DECODEINDEX_ROM)
+            pDecoded->blockgen = m_blockGeneration;  // Write to this word drops the block
+
+        BlockInstruction* pInstr = pBlock->instructions + count;
+        pInstr->instruction = pDecoded->instruction;
+        pInstr->opcodeclass = pDecoded->opcodeclass;
+        pInstr->regsrc   = pDecoded->regsrc;
+        pInstr->methsrc  = pDecoded->methsrc;
+        pInstr->regdest  = pDecoded->regdest;
+        pInstr->methdest = pDecoded->methdest;
+        int length = 2;
+        int row = GetModeMapRow(pDecoded->opcodeclass);
+        if (row >= 0)  // Double operand command
+        {
+            pInstr->method = m_ModeMethodMap[row][(pDecoded->methsrc << 3) | pDecoded->methdest];
+            length += GetOperandLength(pDecoded->methsrc, pDecoded->regsrc);
+            length += GetOperandLength(pDecoded->methdest, pDecoded->regdest);
+        }
+        else
+        {
+            pInstr->method = m_OpcodeMethodMap[pDecoded->opcodeclass];
+            if (pDecoded->opcodeclass != OPCODE_NOP && pDecoded->opcodeclass != OPCODE_CCC &&
+                pDecoded->opcodeclass != OPCODE_SCC)
+                length += GetOperandLength(pDecoded->methdest, pDecoded->regdest);
+        }
+        pInstr->length = static_cast<uint8_t>(length);
+        count++;
+
+        uint16_t nextpc = pc + length;
+        if (count == BLOCK_MAXLENGTH || IsBlockEnd(pDecoded->opcodeclass) ||
+            (nextpc & 0170000) != (pc & 0170000) ||
+            (m_pBreakpoints != nullptr && m_pBreakpoints->IsBreakpoint(nextpc)))
+            break;
+        pc = nextpc;
+        index += length / 2;
+    }
+    pBlock->count = count;
+}
+
+// Execute instructions from the translated block at PC, the same way as Execute() does on every
+// instruction boundary. Leaves the block when the flow goes elsewhere, on an idle loop start,
+// on device state change or when the next instruction boundary is at the cycle or later.
+// Returns false if there is no block for the current address.
+template<bool profiling>
+bool CProcessor::ExecuteBlock(uint64_t cycle)
+{
+    uint16_t pc = m_R[7];
+    if (pc & 1)
+        return false;
+    int index = m_pBoard->GetDecodeIndex(pc);
+    if (index < 0)  // Ports or fetch-watched page
+        return false;
+
+    DecodedBlock* pBlock = m_pBlocks + (index & (BLOCKCACHE_COUNT - 1));
+    if (pBlock->index != index || (pBlock->generation != 0 && pBlock->generation != m_blockGeneration))
+        BuildBlock(pBlock, pc, index);
+
+    m_okBlockEnd = false;
+    const BlockInstruction* pInstr = pBlock->instructions;
+    const BlockInstruction* pInstrEnd = pInstr + pBlock->count;
+    for (;;)
+    {
+        m_internalTick = TIMING_ILLEGAL;
+        m_RPLYrq = false;
+        m_instructionpc = m_R[7];
+        m_instruction = pInstr->instruction;
+        m_opcodeclass = pInstr->opcodeclass;
+        m_regsrc   = pInstr->regsrc;
+        m_methsrc  = pInstr->methsrc;
+        m_regdest  = pInstr->regdest;
+        m_methdest = pInstr->methdest;
+        m_R[7] += 2;
+        bool okHaltMode = (m_psw & PSW_P) != 0;
+        (this->*pInstr->method)();
+        if (m_internalTick > 0) m_internalTick--;  // Count current tick too
+        m_instructionCount++;
+        m_Counters.modecycles[okHaltMode ? 1 : 0] += m_internalTick + 1;
+        if (profiling)
+            m_pProfiler->Count(m_instructionpc, okHaltMode, m_internalTick + 1);
+
+        if (m_instruction == PI_RTT && (GetPSW() & PSW_T))
+        {
+            // Skip interrupt processing for RTT with T bit set
+        }
+        else if (m_intrq != 0 || m_RPLYrq || (m_psw & PSW_T))  // Usually there are no requests
+            ProcessInterrupts();
+        m_cycleCount++;
+
+        uint16_t nextpc = m_instructionpc + pInstr->length;
+        if (++pInstr == pInstrEnd || m_R[7] != nextpc || m_okBreak || m_okBlockEnd ||
+            (m_okLoop && nextpc == m_loopPC) ||  // Let ExecuteUntil() check the idle loop
+            m_cycleCount + m_internalTick >= cycle)
+            break;
+
+        m_cycleCount += m_internalTick;
+        m_internalTick = 0;
+    }
+
+    return true;
 }
 
 void CProcessor::Execute()
 {
-    if (m_okStopped) return;  // Processor is stopped - nothing to do
+    if (m_okStopped)  // Processor is stopped - nothing to do
+    {
+        m_cycleCount++;
+        return;
+    }
 
     if (m_internalTick > 0)
     {
         m_internalTick--;
+        m_cycleCount++;
         return;
     }
     m_internalTick = TIMING_ILLEGAL;  // ANYTHING UNKNOWN
@@ -258,8 +897,13 @@ void CProcessor::Execute()
         FetchInstruction();  // Read next instruction from memory
         if (!m_RPLYrq)
         {
+            bool okHaltMode = IsHaltMode();
             TranslateInstruction();  // Execute next instruction
             if (m_internalTick > 0) m_internalTick--;  // Count current tick too
+            m_instructionCount++;
+            m_Counters.modecycles[okHaltMode ? 1 : 0] += m_internalTick + 1;
+            if (m_pProfiler != nullptr)
+                m_pProfiler->Count(m_instructionpc, okHaltMode, m_internalTick + 1);
         }
     }
 
@@ -270,144 +914,121 @@ void CProcessor::Execute()
         // Skip interrupt processing for RTT with T bit set
     }
     else  // Processing interrupts
-    {
-        for (;;)
-        {
-            m_TBITrq = (m_psw & 020) != 0;  // T-bit
+        ProcessInterrupts();
 
-            // Calculate interrupt vector and mode according to priority
-            uint16_t intrVector = 0;
-            bool intrMode = false;  // true = HALT mode interrupt, false = USER mode interrupt
+    m_cycleCount++;
+}
 
-            if (m_HALTrq)  // HALT signal
-            {
-                intrVector = 0002;  intrMode = true;
-                m_HALTrq = false;
-                m_pBoard->PreProcessHALT();
-            }
-            else if (m_HALTCMDrq)  // HALT command
-            {
-                intrVector = 0002;  intrMode = true;
-                m_HALTCMDrq = false;
-                m_pBoard->PreProcessHALT();  // snapshot and clear accumulator
-            }
-            else if (m_BPT_rq)  // BPT command
-            {
-                intrVector = 0000014;  intrMode = false;
-                m_BPT_rq = false;
-            }
-            else if (m_IOT_rq)  // IOT command
-            {
-                intrVector = 0000020;  intrMode = false;
-                m_IOT_rq = false;
-            }
-            else if (m_EMT_rq)  // EMT command
-            {
-                intrVector = 0000030;  intrMode = false;
-                m_EMT_rq = false;
-            }
-            else if (m_TRAPrq)  // TRAP command
-            {
-                intrVector = 0000034;  intrMode = false;
-                m_TRAPrq = false;
-            }
-            else if (m_RPLYrq)  // Зависание
-            {
-                intrVector = 0000004;  intrMode = false;
+void CProcessor::ProcessInterrupts()
+{
+    for (;;)
+    {
+        // T-bit request follows the PSW, hangup request comes from the current instruction
+        m_intrq = (m_intrq & ~INTRQ_TBIT) | ((m_psw & PSW_T) ? INTRQ_TBIT : 0);
+        uint16_t intrq = m_intrq | (m_RPLYrq ? INTRQ_RPLY : 0);
+        if (m_waitmode)
+            intrq &= ~INTRQ_TBIT;
+        if (m_psw & 0200)  // HALT mode masks EVNT and VIRQ
+            intrq &= ~(INTRQ_EVNT | INTRQ_VIRQ);
+        if (intrq == 0)
+            break;  // No more unmasked interrupts
+
+        // Calculate interrupt vector and mode according to priority
+        int intrBit = HighestBit(intrq);
+        uint16_t intrMask = static_cast<uint16_t>(1 << intrBit);
+        uint16_t intrVector;
+        bool intrMode = false;  // true = HALT mode interrupt, false = USER mode interrupt
+        if (intrMask == INTRQ_VIRQ)  // The lowest queue number first
+        {
+            int irq = LowestBit(m_virqrq);
+            intrVector = m_virq[irq];
+            m_virq[irq] = 0;
+            m_virqrq &= ~(1 << irq);
+            if (m_virqrq == 0)
+                m_intrq &= ~INTRQ_VIRQ;
+        }
+        else
+        {
+            intrVector = InterruptVectors[intrBit];
+            m_intrq &= ~intrMask;
+            if (intrMask == INTRQ_RPLY)
                 m_RPLYrq = false;
-            }
-            //else if (m_RPL2rq)  // Двойное зависание, priority 1
-            //{
-            //    intrVector = 0174;  intrMode = true;
-            //    m_RPL2rq = false;
-            //}
-            else if (m_RSVDrq)  // Reserved command, priority 2
-            {
-                intrVector = 000010;  intrMode = false;
-                m_RSVDrq = false;
-            }
-            else if (m_TBITrq && (!m_waitmode))  // T-bit
-            {
-                intrVector = 000014;  intrMode = false;
-                m_TBITrq = false;
-            }
-            else if (m_EVNTrq && (m_psw & 0200) != 0200)  // EVNT signal
-            {
-                intrVector = 0000100;  intrMode = false;
-                m_EVNTrq = false;
-            }
-            else if (m_virqrq > 0 && (m_psw & 0200) != 0200)  // VIRQ, priority 7
+            else if (intrMask & (INTRQ_HALT | INTRQ_HALTCMD))
             {
-                intrMode = false;
-                for (int irq = 0; irq <= 15; irq++)
-                {
-                    if (m_virq[irq] != 0)
-                    {
-                        intrVector = m_virq[irq];
-                        m_virq[irq] = 0;
-                        m_virqrq--;
-                        break;
-                    }
-                }
-                if (intrVector == 0) m_virqrq = 0;
+                intrMode = true;
+                m_pBoard->PreProcessHALT();  // snapshot and clear accumulator
             }
+        }
 
-            if (intrVector == 0)
-                break;  // No more unmasked interrupts
+        m_waitmode = false;
+        m_Counters.interrupts[intrMode ? 1 : 0][(intrVector & 0377) >> 1]++;
 
-            m_waitmode = false;
+        if (intrMode)  // HALT mode interrupt
+        {
+            uint16_t selVector = 0160000;
+            intrVector |= selVector;
 
-            if (intrMode)  // HALT mode interrupt
+            uint16_t oldpsw = GetPSW();
+            if ((oldpsw & PSW_P) == 0)  // HALT monitor call from USER mode
             {
-                uint16_t selVector = 0160000;
-                intrVector |= selVector;
-
-                uint16_t oldpsw = m_psw;
+                uint8_t requests = m_pBoard->GetHaltRequests();
+                m_haltCauses = (requests != 0) ? requests : (1 << HALTCAUSE_NONE);
+                for (int cause = 0; cause < HALTCAUSE_COUNT; cause++)
+                {
+                    if (m_haltCauses & (1 << cause))
+                        m_Counters.haltentries[cause]++;
+                }
+                m_haltEntryCycle = m_cycleCount + m_internalTick;
+                m_okHaltEntered = true;
+            }
 
-                // Save PC/PSW to stack
-                SetSP(GetSP() - 2);
-                SetWord(GetSP(), oldpsw);
-                SetSP(GetSP() - 2);
-                SetWord(GetSP(), GetPC());
+            // Save PC/PSW to stack
+            SetSP(GetSP() - 2);
+            SetWord(GetSP(), oldpsw);
+            SetSP(GetSP() - 2);
+            SetWord(GetSP(), GetPC());
 
-                SetPC(GetWord(intrVector));
-                m_psw = GetWord(intrVector + 2) & 0377;
+            SetPC(GetWord(intrVector));
+            SetPSW(GetWord(intrVector + 2) & 0377);
+            if (m_pProfiler != nullptr)
+                m_pProfiler->Call(GetPC(), GetSP(), IsHaltMode(), intrVector);
 #if !defined(PRODUCT)
-                if (m_pBoard->GetTrace() & TRACE_CPUINT)
+            if (m_pBoard->GetTrace() & TRACE_CPUINT)
+            {
+                if (intrVector == 0160002)  // HALT
                 {
-                    if (intrVector == 0160002)  // HALT
-                    {
-                        uint16_t port170006 = m_pBoard->GetPortView(0170006);
-                        uint8_t keybyte = (uint8_t)(port170006 & 255);
-                        DebugLogFormat(_T("CPU HALT interrupt vector=%06o PC=%06o PSW=%06o 170006=%06o %C\r\n"), intrVector, GetPC(), GetPSW(), port170006, keybyte >= 32 && keybyte < 128 ? (char)keybyte : ' ');
-                    }
-                    else
-                    {
-                        DebugLogFormat(_T("CPU interrupt vector=%06o PC=%06o PSW=%06o\r\n"), intrVector, GetPC(), GetPSW());
-                    }
+                    uint16_t port170006 = m_pBoard->GetPortView(0170006);
+                    uint8_t keybyte = (uint8_t)(port170006 & 255);
+                    DebugLogFormat(_T("CPU HALT interrupt vector=%06o PC=%06o PSW=%06o 170006=%06o %C\r\n"), intrVector, GetPC(), GetPSW(), port170006, keybyte >= 32 && keybyte < 128 ? (char)keybyte : ' ');
+                }
+                else
+                {
+                    DebugLogFormat(_T("CPU interrupt vector=%06o PC=%06o PSW=%06o\r\n"), intrVector, GetPC(), GetPSW());
                 }
-#endif
             }
-            else  // USER mode interrupt
-            {
-                uint16_t oldpsw = m_psw;
+#endif
+        }
+        else  // USER mode interrupt
+        {
+            uint16_t oldpsw = GetPSW();
 
-                // Save PC/PSW to stack
-                SetSP(GetSP() - 2);
-                SetWord(GetSP(), oldpsw);
-                SetSP(GetSP() - 2);
-                SetWord(GetSP(), GetPC());
+            // Save PC/PSW to stack
+            SetSP(GetSP() - 2);
+            SetWord(GetSP(), oldpsw);
+            SetSP(GetSP() - 2);
+            SetWord(GetSP(), GetPC());
 
-                SetPC(GetWord(intrVector));
-                m_psw = GetWord(intrVector + 2) & 0377;
+            SetPC(GetWord(intrVector));
+            SetPSW(GetWord(intrVector + 2) & 0377);
+            if (m_pProfiler != nullptr)
+                m_pProfiler->Call(GetPC(), GetSP(), IsHaltMode(), intrVector);
 
-                if (m_pBoard->GetTrace() & TRACE_CPUINT)
-                {
-                    if (intrVector != 000020 && intrVector != 000030 && intrVector != 000034)  // skip IOT/EMT/TRAP
-                        DebugLogFormat(_T("CPU interrupt vector=%06o PC=%06o PSW=%06o\r\n"), intrVector, GetPC(), GetPSW());
-                }
+            if (m_pBoard->GetTrace() & TRACE_CPUINT)
+            {
+                if (intrVector != 000020 && intrVector != 000030 && intrVector != 000034)  // skip IOT/EMT/TRAP
+                    DebugLogFormat(_T("CPU interrupt vector=%06o PC=%06o PSW=%06o\r\n"), intrVector, GetPC(), GetPSW());
             }
-        }  // end while
+        }
     }
 }
 
@@ -415,7 +1036,7 @@ void CProcessor::TickEVNT()
 {
     if (m_okStopped) return;  // Processor is stopped - nothing to do
 
-    m_EVNTrq = true;
+    m_intrq |= INTRQ_EVNT;
 }
 
 void CProcessor::InterruptVIRQ(int que, uint16_t interrupt)
@@ -425,8 +1046,15 @@ void CProcessor::InterruptVIRQ(int que, uint16_t interrupt)
     // {
     //  DebugPrintFormat(_T("Lost VIRQ %d %d\r\n"), m_virq, interrupt);
     // }
-    m_virqrq += 1;
     m_virq[que] = interrupt;
+    if (interrupt != 0)
+        m_virqrq |= (1 << que);
+    else
+        m_virqrq &= ~(1 << que);
+    if (m_virqrq != 0)
+        m_intrq |= INTRQ_VIRQ;
+    else
+        m_intrq &= ~INTRQ_VIRQ;
 }
 
 void CProcessor::MemoryError()
@@ -454,7 +1082,28 @@ void CProcessor::FetchInstruction()
     uint16_t pc = GetPC();
     pc = pc & ~1;
 
-    m_instruction = GetWordExec(pc);
+    int index = m_pBoard->GetDecodeIndex(pc);
+    if (index >= 0)  // RAM or ROM: take the instruction from the decoded cache
+    {
+        DecodedInstruction* pDecoded = m_pDecoded + index;
+        if (!pDecoded->decoded)  // Not decoded yet or the memory was changed
+            DecodeInstruction(pDecoded, pc);
+        m_instruction = pDecoded->instruction;
+        m_regdest  = pDecoded->regdest;
+        m_methdest = pDecoded->methdest;
+        m_regsrc   = pDecoded->regsrc;
+        m_methsrc  = pDecoded->methsrc;
+        m_opcodeclass = pDecoded->opcodeclass;
+    }
+    else
+    {
+        m_instruction = GetWordExec(pc);
+        m_regdest  = GetDigit(m_instruction, 0);
+        m_methdest = GetDigit(m_instruction, 1);
+        m_regsrc   = GetDigit(m_instruction, 2);
+        m_methsrc  = GetDigit(m_instruction, 3);
+        m_opcodeclass = OpcodeClassTable[m_instruction];
+    }
     SetPC(GetPC() + 2);
 
 //    uint16_t address = GetPC() - 2;
@@ -472,27 +1121,48 @@ void CProcessor::FetchInstruction()
 //    }
 }
 
+void CProcessor::DecodeInstruction(DecodedInstruction* pDecoded, uint16_t pc)
+{
+    uint16_t instruction = GetWordExec(pc);
+    pDecoded->instruction = instruction;
+    pDecoded->regdest  = GetDigit(instruction, 0);
+    pDecoded->methdest = GetDigit(instruction, 1);
+    pDecoded->regsrc   = GetDigit(instruction, 2);
+    pDecoded->methsrc  = GetDigit(instruction, 3);
+    pDecoded->opcodeclass = OpcodeClassTable[instruction];
+    pDecoded->decoded = true;
+}
+
 void CProcessor::TranslateInstruction()
 {
     //if (m_okTrace)
     //    TraceInstruction(this, m_instructionpc);
 
-    // Prepare values to help decode the command
-    m_regdest  = GetDigit(m_instruction, 0);
-    m_methdest = GetDigit(m_instruction, 1);
-    m_regsrc   = GetDigit(m_instruction, 2);
-    m_methsrc  = GetDigit(m_instruction, 3);
-
-    // Find command implementation using the command map
-    ExecuteMethodRef methodref = m_pExecuteMethodMap[m_instruction];
-    (this->*methodref)();  // Call command implementation method
+    // Call command implementation, opcode class found by FetchInstruction()
+    int modes = (m_methsrc << 3) | m_methdest;
+    switch (m_opcodeclass)
+    {
+    case OPCODE_MOV:   (this->*m_ModeMethodMap[MODEMAP_MOV][modes])();  break;
+    case OPCODE_CMP:   (this->*m_ModeMethodMap[MODEMAP_CMP][modes])();  break;
+    case OPCODE_BIT:   (this->*m_ModeMethodMap[MODEMAP_BIT][modes])();  break;
+    case OPCODE_BIC:   (this->*m_ModeMethodMap[MODEMAP_BIC][modes])();  break;
+    case OPCODE_BIS:   (this->*m_ModeMethodMap[MODEMAP_BIS][modes])();  break;
+    case OPCODE_ADD:   (this->*m_ModeMethodMap[MODEMAP_ADD][modes])();  break;
+    case OPCODE_MOVB:  (this->*m_ModeMethodMap[MODEMAP_MOVB][modes])(); break;
+    case OPCODE_CMPB:  (this->*m_ModeMethodMap[MODEMAP_CMPB][modes])(); break;
+    case OPCODE_BITB:  (this->*m_ModeMethodMap[MODEMAP_BITB][modes])(); break;
+    case OPCODE_BICB:  (this->*m_ModeMethodMap[MODEMAP_BICB][modes])(); break;
+    case OPCODE_BISB:  (this->*m_ModeMethodMap[MODEMAP_BISB][modes])(); break;
+    case OPCODE_SUB:   (this->*m_ModeMethodMap[MODEMAP_SUB][modes])();  break;
+    default:           (this->*m_OpcodeMethodMap[m_opcodeclass])();  break;
+    }
 }
 
 void CProcessor::ExecuteUNKNOWN()  // Нет такой инструкции - просто вызывается TRAP 10
 {
     DebugLogFormat(_T(">>Invalid OPCODE = %06o at %06o\r\n"), m_instruction, m_instructionpc);
 
-    m_RSVDrq = true;
+    m_intrq |= INTRQ_RSVD;
 }
 
 
@@ -507,7 +1177,24 @@ void CProcessor::ExecuteWAIT()  // WAIT - Wait for an interrupt
 
 void CProcessor::ExecuteHALT()  // HALT - Останов
 {
-    m_HALTCMDrq = true;
+    m_intrq |= INTRQ_HALTCMD;
+}
+
+void CProcessor::CountHaltExit()
+{
+    m_okHaltEntered = false;
+    uint64_t cycles = m_cycleCount + m_internalTick - m_haltEntryCycle;
+    int bucket = 0;
+    while (bucket < HALTLATENCY_BUCKETS - 1 && (cycles >> (bucket + 1)) != 0)
+        bucket++;
+    for (int cause = 0; cause < HALTCAUSE_COUNT; cause++)
+    {
+        if (m_haltCauses & (1 << cause))
+        {
+            m_Counters.haltcycles[cause] += cycles;
+            m_Counters.haltlatency[cause][bucket]++;
+        }
+    }
 }
 
 void CProcessor::ExecuteRTI()  // RTI - Return from Interrupt
@@ -520,8 +1207,12 @@ void CProcessor::ExecuteRTI()  // RTI - Return from Interrupt
     uint16_t new_psw = GetWord(GetSP());  // Pop PSW --- saving HALT
     SetSP( GetSP() + 2 );
     SetPSW(new_psw & 0377);
+    if (m_pProfiler != nullptr)
+        m_pProfiler->Return(GetSP());
 
     m_internalTick = TIMING_RTI;
+    if (m_okHaltEntered && !IsHaltMode())
+        CountHaltExit();
 }
 
 void CProcessor::ExecuteRTT()  // RTT - Return from Trace Trap
@@ -535,21 +1226,25 @@ void CProcessor::ExecuteRTT()  // RTT - Return from Trace Trap
     SetSP( GetSP() + 2 );
     if (m_RPLYrq) return;
     SetPSW(new_psw & 0377);
+    if (m_pProfiler != nullptr)
+        m_pProfiler->Return(GetSP());
 
     //m_psw |= PSW_T; // set the trap flag ???
 
     m_internalTick = TIMING_RTI;
+    if (m_okHaltEntered && !IsHaltMode())
+        CountHaltExit();
 }
 
 void CProcessor::ExecuteBPT()  // BPT - Breakpoint
 {
-    m_BPT_rq = true;
+    m_intrq |= INTRQ_BPT;
     m_internalTick = TIMING_EMT;
 }
 
 void CProcessor::ExecuteIOT()  // IOT - I/O trap
 {
-    m_IOT_rq = true;
+    m_intrq |= INTRQ_IOT;
     m_internalTick = TIMING_EMT;
 }
 
@@ -567,6 +1262,8 @@ void CProcessor::ExecuteRTS()  // RTS - return from subroutine
     SetSP(GetSP() + 2);
     if (m_RPLYrq) return;
     SetReg(m_regdest, word);
+    if (m_pProfiler != nullptr)
+        m_pProfiler->Return(GetSP());
     m_internalTick = TIMING_RTS;
 }
 
@@ -764,9 +1461,7 @@ void CProcessor::ExecuteINC()
         SetReg(m_regdest, dst);
     if (m_RPLYrq) return;
 
-    SetN((dst >> 15) != 0);
-    SetZ(!dst);
-    SetV(dst == 0100000);
+    SetLazyFlags(PSW_N | PSW_Z | PSW_V, CCOP_INC, dst);
 
     m_internalTick = TIMING_REGREG + TIMING_AB[m_methdest];
 }
@@ -794,9 +1489,7 @@ void CProcessor::ExecuteINCB()
         SetReg(m_regdest, (GetReg(m_regdest) & 0177400) | dst);
     if (m_RPLYrq) return;
 
-    SetN((dst >> 7) != 0);
-    SetZ(!dst);
-    SetV(dst == 0200);
+    SetLazyFlagsB(PSW_N | PSW_Z | PSW_V, CCOP_INCB, dst);
 
     m_internalTick = TIMING_REGREG + TIMING_AB[m_methdest];
 }
@@ -824,9 +1517,7 @@ void CProcessor::ExecuteDEC()
         SetReg(m_regdest, dst);
     if (m_RPLYrq) return;
 
-    SetN((dst >> 15) != 0);
-    SetZ(!dst);
-    SetV(dst == 077777);
+    SetLazyFlags(PSW_N | PSW_Z | PSW_V, CCOP_DEC, dst);
 
     m_internalTick = TIMING_REGREG + TIMING_AB[m_methdest];
 }
@@ -854,9 +1545,7 @@ void CProcessor::ExecuteDECB()
         SetReg(m_regdest, (GetReg(m_regdest) & 0177400) | dst);
     if (m_RPLYrq) return;
 
-    SetN((dst >> 7) != 0);
-    SetZ(!dst);
-    SetV(dst == 0177);
+    SetLazyFlagsB(PSW_N | PSW_Z | PSW_V, CCOP_DECB, dst);
 
     m_internalTick = TIMING_REGREG + TIMING_AB[m_methdest];
 }
@@ -1061,10 +1750,7 @@ void CProcessor::ExecuteTST()
     else
         dst = GetReg(m_regdest);
 
-    SetN((dst >> 15) != 0);
-    SetZ(!dst);
-    SetV(false);
-    SetC(false);
+    SetLazyFlags(PSW_N | PSW_Z | PSW_V | PSW_C, CCOP_LOGIC, dst);
 
     m_internalTick = TIMING_REGREG + TIMING_A1[m_methdest];
 }
@@ -1083,10 +1769,7 @@ void CProcessor::ExecuteTSTB()
     else
         dst = GetLReg(m_regdest);
 
-    SetN((dst >> 7) != 0);
-    SetZ(!dst);
-    SetV(false);
-    SetC(false);
+    SetLazyFlagsB(PSW_N | PSW_Z | PSW_V | PSW_C, CCOP_LOGIC, dst);
 
     m_internalTick = TIMING_REGREG + TIMING_A1[m_methdest];
 }
@@ -1381,6 +2064,8 @@ void CProcessor::ExecuteMTPS()  // MTPS - move to PS
     }
 
     m_internalTick = TIMING_REGREG + TIMING_AB[m_methdest];
+    if (m_okHaltEntered && !IsHaltMode())
+        CountHaltExit();
 }
 
 void CProcessor::ExecuteMFPS()  // MFPS - move from PS
@@ -1548,9 +2233,7 @@ void CProcessor::ExecuteXOR()
         SetReg(m_regdest, dst);
     if (m_RPLYrq) return;
 
-    SetN((dst >> 15) != 0);
-    SetZ(!dst);
-    SetV(false);
+    SetLazyFlags(PSW_N | PSW_Z | PSW_V, CCOP_LOGIC, dst);
 
     m_internalTick = TIMING_REGREG + TIMING_A2[m_methdest];
 }
@@ -1689,7 +2372,7 @@ void CProcessor::ExecuteASHC()  // ASHC - arithmetic shift combined
     if (m_RPLYrq) return;
     src &= 0x3F;
     src |= (src & 040) ? 0177700 : 0;
-    long dst = MAKELONG(GetReg(m_regsrc | 1), GetReg(m_regsrc));
+    int32_t dst = MAKELONG(GetReg(m_regsrc | 1), GetReg(m_regsrc));
     m_internalTick = ASHC_TIMING[m_methdest];
     if (src >= 0)
     {
@@ -1737,14 +2420,15 @@ void CProcessor::ExecuteSOB()  // SOB - subtract one: R = R - 1; if R != 0 : PC
     m_internalTick = TIMING_SOB;
 }
 
+template<int METHSRC, int METHDEST>
 void CProcessor::ExecuteMOV()  // MOV - move
 {
     uint16_t src_addr, dst_addr;
     uint16_t dst;
 
-    if (m_methsrc)
+    if (METHSRC)
     {
-        src_addr = GetWordAddr(m_methsrc, m_regsrc);
+        src_addr = GetWordAddr(METHSRC, m_regsrc);
         if (m_RPLYrq) return;
         dst = GetWord(src_addr);
         if (m_RPLYrq) return;
@@ -1752,9 +2436,9 @@ void CProcessor::ExecuteMOV()  // MOV - move
     else
         dst = GetReg(m_regsrc);
 
-    if (m_methdest)
+    if (METHDEST)
     {
-        dst_addr = GetWordAddr(m_methdest, m_regdest);
+        dst_addr = GetWordAddr(METHDEST, m_regdest);
         if (m_RPLYrq) return;
         SetWord(dst_addr, dst);
         if (m_RPLYrq) return;
@@ -1762,21 +2446,20 @@ void CProcessor::ExecuteMOV()  // MOV - move
     else
         SetReg(m_regdest, dst);
 
-    SetN((dst >> 15) != 0);
-    SetZ(!dst);
-    SetV(false);
+    SetLazyFlags(PSW_N | PSW_Z | PSW_V, CCOP_LOGIC, dst);
 
-    m_internalTick = TIMING_REGREG + TIMING_A[m_methsrc] + TIMING_DST[m_methdest];
+    m_internalTick = TIMING_REGREG + TIMING_A[METHSRC] + TIMING_DST[METHDEST];
 }
 
+template<int METHSRC, int METHDEST>
 void CProcessor::ExecuteMOVB()  // MOVB - move byte
 {
     uint16_t src_addr, dst_addr;
     uint8_t dst;
 
-    if (m_methsrc)
+    if (METHSRC)
     {
-        src_addr = GetByteAddr(m_methsrc, m_regsrc);
+        src_addr = GetByteAddr(METHSRC, m_regsrc);
         if (m_RPLYrq) return;
         dst = GetByte(src_addr);
         if (m_RPLYrq) return;
@@ -1784,9 +2467,9 @@ void CProcessor::ExecuteMOVB()  // MOVB - move byte
     else
         dst = GetLReg(m_regsrc);
 
-    if (m_methdest)
+    if (METHDEST)
     {
-        dst_addr = GetByteAddr(m_methdest, m_regdest);
+        dst_addr = GetByteAddr(METHDEST, m_regdest);
         if (m_RPLYrq) return;
         GetByte(dst_addr);
         if (m_RPLYrq) return;
@@ -1796,21 +2479,20 @@ void CProcessor::ExecuteMOVB()  // MOVB - move byte
     else
         SetReg(m_regdest, (dst & 0200) ? (0177400 | dst) : dst);
 
-    SetN((dst >> 7) != 0);
-    SetZ(!dst);
-    SetV(false);
+    SetLazyFlagsB(PSW_N | PSW_Z | PSW_V, CCOP_LOGIC, dst);
 
-    m_internalTick = TIMING_REGREG + TIMING_A[m_methsrc] + TIMING_DST[m_methdest];
+    m_internalTick = TIMING_REGREG + TIMING_A[METHSRC] + TIMING_DST[METHDEST];
 }
 
+template<int METHSRC, int METHDEST>
 void CProcessor::ExecuteCMP()  // CMP - compare
 {
     uint16_t src_addr, dst_addr;
     uint16_t src, src2;
 
-    if (m_methsrc)
+    if (METHSRC)
     {
-        src_addr = GetWordAddr(m_methsrc, m_regsrc);
+        src_addr = GetWordAddr(METHSRC, m_regsrc);
         if (m_RPLYrq) return;
         src = GetWord(src_addr);
         if (m_RPLYrq) return;
@@ -1818,9 +2500,9 @@ void CProcessor::ExecuteCMP()  // CMP - compare
     else
         src = GetReg(m_regsrc);
 
-    if (m_methdest)
+    if (METHDEST)
     {
-        dst_addr = GetWordAddr(m_methdest, m_regdest);
+        dst_addr = GetWordAddr(METHDEST, m_regdest);
         if (m_RPLYrq) return;
         src2 = GetWord(dst_addr);
         if (m_RPLYrq) return;
@@ -1830,22 +2512,20 @@ void CProcessor::ExecuteCMP()  // CMP - compare
 
     uint16_t dst = src - src2;
 
-    SetN(CheckForNegative(dst));
-    SetZ(CheckForZero(dst));
-    SetV(CheckSubForOverflow(src, src2));
-    SetC(CheckSubForCarry(src, src2));
+    SetLazyFlags(PSW_N | PSW_Z | PSW_V | PSW_C, CCOP_SUB, dst, src, src2);
 
-    m_internalTick = TIMING_REGREG + TIMING_A1[m_methsrc] + TIMING_CMP[m_methdest];
+    m_internalTick = TIMING_REGREG + TIMING_A1[METHSRC] + TIMING_CMP[METHDEST];
 }
 
+template<int METHSRC, int METHDEST>
 void CProcessor::ExecuteCMPB()  // CMPB - compare byte
 {
     uint16_t src_addr, dst_addr;
     uint8_t src, src2;
 
-    if (m_methsrc)
+    if (METHSRC)
     {
-        src_addr = GetByteAddr(m_methsrc, m_regsrc);
+        src_addr = GetByteAddr(METHSRC, m_regsrc);
         if (m_RPLYrq) return;
         src = GetByte(src_addr);
         if (m_RPLYrq) return;
@@ -1853,9 +2533,9 @@ void CProcessor::ExecuteCMPB()  // CMPB - compare byte
     else
         src = GetLReg(m_regsrc);
 
-    if (m_methdest)
+    if (METHDEST)
     {
-        dst_addr = GetByteAddr(m_methdest, m_regdest);
+        dst_addr = GetByteAddr(METHDEST, m_regdest);
         if (m_RPLYrq) return;
         src2 = GetByte(dst_addr);
         if (m_RPLYrq) return;
@@ -1865,22 +2545,20 @@ void CProcessor::ExecuteCMPB()  // CMPB - compare byte
 
     uint8_t dst = src - src2;
 
-    SetN(CheckForNegative(dst));
-    SetZ(CheckForZero(dst));
-    SetV(CheckSubForOverflow(src, src2));
-    SetC(CheckSubForCarry(src, src2));
+    SetLazyFlagsB(PSW_N | PSW_Z | PSW_V | PSW_C, CCOP_SUBB, dst, src, src2);
 
-    m_internalTick = TIMING_REGREG + TIMING_A1[m_methsrc] + TIMING_CMP[m_methdest];
+    m_internalTick = TIMING_REGREG + TIMING_A1[METHSRC] + TIMING_CMP[METHDEST];
 }
 
+template<int METHSRC, int METHDEST>
 void CProcessor::ExecuteBIT()  // BIT - bit test
 {
     uint16_t src_addr, dst_addr;
     uint16_t src, src2;
 
-    if (m_methsrc)
+    if (METHSRC)
     {
-        src_addr = GetWordAddr(m_methsrc, m_regsrc);
+        src_addr = GetWordAddr(METHSRC, m_regsrc);
         if (m_RPLYrq) return;
         src = GetWord(src_addr);
         if (m_RPLYrq) return;
@@ -1888,9 +2566,9 @@ void CProcessor::ExecuteBIT()  // BIT - bit test
     else
         src = GetReg(m_regsrc);
 
-    if (m_methdest)
+    if (METHDEST)
     {
-        dst_addr = GetWordAddr(m_methdest, m_regdest);
+        dst_addr = GetWordAddr(METHDEST, m_regdest);
         if (m_RPLYrq) return;
         src2 = GetWord(dst_addr);
         if (m_RPLYrq) return;
@@ -1900,21 +2578,20 @@ void CProcessor::ExecuteBIT()  // BIT - bit test
 
     uint16_t dst = src2 & src;
 
-    SetN((dst >> 15) != 0);
-    SetZ(!dst);
-    SetV(false);
+    SetLazyFlags(PSW_N | PSW_Z | PSW_V, CCOP_LOGIC, dst);
 
-    m_internalTick = TIMING_REGREG + TIMING_A1[m_methsrc] + TIMING_CMP[m_methdest];
+    m_internalTick = TIMING_REGREG + TIMING_A1[METHSRC] + TIMING_CMP[METHDEST];
 }
 
+template<int METHSRC, int METHDEST>
 void CProcessor::ExecuteBITB()  // BITB - bit test on byte
 {
     uint16_t src_addr, dst_addr;
     uint8_t src, src2;
 
-    if (m_methsrc)
+    if (METHSRC)
     {
-        src_addr = GetByteAddr(m_methsrc, m_regsrc);
+        src_addr = GetByteAddr(METHSRC, m_regsrc);
         if (m_RPLYrq) return;
         src = GetByte(src_addr);
         if (m_RPLYrq) return;
@@ -1922,9 +2599,9 @@ void CProcessor::ExecuteBITB()  // BITB - bit test on byte
     else
         src = GetLReg(m_regsrc);
 
-    if (m_methdest)
+    if (METHDEST)
     {
-        dst_addr = GetByteAddr(m_methdest, m_regdest);
+        dst_addr = GetByteAddr(METHDEST, m_regdest);
         if (m_RPLYrq) return;
         src2 = GetByte(dst_addr);
         if (m_RPLYrq) return;
@@ -1934,21 +2611,20 @@ void CProcessor::ExecuteBITB()  // BITB - bit test on byte
 
     uint8_t dst = src2 & src;
 
-    SetN((dst >> 7) != 0);
-    SetZ(!dst);
-    SetV(false);
+    SetLazyFlagsB(PSW_N | PSW_Z | PSW_V, CCOP_LOGIC, dst);
 
-    m_internalTick = TIMING_REGREG + TIMING_A1[m_methsrc] + TIMING_CMP[m_methdest];
+    m_internalTick = TIMING_REGREG + TIMING_A1[METHSRC] + TIMING_CMP[METHDEST];
 }
 
+template<int METHSRC, int METHDEST>
 void CProcessor::ExecuteBIC()  // BIC - bit clear
 {
     uint16_t src_addr, dst_addr = 0;
     uint16_t src, src2;
 
-    if (m_methsrc)
+    if (METHSRC)
     {
-        src_addr = GetWordAddr(m_methsrc, m_regsrc);
+        src_addr = GetWordAddr(METHSRC, m_regsrc);
         if (m_RPLYrq) return;
         src = GetWord(src_addr);
         if (m_RPLYrq) return;
@@ -1956,9 +2632,9 @@ void CProcessor::ExecuteBIC()  // BIC - bit clear
     else
         src = GetReg(m_regsrc);
 
-    if (m_methdest)
+    if (METHDEST)
     {
-        dst_addr = GetWordAddr(m_methdest, m_regdest);
+        dst_addr = GetWordAddr(METHDEST, m_regdest);
         if (m_RPLYrq) return;
         src2 = GetWord(dst_addr);
         if (m_RPLYrq) return;
@@ -1968,27 +2644,26 @@ void CProcessor::ExecuteBIC()  // BIC - bit clear
 
     uint16_t dst = src2 & (~src);
 
-    if (m_methdest)
+    if (METHDEST)
         SetWord(dst_addr, dst);
     else
         SetReg(m_regdest, dst);
     if (m_RPLYrq) return;
 
-    SetN((dst >> 15) != 0);
-    SetZ(!dst);
-    SetV(false);
+    SetLazyFlags(PSW_N | PSW_Z | PSW_V, CCOP_LOGIC, dst);
 
-    m_internalTick = TIMING_REGREG + TIMING_A[m_methsrc] + TIMING_DST[m_methdest];
+    m_internalTick = TIMING_REGREG + TIMING_A[METHSRC] + TIMING_DST[METHDEST];
 }
 
+template<int METHSRC, int METHDEST>
 void CProcessor::ExecuteBICB()  // BICB - bit clear
 {
     uint16_t src_addr, dst_addr = 0;
     uint8_t src, src2;
 
-    if (m_methsrc)
+    if (METHSRC)
     {
-        src_addr = GetByteAddr(m_methsrc, m_regsrc);
+        src_addr = GetByteAddr(METHSRC, m_regsrc);
         if (m_RPLYrq) return;
         src = GetByte(src_addr);
         if (m_RPLYrq) return;
@@ -1996,9 +2671,9 @@ void CProcessor::ExecuteBICB()  // BICB - bit clear
     else
         src = GetLReg(m_regsrc);
 
-    if (m_methdest)
+    if (METHDEST)
     {
-        dst_addr = GetByteAddr(m_methdest, m_regdest);
+        dst_addr = GetByteAddr(METHDEST, m_regdest);
         if (m_RPLYrq) return;
         src2 = GetByte(dst_addr);
         if (m_RPLYrq) return;
@@ -2008,27 +2683,26 @@ void CProcessor::ExecuteBICB()  // BICB - bit clear
 
     uint8_t dst = src2 & (~src);
 
-    if (m_methdest)
+    if (METHDEST)
         SetByte(dst_addr, dst);
     else
         SetReg(m_regdest, (GetReg(m_regdest) & 0177400) | dst);
     if (m_RPLYrq) return;
 
-    SetN((dst >> 7) != 0);
-    SetZ(!dst);
-    SetV(false);
+    SetLazyFlagsB(PSW_N | PSW_Z | PSW_V, CCOP_LOGIC, dst);
 
-    m_internalTick = TIMING_REGREG + TIMING_A[m_methsrc] + TIMING_DST[m_methdest];
+    m_internalTick = TIMING_REGREG + TIMING_A[METHSRC] + TIMING_DST[METHDEST];
 }
 
+template<int METHSRC, int METHDEST>
 void CProcessor::ExecuteBIS()  // BIS - bit set
 {
     uint16_t src_addr, dst_addr = 0;
     uint16_t src, src2;
 
-    if (m_methsrc)
+    if (METHSRC)
     {
-        src_addr = GetWordAddr(m_methsrc, m_regsrc);
+        src_addr = GetWordAddr(METHSRC, m_regsrc);
         if (m_RPLYrq) return;
         src = GetWord(src_addr);
         if (m_RPLYrq) return;
@@ -2036,9 +2710,9 @@ void CProcessor::ExecuteBIS()  // BIS - bit set
     else
         src = GetReg(m_regsrc);
 
-    if (m_methdest)
+    if (METHDEST)
     {
-        dst_addr = GetWordAddr(m_methdest, m_regdest);
+        dst_addr = GetWordAddr(METHDEST, m_regdest);
         if (m_RPLYrq) return;
         src2 = GetWord(dst_addr);
         if (m_RPLYrq) return;
@@ -2048,27 +2722,26 @@ void CProcessor::ExecuteBIS()  // BIS - bit set
 
     uint16_t dst = src2 | src;
 
-    if (m_methdest)
+    if (METHDEST)
         SetWord(dst_addr, dst);
     else
         SetReg(m_regdest, dst);
     if (m_RPLYrq) return;
 
-    SetN((dst >> 15) != 0);
-    SetZ(!dst);
-    SetV(false);
+    SetLazyFlags(PSW_N | PSW_Z | PSW_V, CCOP_LOGIC, dst);
 
-    m_internalTick = TIMING_REGREG + TIMING_A[m_methsrc] + TIMING_DST[m_methdest];
+    m_internalTick = TIMING_REGREG + TIMING_A[METHSRC] + TIMING_DST[METHDEST];
 }
 
+template<int METHSRC, int METHDEST>
 void CProcessor::ExecuteBISB()  // BISB - bit set on byte
 {
     uint16_t src_addr, dst_addr = 0;
     uint8_t src, src2;
 
-    if (m_methsrc)
+    if (METHSRC)
     {
-        src_addr = GetByteAddr(m_methsrc, m_regsrc);
+        src_addr = GetByteAddr(METHSRC, m_regsrc);
         if (m_RPLYrq) return;
         src = GetByte(src_addr);
         if (m_RPLYrq) return;
@@ -2076,9 +2749,9 @@ void CProcessor::ExecuteBISB()  // BISB - bit set on byte
     else
         src = GetLReg(m_regsrc);
 
-    if (m_methdest)
+    if (METHDEST)
     {
-        dst_addr = GetByteAddr(m_methdest, m_regdest);
+        dst_addr = GetByteAddr(METHDEST, m_regdest);
         if (m_RPLYrq) return;
         src2 = GetByte(dst_addr);
         if (m_RPLYrq) return;
@@ -2088,27 +2761,26 @@ void CProcessor::ExecuteBISB()  // BISB - bit set on byte
 
     uint8_t dst = src2 | src;
 
-    if (m_methdest)
+    if (METHDEST)
         SetByte(dst_addr, dst);
     else
         SetReg(m_regdest, (GetReg(m_regdest) & 0177400) | dst);
     if (m_RPLYrq) return;
 
-    SetN((dst >> 7) != 0);
-    SetZ(!dst);
-    SetV(false);
+    SetLazyFlagsB(PSW_N | PSW_Z | PSW_V, CCOP_LOGIC, dst);
 
-    m_internalTick = TIMING_REGREG + TIMING_A[m_methsrc] + TIMING_DST[m_methdest];
+    m_internalTick = TIMING_REGREG + TIMING_A[METHSRC] + TIMING_DST[METHDEST];
 }
 
+template<int METHSRC, int METHDEST>
 void CProcessor::ExecuteADD()
 {
     uint16_t src_addr, dst_addr = 0;
     uint16_t src, src2;
 
-    if (m_methsrc)
+    if (METHSRC)
     {
-        src_addr = GetWordAddr(m_methsrc, m_regsrc);
+        src_addr = GetWordAddr(METHSRC, m_regsrc);
         if (m_RPLYrq) return;
         src = GetWord(src_addr);
         if (m_RPLYrq) return;
@@ -2116,9 +2788,9 @@ void CProcessor::ExecuteADD()
     else
         src = GetReg(m_regsrc);
 
-    if (m_methdest)
+    if (METHDEST)
     {
-        dst_addr = GetWordAddr(m_methdest, m_regdest);
+        dst_addr = GetWordAddr(METHDEST, m_regdest);
         if (m_RPLYrq) return;
         src2 = GetWord(dst_addr);
         if (m_RPLYrq) return;
@@ -2128,28 +2800,26 @@ void CProcessor::ExecuteADD()
 
     signed short dst = src2 + src;
 
-    if (m_methdest)
+    if (METHDEST)
         SetWord(dst_addr, dst);
     else
         SetReg(m_regdest, dst);
     if (m_RPLYrq) return;
 
-    SetN(CheckForNegative(static_cast<uint16_t>(src2 + src)));
-    SetZ(CheckForZero(static_cast<uint16_t>(src2 + src)));
-    SetV(CheckAddForOverflow(src2, src));
-    SetC(CheckAddForCarry(src2, src));
+    SetLazyFlags(PSW_N | PSW_Z | PSW_V | PSW_C, CCOP_ADD, static_cast<uint16_t>(src2 + src), src2, src);
 
-    m_internalTick = TIMING_REGREG + TIMING_A[m_methsrc] + TIMING_DST[m_methdest];
+    m_internalTick = TIMING_REGREG + TIMING_A[METHSRC] + TIMING_DST[METHDEST];
 }
 
+template<int METHSRC, int METHDEST>
 void CProcessor::ExecuteSUB()
 {
     uint16_t src_addr, dst_addr = 0;
     uint16_t src, src2;
 
-    if (m_methsrc)
+    if (METHSRC)
     {
-        src_addr = GetWordAddr(m_methsrc, m_regsrc);
+        src_addr = GetWordAddr(METHSRC, m_regsrc);
         if (m_RPLYrq) return;
         src = GetWord(src_addr);
         if (m_RPLYrq) return;
@@ -2157,9 +2827,9 @@ void CProcessor::ExecuteSUB()
     else
         src = GetReg(m_regsrc);
 
-    if (m_methdest)
+    if (METHDEST)
     {
-        dst_addr = GetWordAddr(m_methdest, m_regdest);
+        dst_addr = GetWordAddr(METHDEST, m_regdest);
         if (m_RPLYrq) return;
         src2 = GetWord(dst_addr);
         if (m_RPLYrq) return;
@@ -2169,29 +2839,26 @@ void CProcessor::ExecuteSUB()
 
     uint16_t dst = src2 - src;
 
-    if (m_methdest)
+    if (METHDEST)
         SetWord(dst_addr, dst);
     else
         SetReg(m_regdest, dst);
     if (m_RPLYrq) return;
 
-    SetN(CheckForNegative(static_cast<uint16_t>(src2 - src)));
-    SetZ(CheckForZero(static_cast<uint16_t>(src2 - src)));
-    SetV(CheckSubForOverflow(src2, src));
-    SetC(CheckSubForCarry(src2, src));
+    SetLazyFlags(PSW_N | PSW_Z | PSW_V | PSW_C, CCOP_SUB, static_cast<uint16_t>(src2 - src), src2, src);
 
-    m_internalTick = TIMING_REGREG + TIMING_A[m_methsrc] + TIMING_DST[m_methdest];
+    m_internalTick = TIMING_REGREG + TIMING_A[METHSRC] + TIMING_DST[METHDEST];
 }
 
 void CProcessor::ExecuteEMT()  // EMT - emulator trap
 {
-    m_EMT_rq = true;
+    m_intrq |= INTRQ_EMT;
     m_internalTick = TIMING_EMT;
 }
 
 void CProcessor::ExecuteTRAP()
 {
-    m_TRAPrq = true;
+    m_intrq |= INTRQ_TRAP;
     m_internalTick = TIMING_EMT;
 }
 
@@ -2213,6 +2880,8 @@ void CProcessor::ExecuteJSR()  // JSR - jump subroutine: *--SP = R; R = PC; PC =
         SetReg(m_regsrc, GetPC());
         SetPC(dst);
         if (m_RPLYrq) return;
+        if (m_pProfiler != nullptr)
+            m_pProfiler->Call(dst, GetSP(), IsHaltMode(), CALLGRAPH_NOVECTOR);
 
         m_internalTick = TIMING_DS[m_methdest];
     }
@@ -2225,6 +2894,8 @@ void CProcessor::ExecuteMARK()  // MARK
     SetReg(5, GetWord( GetSP() ));
     SetSP( GetSP() + 2 );
     if (m_RPLYrq) return;
+    if (m_pProfiler != nullptr)
+        m_pProfiler->Return(GetSP());
 
     m_internalTick = TIMING_MARK;
 }
@@ -2246,7 +2917,7 @@ void CProcessor::SaveToImage(uint8_t* pImage)
 {
     // Processor data                               // Offset Size
     uint16_t* pwImage = reinterpret_cast<uint16_t*>(pImage);  //    0    --
-    *pwImage++ = m_psw;                             //    0     2   PSW
+    *pwImage++ = GetPSW();                          //    0     2   PSW
     ::memcpy(pwImage, m_R, 2 * 8);  pwImage += 8;   //    2    16   Registers R0-R7
     *pwImage++ = (m_okStopped ? 1 : 0);             //   18     2   Stopped
     *pwImage++ = static_cast<uint16_t>(m_internalTick);  //   20     2   Internal tick count
@@ -2258,16 +2929,16 @@ void CProcessor::SaveToImage(uint8_t* pImage)
     *pbImage++ = flags0;                            //   22     1   Flags
     uint8_t flags1 = 0;
     flags1 |= (m_RPLYrq ? 2 : 0);
-    flags1 |= (m_RSVDrq ? 8 : 0);
-    flags1 |= (m_TBITrq ? 16 : 0);
-    flags1 |= (m_HALTrq ? 64 : 0);
-    flags1 |= (m_EVNTrq ? 128 : 0);
+    flags1 |= ((m_intrq & INTRQ_RSVD) ? 8 : 0);
+    flags1 |= ((m_intrq & INTRQ_TBIT) ? 16 : 0);
+    flags1 |= ((m_intrq & INTRQ_HALT) ? 64 : 0);
+    flags1 |= ((m_intrq & INTRQ_EVNT) ? 128 : 0);
     *pbImage++ = flags1;                            //   23     1   Flags
     uint8_t flags2 = 0;
-    flags2 |= (m_BPT_rq ? 2 : 0);
-    flags2 |= (m_IOT_rq ? 4 : 0);
-    flags2 |= (m_EMT_rq ? 8 : 0);
-    flags2 |= (m_TRAPrq ? 16 : 0);
+    flags2 |= ((m_intrq & INTRQ_BPT) ? 2 : 0);
+    flags2 |= ((m_intrq & INTRQ_IOT) ? 4 : 0);
+    flags2 |= ((m_intrq & INTRQ_EMT) ? 8 : 0);
+    flags2 |= ((m_intrq & INTRQ_TRAP) ? 16 : 0);
     *pbImage++ = flags2;                            //   24     1   Flags
     //                                              //   25     1   RESERVED
     memcpy(pImage + 26, m_eisregs, 2 * 3);          //   26     6   EIS chip registers
@@ -2280,7 +2951,7 @@ void CProcessor::LoadFromImage(const uint8_t* pImage)
 
     // Processor data                               // Offset Size
     const uint16_t* pwImage = reinterpret_cast<const uint16_t*>(pImage);  //    0    --
-    m_psw = *pwImage++;                             //    0     2   PSW
+    SetPSW(*pwImage++);                             //    0     2   PSW
     ::memcpy(m_R, pwImage, 2 * 8);  pwImage += 8;   //    2    16   Registers R0-R7
     m_okStopped = (*pwImage++ != 0);                //   18     2   Stopped
     m_internalTick = *pwImage++;                    //   20     2   Internal tick count
@@ -2291,18 +2962,25 @@ void CProcessor::LoadFromImage(const uint8_t* pImage)
     m_waitmode  = ((flags0 &  32) != 0);
     uint8_t flags1 = *pbImage++;                    //   23     1   Flags
     m_RPLYrq    = ((flags1 &   2) != 0);
-    m_RSVDrq    = ((flags1 &   8) != 0);
-    m_TBITrq    = ((flags1 &  16) != 0);
-    m_HALTrq    = ((flags1 &  64) != 0);
-    m_EVNTrq    = ((flags1 & 128) != 0);
+    if (flags1 &   8) m_intrq |= INTRQ_RSVD;
+    if (flags1 &  16) m_intrq |= INTRQ_TBIT;
+    if (flags1 &  64) m_intrq |= INTRQ_HALT;
+    if (flags1 & 128) m_intrq |= INTRQ_EVNT;
     uint8_t flags2 = *pbImage++;                    //   24     1   Flags
-    m_BPT_rq    = ((flags2 &   2) != 0);
-    m_IOT_rq    = ((flags2 &   4) != 0);
-    m_EMT_rq    = ((flags2 &   8) != 0);
-    m_TRAPrq    = ((flags2 &  16) != 0);
+    if (flags2 &   2) m_intrq |= INTRQ_BPT;
+    if (flags2 &   4) m_intrq |= INTRQ_IOT;
+    if (flags2 &   8) m_intrq |= INTRQ_EMT;
+    if (flags2 &  16) m_intrq |= INTRQ_TRAP;
     //                                              //   25     1   RESERVED
     memcpy(m_eisregs, pImage + 26, 2 * 3);          //   26     3   EIS chip registers
     memcpy(m_virq, pImage + 32, 2 * 16);            //   32    32   VIRQ vectors
+    for (int irq = 0; irq < 16; irq++)
+    {
+        if (m_virq[irq] != 0)
+            m_virqrq |= (1 << irq);
+    }
+    if (m_virqrq != 0)
+        m_intrq |= INTRQ_VIRQ;
 }
 
 uint16_t CProcessor::GetWordAddr(uint8_t meth, uint8_t reg)
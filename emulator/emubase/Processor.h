@@ -16,39 +16,158 @@ NEMIGABTL. If not, see <http://www.gnu.org/licenses/>. */
 #include "Defines.h"
 #include "Board.h"
 
+class CProfiler;
+class CBreakpointList;
+
 
 //////////////////////////////////////////////////////////////////////
 
+// Lazy condition codes: how to calculate the flags from the last result, see CProcessor::CalcLazyFlags()
+#define CCOP_LOGIC      0  // N, Z from the result; V = 0, C = 0
+#define CCOP_ADD        1  // Result = A + B
+#define CCOP_SUB        2  // Result = A - B
+#define CCOP_SUBB       3  // Byte result = A - B
+#define CCOP_INC        4  // Result = dst + 1
+#define CCOP_INCB       5
+#define CCOP_DEC        6  // Result = dst - 1
+#define CCOP_DECB       7
+
+// Interrupt request bits, higher bit = higher priority, see CProcessor::Execute()
+#define INTRQ_VIRQ      00001  // VIRQ, priority 7, see m_virqrq
+#define INTRQ_EVNT      00002  // EVNT signal
+#define INTRQ_TBIT      00004  // T-bit
+#define INTRQ_RSVD      00010  // Reserved instruction, priority 2
+#define INTRQ_RPLY      00020  // Hangup, comes from m_RPLYrq
+#define INTRQ_TRAP      00040  // TRAP command
+#define INTRQ_EMT       00100  // EMT command
+#define INTRQ_IOT       00200  // IOT command
+#define INTRQ_BPT       00400  // BPT command
+#define INTRQ_HALTCMD   01000  // HALT command
+#define INTRQ_HALT      02000  // HALT signal
+
+// Translated block cache, see CProcessor::ExecuteBlock()
+#define BLOCKCACHE_COUNT 2048  // Direct-mapped by the block start decode index
+#define BLOCK_MAXLENGTH    16  // Instructions per block
+
+
+// HALT monitor accounting, see ProcessorCounters
+#define HALTCAUSE_COUNT      9  // HALT request bits 0-7 of port 170007, then HALTCAUSE_NONE
+#define HALTCAUSE_NONE       8  // HALT entry without request bits: HALT instruction, power on
+#define HALTLATENCY_BUCKETS 24  // Bucket N counts 2^N to 2^(N+1)-1 cycles, the last one counts the rest
+
+// Performance counters, see CProcessor::GetCounters()
+struct ProcessorCounters
+{
+    uint64_t    modecycles[2];  // Instruction cycles in USER mode and in HALT mode, skipped idle loops included
+    uint64_t    interrupts[2][0200];  // Interrupts taken to USER and to HALT mode, by vector / 2, vectors 0-376
+    // HALT mode entries from USER mode by cause; an entry with several request bits counts for every bit
+    uint64_t    haltentries[HALTCAUSE_COUNT];
+    uint64_t    haltcycles[HALTCAUSE_COUNT];  // Cycles from the entry to the return to USER mode
+    uint64_t    haltlatency[HALTCAUSE_COUNT][HALTLATENCY_BUCKETS];  // Entry-to-RTI cycles histogram
+};
+
 
 class CProcessor  // KM1801VM1 processor
 {
 public:  // Constructor / initialization
     CProcessor(CMotherboard* pBoard);
-    void        FireHALT() { m_HALTrq = true; }  // Fire HALT interrupt request
+    ~CProcessor();
+    void        FireHALT() { m_intrq |= INTRQ_HALT; }  // Fire HALT interrupt request
     void        MemoryError();
     int         GetInternalTick() const { return m_internalTick; }
     void        ClearInternalTick() { m_internalTick = 0; }
+    uint64_t    GetInstructionCount() const { return m_instructionCount; }  // Instructions executed, for statistics
+    void        ClearInstructionCount() { m_instructionCount = 0; }
+    uint64_t    GetCycleCount() const { return m_cycleCount; }  // Processor clock, ticks passed before the current one
+    void        BreakExecution() { m_okBreak = true; }  // Make ExecuteUntil() return right after the current instruction
+    // Make ExecuteUntil() stop at the breakpoints, nullptr = no breakpoints
+    void        SetBreakpoints(CBreakpointList* pBreakpoints);
+    bool        IsBreakpointHit() const { return m_okBreakpointHit; }  // ExecuteUntil() stopped at a breakpoint
+    uint64_t    GetIdleCycleCount() const { return m_idleCycleCount; }  // Ticks skipped in idle loops, for statistics
+    const ProcessorCounters& GetCounters() const { return m_Counters; }
+    void        ResetCounters() { ::memset(&m_Counters, 0, sizeof(m_Counters)); }
+    void        BreakIdleLoop() { m_okLoopClean = false; m_okBlockEnd = true; }  // Device state changed, see CheckIdleLoop(), ExecuteBlock()
+    // Count every instruction in the profiler, nullptr to stop; idle loops are not skipped while profiling
+    void        SetProfiler(CProfiler* pProfiler) { m_pProfiler = pProfiler; }
+    CProfiler*  GetProfiler() const { return m_pProfiler; }
+
+public:  // Decoded instruction cache
+    struct DecodedInstruction  // Cache entry, one per word of RAM/ROM, see CMotherboard::GetDecodeIndex()
+    {
+        uint16_t    instruction;     // Instruction code
+        uint8_t     opcodeclass;     // Command implementation, see OpcodeClassTable
+        uint8_t     regsrc;
+        uint8_t     methsrc;
+        uint8_t     regdest;
+        uint8_t     methdest;
+        bool        decoded;         // false = not decoded yet
+        uint16_t    blockgen;        // RAM word is in a translated block if equals to m_blockGeneration
+    };
+    void        InvalidateDecoded(int index)  // Memory word changed
+    {
+        m_pDecoded[index].decoded = false;
+        m_okLoopClean = false;
+        if (m_pDecoded[index].blockgen == m_blockGeneration)
+            InvalidateBlocks();
+    }
+    void        InvalidateDecodedAll();
+protected:
+    void        InvalidateBlocks();  // Drop all the RAM blocks
+    void        ClearBlocks();  // Drop all the blocks, RAM and ROM ones
+    void        DecodeInstruction(DecodedInstruction* pDecoded, uint16_t pc);
 
-public:
-    static void Init();  // Initialize static tables
-    static void Done();  // Release memory used for static tables
 protected:  // Statics
     typedef void ( CProcessor::*ExecuteMethodRef )();
-    static ExecuteMethodRef* m_pExecuteMethodMap;
-    static void RegisterMethodRef(uint16_t start, uint16_t end, CProcessor::ExecuteMethodRef methodref);
+    static const ExecuteMethodRef m_OpcodeMethodMap[];  // Command implementation by opcode class, nullptr for double operand commands
+    static const ExecuteMethodRef m_ModeMethodMap[12][64];  // Double operand commands, index is [command][(methsrc << 3) | methdest]
 
-protected:  // Processor state
-    int         m_internalTick;     // How many ticks waiting to the end of current instruction
-    uint16_t    m_psw;              // Processor Status Word (PSW)
+protected:  // Translated blocks: straight-line runs of decoded instructions, see ExecuteBlock()
+    struct BlockInstruction
+    {
+        ExecuteMethodRef method;     // Command implementation
+        uint16_t    instruction;     // Instruction code
+        uint8_t     opcodeclass;
+        uint8_t     regsrc;
+        uint8_t     methsrc;
+        uint8_t     regdest;
+        uint8_t     methdest;
+        uint8_t     length;          // Instruction length in bytes, with the operand words
+    };
+    struct DecodedBlock
+    {
+        int         index;           // Decode index of the first instruction, -1 = empty slot
+        uint16_t    generation;      // m_blockGeneration for RAM block, 0 for ROM block
+        int         count;           // Number of instructions
+        BlockInstruction instructions[BLOCK_MAXLENGTH];
+    };
+
+protected:  // Processor state used on every instruction, kept together in one 64-byte cache line
     uint16_t    m_R[8];             // Registers (R0..R5, R6=SP, R7=PC)
+    uint16_t    m_psw;              // Processor Status Word (PSW), except the m_ccLazy bits
+    uint8_t     m_ccLazy;           // PSW_N/Z/V/C bits to calculate from the last result
+    uint8_t     m_ccOp;             // CCOP_Xxx, operation of the last result
+    uint16_t    m_ccResult;         // Last result, byte results are sign-extended
+    uint16_t    m_ccA;              // Last operation operands
+    uint16_t    m_ccB;
+    uint16_t    m_intrq;            // Pending interrupt requests, INTRQ_Xxx bits
+    int         m_internalTick;     // How many ticks waiting to the end of current instruction
+    bool        m_RPLYrq;           // Hangup interrupt pending, breaks the current instruction
     bool        m_okStopped;        // "Processor stopped" flag
     bool        m_stepmode;         // Read true if it's step mode
     bool        m_waitmode;         // WAIT
-    uint16_t    m_eisregs[3];       // EIS chip registers
+    uint64_t    m_cycleCount;       // Processor clock, number of ticks, not saved to image
+    DecodedInstruction* m_pDecoded; // Decoded instruction cache, DECODEINDEX_COUNT entries
+    CMotherboard* m_pBoard;
+
+protected:  // Translated block cache state
+    DecodedBlock* m_pBlocks;         // Translated block cache, BLOCKCACHE_COUNT entries
+    uint16_t    m_blockGeneration;   // Current generation of RAM blocks, incremented on a write into a block
+    bool        m_okBlockEnd;        // Device state changed, ExecuteBlock() should stop after the current instruction
 
 protected:  // Current instruction processing
     uint16_t    m_instruction;      // Current instruction
     uint16_t    m_instructionpc;    // Address of the current instruction
+    uint8_t     m_opcodeclass;      // Current instruction implementation, see OpcodeClassTable
     uint8_t     m_regsrc;           // Source register number
     uint8_t     m_methsrc;          // Source address mode
     uint16_t    m_addrsrc;          // Source address
@@ -56,30 +175,39 @@ protected:  // Current instruction processing
     uint8_t     m_methdest;         // Destination address mode
     uint16_t    m_addrdest;         // Destination address
 
-protected:  // Interrupt processing
-    bool        m_RPLYrq;           // Hangup interrupt pending
-    bool        m_RSVDrq;           // Reserved instruction interrupt pending
-    bool        m_TBITrq;           // T-bit interrupt pending
-    bool        m_HALTrq;           // HALT signal
-    bool        m_HALTCMDrq;        // HALT command
-    bool        m_RPL2rq;           // Double hangup interrupt pending
-    bool        m_EVNTrq;           // Timer event interrupt pending
-    bool        m_BPT_rq;           // BPT command interrupt pending
-    bool        m_IOT_rq;           // IOT command interrupt pending
-    bool        m_EMT_rq;           // EMT command interrupt pending
-    bool        m_TRAPrq;           // TRAP command interrupt pending
-    int         m_virqrq;           // VIRQ pending
+protected:  // Processor state used rarely
+    uint16_t    m_eisregs[3];       // EIS chip registers
+    uint16_t    m_virqrq;           // VIRQ pending, one bit per non-zero m_virq entry
     uint16_t    m_virq[16];         // VIRQ vector
+    uint64_t    m_instructionCount; // Number of instructions executed, not saved to image
+    bool        m_okBreak;          // ExecuteUntil() should return after the current instruction
+    CBreakpointList* m_pBreakpoints;  // Checked at instruction boundaries in ExecuteUntil(), nullptr = off
+    uint32_t    m_breakpointsVersion;  // Breakpoint list version the blocks were built for
+    bool        m_okBreakpointHit;  // ExecuteUntil() stopped at a breakpoint
 
-protected:
-    CMotherboard* m_pBoard;
+protected:  // Idle loop detection, see CheckIdleLoop()
+    bool        m_okLoop;           // Loop start address is known
+    bool        m_okLoopClean;      // No memory writes and no device side effects since the loop state saved
+    uint16_t    m_loopPC;           // Loop start address, the backward branch target
+    uint16_t    m_loopR[8];         // Registers at the loop start
+    uint16_t    m_loopPSW;          // PSW at the loop start
+    uint16_t    m_loopEisRegs[3];   // EIS registers at the loop start
+    uint64_t    m_loopCycle;        // Cycle the loop iteration started
+    uint64_t    m_loopInstructionCount;  // Instruction count at the loop start
+    uint64_t    m_idleCycleCount;   // Ticks skipped in idle loops, not saved to image
+    CProfiler*  m_pProfiler;        // Instruction profiler, nullptr = off
+    ProcessorCounters m_Counters;   // Not saved to image
+    bool        m_okHaltEntered;    // HALT mode entered from USER mode, counting its cycles
+    uint16_t    m_haltCauses;       // The entry causes, HALTCAUSE_Xxx bits
+    uint64_t    m_haltEntryCycle;
 
 public:  // Register control
-    uint16_t    GetPSW() const { return m_psw; }
-    uint8_t     GetLPSW() const { return LOBYTE(m_psw); }
-    void        SetPSW(uint16_t word) { m_psw = word; }
+    uint16_t    GetPSW() const { return m_ccLazy ? (m_psw & ~m_ccLazy) | (CalcLazyFlags() & m_ccLazy) : m_psw; }
+    uint8_t     GetLPSW() const { return LOBYTE(GetPSW()); }
+    void        SetPSW(uint16_t word) { m_ccLazy = 0; m_psw = word; }
     void        SetLPSW(uint8_t byte)
     {
+        m_ccLazy = 0;
         m_psw = (m_psw & 0xFF00) | static_cast<uint16_t>(byte);
     }
     uint16_t    GetReg(int regno) const { return m_R[regno]; }
@@ -94,41 +222,59 @@ public:  // Register control
 
 public:  // PSW bits control
     void        SetC(bool bFlag);
-    uint16_t    GetC() const { return (m_psw & PSW_C) != 0; }
+    uint16_t    GetC() const { return (((m_ccLazy & PSW_C) ? CalcLazyFlags() : m_psw) & PSW_C) != 0; }
     void        SetV(bool bFlag);
-    uint16_t    GetV() const { return (m_psw & PSW_V) != 0; }
+    uint16_t    GetV() const { return (((m_ccLazy & PSW_V) ? CalcLazyFlags() : m_psw) & PSW_V) != 0; }
     void        SetN(bool bFlag);
-    uint16_t    GetN() const { return (m_psw & PSW_N) != 0; }
+    uint16_t    GetN() const { return (m_ccLazy & PSW_N) ? (m_ccResult >> 15) : (m_psw & PSW_N) != 0; }
     void        SetZ(bool bFlag);
-    uint16_t    GetZ() const { return (m_psw & PSW_Z) != 0; }
+    uint16_t    GetZ() const { return (m_ccLazy & PSW_Z) ? (m_ccResult == 0) : (m_psw & PSW_Z) != 0; }
 
 public:  // Processor state
     // "Processor stopped" flag
     bool        IsStopped() const { return m_okStopped; }
     // HALT flag (true - HALT mode, false - USER mode)
     bool        IsHaltMode() const { return (m_psw & PSW_P) != 0; }
+    // WAIT flag (true - waiting for an interrupt)
+    bool        IsWaitMode() const { return m_waitmode; }
 public:  // Processor control
     void        Start();     // Start processor
     void        Stop();      // Stop processor
     void        TickEVNT();  // EVNT signal
     void        InterruptVIRQ(int que, uint16_t interrupt);  // External interrupt via VIRQ signal
-    void        Execute();   // Execute one instruction - for debugger only
+    void        Execute();   // Execute one tick - for debugger only
+    int         ExecuteUntil(uint64_t cycle);  // Execute ticks until the given cycle or BreakExecution(), returns ticks done
 
 public:  // Saving/loading emulator status (pImage addresses up to 32 bytes)
     void        SaveToImage(uint8_t* pImage);
     void        LoadFromImage(const uint8_t* pImage);
 
 protected:  // Implementation
-    void        FetchInstruction();      // Read next instruction
+    void        FetchInstruction();      // Read and decode next instruction
     void        TranslateInstruction();  // Execute the instruction
+    void        CheckIdleLoop(uint64_t cycle);  // Skip idle loop iterations up to the cycle
+    void        ProcessInterrupts();     // Take the pending interrupt requests at the instruction boundary
+    void        CountHaltExit();         // Called on return from HALT mode to USER mode
+    template<bool profiling, bool breakpoints>
+    int         ExecuteCycles(uint64_t cycle);  // ExecuteUntil() body
+    bool        CheckBreakpoint();  // Check the breakpoint at PC on instruction boundary; true = stop
+    template<bool profiling>
+    bool        ExecuteBlock(uint64_t cycle);  // Execute instructions of the translated block at PC
+    void        BuildBlock(DecodedBlock* pBlock, uint16_t pc, int index);
 protected:  // Implementation - memory access
     uint16_t    GetWordExec(uint16_t address) { return m_pBoard->GetWordExec(address, IsHaltMode()); }
     uint16_t    GetWord(uint16_t address) { return m_pBoard->GetWord(address, IsHaltMode()); }
-    void        SetWord(uint16_t address, uint16_t word) { m_pBoard->SetWord(address, IsHaltMode(), word); }
+    void        SetWord(uint16_t address, uint16_t word) { m_okLoopClean = false; m_pBoard->SetWord(address, IsHaltMode(), word); }
     uint8_t     GetByte(uint16_t address) { return m_pBoard->GetByte(address, IsHaltMode()); }
-    void        SetByte(uint16_t address, uint8_t byte) { m_pBoard->SetByte(address, IsHaltMode(), byte); }
+    void        SetByte(uint16_t address, uint8_t byte) { m_okLoopClean = false; m_pBoard->SetByte(address, IsHaltMode(), byte); }
 
 protected:  // PSW bits calculations
+    uint16_t    CalcLazyFlags() const;  // NZVC bits for the last result
+    void        SetLazyFlags(uint8_t flags, uint8_t op, uint16_t result, uint16_t a = 0, uint16_t b = 0);
+    void        SetLazyFlagsB(uint8_t flags, uint8_t op, uint8_t result, uint8_t a = 0, uint8_t b = 0)
+    {
+        SetLazyFlags(flags, op, static_cast<uint16_t>(static_cast<int8_t>(result)), a, b);
+    }
     bool static CheckForNegative(uint8_t byte) { return (byte & 0200) != 0; }
     bool static CheckForNegative(uint16_t word) { return (word & 0100000) != 0; }
     bool static CheckForZero(uint8_t byte) { return byte == 0; }
@@ -179,19 +325,19 @@ protected:  // Implementation - instruction execution
     void        ExecuteSWAB ();     //  0002
     void        ExecuteMTPS ();     //  0002
     void        ExecuteMFPS ();     //  0002
-    // Двухадресные команды
-    void        ExecuteMOV ();      //  0001
-    void        ExecuteMOVB();      //  0001
-    void        ExecuteCMP ();      //  0001
-    void        ExecuteCMPB();      //  0001
-    void        ExecuteADD ();      //  0001
-    void        ExecuteSUB ();      //  0001
-    void        ExecuteBIT ();      //  0001
-    void        ExecuteBITB();      //  0001
-    void        ExecuteBIC ();      //  0001
-    void        ExecuteBICB();      //  0001
-    void        ExecuteBIS ();      //  0001
-    void        ExecuteBISB();      //  0001
+    // Двухадресные команды, специализированные по методам адресации источника и приёмника
+    template<int METHSRC, int METHDEST> void ExecuteMOV ();   //  0001
+    template<int METHSRC, int METHDEST> void ExecuteMOVB();   //  0001
+    template<int METHSRC, int METHDEST> void ExecuteCMP ();   //  0001
+    template<int METHSRC, int METHDEST> void ExecuteCMPB();   //  0001
+    template<int METHSRC, int METHDEST> void ExecuteADD ();   //  0001
+    template<int METHSRC, int METHDEST> void ExecuteSUB ();   //  0001
+    template<int METHSRC, int METHDEST> void ExecuteBIT ();   //  0001
+    template<int METHSRC, int METHDEST> void ExecuteBITB();   //  0001
+    template<int METHSRC, int METHDEST> void ExecuteBIC ();   //  0001
+    template<int METHSRC, int METHDEST> void ExecuteBICB();   //  0001
+    template<int METHSRC, int METHDEST> void ExecuteBIS ();   //  0001
+    template<int METHSRC, int METHDEST> void ExecuteBISB();   //  0001
     void        ExecuteXOR ();      //  0002
     // Команды управления программой
     void        ExecuteBR ();       //  0002
@@ -240,21 +386,72 @@ protected:  // Implementation - instruction execution
 // PSW bits control - implementation
 inline void CProcessor::SetC (bool bFlag)
 {
+    m_ccLazy &= ~PSW_C;
     if (bFlag) m_psw |= PSW_C; else m_psw &= ~PSW_C;
 }
 inline void CProcessor::SetV (bool bFlag)
 {
+    m_ccLazy &= ~PSW_V;
     if (bFlag) m_psw |= PSW_V; else m_psw &= ~PSW_V;
 }
 inline void CProcessor::SetN (bool bFlag)
 {
+    m_ccLazy &= ~PSW_N;
     if (bFlag) m_psw |= PSW_N; else m_psw &= ~PSW_N;
 }
 inline void CProcessor::SetZ (bool bFlag)
 {
+    m_ccLazy &= ~PSW_Z;
     if (bFlag) m_psw |= PSW_Z; else m_psw &= ~PSW_Z;
 }
 
+// Lazy condition codes - implementation
+inline uint16_t CProcessor::CalcLazyFlags() const
+{
+    uint16_t flags = 0;
+    if (m_ccResult & 0100000) flags |= PSW_N;
+    if (m_ccResult == 0) flags |= PSW_Z;
+    switch (m_ccOp)
+    {
+    case CCOP_ADD:
+        if (CheckAddForOverflow(m_ccA, m_ccB)) flags |= PSW_V;
+        if (CheckAddForCarry(m_ccA, m_ccB)) flags |= PSW_C;
+        break;
+    case CCOP_SUB:
+        if (CheckSubForOverflow(m_ccA, m_ccB)) flags |= PSW_V;
+        if (CheckSubForCarry(m_ccA, m_ccB)) flags |= PSW_C;
+        break;
+    case CCOP_SUBB:
+        if (CheckSubForOverflow(static_cast<uint8_t>(m_ccA), static_cast<uint8_t>(m_ccB))) flags |= PSW_V;
+        if (CheckSubForCarry(static_cast<uint8_t>(m_ccA), static_cast<uint8_t>(m_ccB))) flags |= PSW_C;
+        break;
+    case CCOP_INC:
+        if (m_ccResult == 0100000) flags |= PSW_V;
+        break;
+    case CCOP_INCB:
+        if (m_ccResult == 0177600) flags |= PSW_V;  // 0200 sign-extended
+        break;
+    case CCOP_DEC:
+        if (m_ccResult == 077777) flags |= PSW_V;
+        break;
+    case CCOP_DECB:
+        if (m_ccResult == 0177) flags |= PSW_V;
+        break;
+    }
+    return flags;
+}
+// Remember the result instead of setting the flags; flags not covered by the new operation are calculated now
+inline void CProcessor::SetLazyFlags(uint8_t flags, uint8_t op, uint16_t result, uint16_t a, uint16_t b)
+{
+    if (m_ccLazy & ~flags)
+        m_psw = (m_psw & ~m_ccLazy) | (CalcLazyFlags() & m_ccLazy);
+    m_ccLazy = flags;
+    m_ccOp = op;
+    m_ccResult = result;
+    m_ccA = a;
+    m_ccB = b;
+}
+
 // PSW bits calculations - implementation
 inline bool CProcessor::CheckAddForOverflow (uint8_t a, uint8_t b)
 {
@@ -0,0 +1,521 @@
+﻿/*  This file is part of NEMIGABTL.
+    NEMIGABTL is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software Foundation,
+either version 3 of the License, or (at your option) any later version.
+    NEMIGABTL is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU Lesser General Public License for more details.
+    You should have received a copy of the GNU Lesser General Public License along with
+NEMIGABTL. If not, see <http://www.gnu.org/licenses/>. */
+
+// Profiler.cpp
+//
+
+#include "stdafx.h"
+#include "Emubase.h"
+
+
+//////////////////////////////////////////////////////////////////////
+
+
+CSymbolTable::CSymbolTable()
+{
+    m_pSymbols = nullptr;
+    m_nCount = 0;
+}
+
+CSymbolTable::~CSymbolTable()
+{
+    Clear();
+}
+
+void CSymbolTable::Clear()
+{
+    ::free(m_pSymbols);  m_pSymbols = nullptr;
+    m_nCount = 0;
+}
+
+// Insert keeping the order by address; the first symbol for the address wins
+void CSymbolTable::Add(uint16_t address, const char* name, size_t length)
+{
+    int pos = 0;
+    while (pos < m_nCount && m_pSymbols[pos].address < address)
+        pos++;
+    if (pos < m_nCount && m_pSymbols[pos].address == address)
+        return;
+
+    if ((m_nCount & 63) == 0)
+        m_pSymbols = static_cast<Symbol*>(::realloc(m_pSymbols, (m_nCount + 64) * sizeof(Symbol)));
+    ::memmove(m_pSymbols + pos + 1, m_pSymbols + pos, (m_nCount - pos) * sizeof(Symbol));
+    m_nCount++;
+
+    Symbol* pSymbol = m_pSymbols + pos;
+    pSymbol->address = address;
+    if (length > SYMBOL_MAXLENGTH)
+        length = SYMBOL_MAXLENGTH;
+    ::memcpy(pSymbol->name, name, length);
+    pSymbol->name[length] = 0;
+}
+
+static bool IsSymbolChar(char ch)
+{
+    return (ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z') || (ch >= '0' && ch <= '9') || ch == '.' || ch == '$' || ch == '_';
+}
+
+// Listing lines, see DisasmView_ParseSubtitles():
+//   "160210: CMP ...  ; comment"  - address line
+//   "HMON::  ; comment"            - label for the next address line
+//   "; .RESET - comment"           - block comment, its first word names the next address line
+bool CSymbolTable::LoadListing(LPCTSTR sFileName)
+{
+    FILE* fpFile = ::_tfopen(sFileName, _T("rb"));
+    if (fpFile == nullptr)
+        return false;
+    ::fseek(fpFile, 0, SEEK_END);
+    long size = ::ftell(fpFile);
+    ::fseek(fpFile, 0, SEEK_SET);
+    if (size <= 0 || size > 1024 * 1024)
+    {
+        ::fclose(fpFile);
+        return false;
+    }
+    char* pText = static_cast<char*>(::calloc(size + 2, 1));
+    size_t bytesRead = ::fread(pText, 1, size, fpFile);
+    ::fclose(fpFile);
+
+    // UTF-16 LE text, the DisasmView subtitles format: keep the low bytes, the symbols are ASCII anyway
+    if (bytesRead >= 2 && static_cast<uint8_t>(pText[0]) == 0xFF && static_cast<uint8_t>(pText[1]) == 0xFE)
+    {
+        size_t length = 0;
+        for (size_t i = 2; i + 1 < bytesRead; i += 2)
+            pText[length++] = (pText[i + 1] == 0) ? pText[i] : '?';
+        pText[length] = 0;
+    }
+
+    const char* pLabel = nullptr;  size_t labelLength = 0;
+    const char* pComment = nullptr;  size_t commentLength = 0;
+    const char* p = pText;
+    while (*p != 0)
+    {
+        const char* pLine = p;
+        while (*p != 0 && *p != '\n' && *p != '\r') p++;
+        const char* pLineEnd = p;
+        while (*p == '\n' || *p == '\r') p++;
+
+        if (*pLine >= '0' && *pLine <= '7')  // Address line
+        {
+            uint16_t address = 0;
+            const char* pChar = pLine;
+            for (; pChar < pLineEnd && *pChar >= '0' && *pChar <= '7' && pChar - pLine < 6; pChar++)
+                address = static_cast<uint16_t>((address << 3) | (*pChar - '0'));
+            if (pLabel != nullptr)
+                Add(address, pLabel, labelLength);
+            if (pComment != nullptr)
+                Add(address, pComment, commentLength);
+            pLabel = pComment = nullptr;
+        }
+        else if (*pLine == ';')  // Comment line
+        {
+            const char* pChar = pLine + 1;
+            while (pChar < pLineEnd && (*pChar == ' ' || *pChar == '\t')) pChar++;
+            const char* pName = pChar;
+            while (pChar < pLineEnd && IsSymbolChar(*pChar)) pChar++;
+            size_t length = pChar - pName;
+            while (pChar < pLineEnd && (*pChar == ' ' || *pChar == '\t')) pChar++;
+            bool okName = length > 0 && !(*pName >= '0' && *pName <= '9') && pChar < pLineEnd && (*pChar == '-' || *pChar == ':');
+            pComment = okName ? pName : nullptr;
+            commentLength = length;
+        }
+        else if (IsSymbolChar(*pLine))  // Label line
+        {
+            const char* pChar = pLine;
+            while (pChar < pLineEnd && IsSymbolChar(*pChar)) pChar++;
+            if (pChar < pLineEnd && *pChar == ':')
+            {
+                pLabel = pLine;
+                labelLength = pChar - pLine;
+            }
+        }
+    }
+
+    ::free(pText);
+    return true;
+}
+
+int CSymbolTable::FindIndex(uint16_t address) const
+{
+    // Binary search for the last symbol at or before the address
+    int lo = 0, hi = m_nCount - 1, found = -1;
+    while (lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (m_pSymbols[mid].address <= address)
+        {
+            found = mid;
+            lo = mid + 1;
+        }
+        else
+            hi = mid - 1;
+    }
+    if (found < 0 || ((m_pSymbols[found].address ^ address) & 0170000) != 0)
+        return -1;
+    return found;
+}
+
+const char* CSymbolTable::Find(uint16_t address, uint16_t* pOffset) const
+{
+    int index = FindIndex(address);
+    if (index < 0)
+        return nullptr;
+    *pOffset = address - m_pSymbols[index].address;
+    return m_pSymbols[index].name;
+}
+
+void CSymbolTable::FormatAddress(uint16_t address, char* buffer, size_t size) const
+{
+    uint16_t offset;
+    const char* name = Find(address, &offset);
+    if (name == nullptr)
+        snprintf(buffer, size, "%06o", address);
+    else if (offset == 0)
+        snprintf(buffer, size, "%s", name);
+    else
+        snprintf(buffer, size, "%s+%o", name, offset);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+
+
+CProfiler::CProfiler()
+{
+    m_pEntries = static_cast<ProfileEntry*>(::calloc(2 * 0100000, sizeof(ProfileEntry)));
+    m_pNodes = static_cast<CallNode*>(::calloc(CALLGRAPH_MAXNODES, sizeof(CallNode)));
+    Clear();
+}
+
+CProfiler::~CProfiler()
+{
+    ::free(m_pEntries);
+    ::free(m_pNodes);
+}
+
+void CProfiler::Clear()
+{
+    ::memset(m_pEntries, 0, 2 * 0100000 * sizeof(ProfileEntry));
+
+    ::memset(m_pNodes, 0, sizeof(CallNode));
+    m_pNodes[0].vector = CALLGRAPH_NOVECTOR;
+    m_nNodeCount = 1;
+    m_nCurrentNode = 0;
+    m_nDepth = 0;
+}
+
+void CProfiler::Unwind(uint32_t sp)
+{
+    while (m_nDepth > 0 && m_Frames[m_nDepth - 1].sp < sp)
+        m_nDepth--;
+    m_nCurrentNode = (m_nDepth > 0) ? m_Frames[m_nDepth - 1].node : 0;
+}
+
+void CProfiler::Call(uint16_t address, uint16_t sp, bool okHaltMode, uint16_t vector)
+{
+    // The frames at or below the new frame were left without return, like when SP is set anew
+    Unwind(static_cast<uint32_t>(sp) + 1);
+    if (m_nDepth == CALLGRAPH_MAXDEPTH)
+        return;
+
+    // Find the callee node, add it when the path is new
+    uint32_t parent = m_nCurrentNode;
+    uint32_t node = m_pNodes[parent].child;
+    while (node != 0 && (m_pNodes[node].address != address || m_pNodes[node].vector != vector ||
+            m_pNodes[node].okHaltMode != okHaltMode))
+        node = m_pNodes[node].sibling;
+    if (node == 0 && m_nNodeCount < CALLGRAPH_MAXNODES)
+    {
+        node = m_nNodeCount++;
+        CallNode& newNode = m_pNodes[node];
+        newNode.parent = parent;
+        newNode.child = 0;
+        newNode.sibling = m_pNodes[parent].child;
+        newNode.address = address;
+        newNode.vector = vector;
+        newNode.okHaltMode = okHaltMode;
+        newNode.calls = newNode.cycles = 0;
+        m_pNodes[parent].child = node;
+    }
+    if (node == 0)  // No room for the node, stay in the caller
+        node = parent;
+    else
+        m_pNodes[node].calls++;
+
+    m_Frames[m_nDepth].sp = sp;
+    m_Frames[m_nDepth].node = node;
+    m_nDepth++;
+    m_nCurrentNode = node;
+}
+
+uint64_t CProfiler::GetCount(uint16_t address, bool okHaltMode) const
+{
+    return m_pEntries[(okHaltMode ? 0100000 : 0) | (address >> 1)].count;
+}
+
+uint64_t CProfiler::GetCycles(uint16_t address, bool okHaltMode) const
+{
+    return m_pEntries[(okHaltMode ? 0100000 : 0) | (address >> 1)].cycles;
+}
+
+struct ProfileReportLine
+{
+    int         index;      // Entry index, or symbol index * 2 + mode
+    uint64_t    count;
+    uint64_t    cycles;
+};
+
+static int CompareReportLines(const void* a, const void* b)
+{
+    const ProfileReportLine* pA = static_cast<const ProfileReportLine*>(a);
+    const ProfileReportLine* pB = static_cast<const ProfileReportLine*>(b);
+    if (pA->cycles != pB->cycles)
+        return (pA->cycles > pB->cycles) ? -1 : 1;
+    return pA->index - pB->index;
+}
+
+bool CProfiler::SaveReport(LPCTSTR sFileName, const CSymbolTable* pSymbols, int maxLines) const
+{
+    FILE* fpFile = ::_tfopen(sFileName, _T("wt"));
+    if (fpFile == nullptr)
+        return false;
+
+    // Addresses with any executions, and the totals
+    ProfileReportLine* pLines = static_cast<ProfileReportLine*>(::malloc(2 * 0100000 * sizeof(ProfileReportLine)));
+    int lineCount = 0;
+    uint64_t totalCount = 0, totalCycles = 0;
+    for (int index = 0; index < 2 * 0100000; index++)
+    {
+        const ProfileEntry& entry = m_pEntries[index];
+        if (entry.count == 0)
+            continue;
+        pLines[lineCount].index = index;
+        pLines[lineCount].count = entry.count;
+        pLines[lineCount].cycles = entry.cycles;
+        lineCount++;
+        totalCount += entry.count;
+        totalCycles += entry.cycles;
+    }
+    double percent = (totalCycles > 0) ? 100.0 / totalCycles : 0.0;
+
+    fprintf(fpFile, "; Profile: %llu instructions, %llu cycles, %d addresses\n",
+            static_cast<unsigned long long>(totalCount), static_cast<unsigned long long>(totalCycles), lineCount);
+    fprintf(fpFile, ";\n; Hot spots by address\n");
+    fprintf(fpFile, ";      Cycles       %%       Count  Mode  Address  Symbol\n");
+    ::qsort(pLines, lineCount, sizeof(ProfileReportLine), CompareReportLines);
+    char buffer[32];
+    for (int i = 0; i < lineCount && i < maxLines; i++)
+    {
+        const ProfileReportLine& line = pLines[i];
+        uint16_t address = static_cast<uint16_t>((line.index & 077777) << 1);
+        buffer[0] = 0;
+        if (pSymbols != nullptr)
+        {
+            uint16_t offset;
+            const char* name = pSymbols->Find(address, &offset);
+            if (name != nullptr)
+                snprintf(buffer, sizeof(buffer), offset == 0 ? "%s" : "%s+%o", name, offset);
+        }
+        fprintf(fpFile, "%13llu  %6.2f%%  %10llu  %s  %06o   %s\n",
+                static_cast<unsigned long long>(line.cycles), line.cycles * percent,
+                static_cast<unsigned long long>(line.count), (line.index & 0100000) ? "HALT" : "USER", address, buffer);
+    }
+
+    // The same, summed up by symbol
+    int symbolCount = (pSymbols != nullptr) ? pSymbols->GetCount() : 0;
+    if (symbolCount > 0)
+    {
+        ProfileReportLine* pSymbolLines = static_cast<ProfileReportLine*>(::calloc(symbolCount * 2, sizeof(ProfileReportLine)));
+        for (int i = 0; i < symbolCount * 2; i++)
+            pSymbolLines[i].index = i;
+        uint64_t symbolCycles = 0;
+        for (int i = 0; i < lineCount; i++)
+        {
+            const ProfileReportLine& line = pLines[i];
+            int symbol = pSymbols->FindIndex(static_cast<uint16_t>((line.index & 077777) << 1));
+            if (symbol < 0)
+                continue;
+            ProfileReportLine& symbolLine = pSymbolLines[symbol * 2 + ((line.index & 0100000) ? 1 : 0)];
+            symbolLine.count += line.count;
+            symbolLine.cycles += line.cycles;
+            symbolCycles += line.cycles;
+        }
+        ::qsort(pSymbolLines, symbolCount * 2, sizeof(ProfileReportLine), CompareReportLines);
+
+        fprintf(fpFile, ";\n; Hot spots by symbol, %.2f%% of cycles are in the symbols\n", symbolCycles * percent);
+        fprintf(fpFile, ";      Cycles       %%       Count  Mode  Address  Symbol\n");
+        for (int i = 0; i < symbolCount * 2 && i < maxLines && pSymbolLines[i].cycles > 0; i++)
+        {
+            const ProfileReportLine& line = pSymbolLines[i];
+            int symbol = line.index / 2;
+            fprintf(fpFile, "%13llu  %6.2f%%  %10llu  %s  %06o   %s\n",
+                    static_cast<unsigned long long>(line.cycles), line.cycles * percent,
+                    static_cast<unsigned long long>(line.count), (line.index & 1) ? "HALT" : "USER",
+                    pSymbols->GetAddress(symbol), pSymbols->GetName(symbol));
+        }
+        ::free(pSymbolLines);
+    }
+
+    ::free(pLines);
+
+    WriteCallReport(fpFile, pSymbols, maxLines, percent);
+
+    ::fclose(fpFile);
+    return true;
+}
+
+// Routine name, with the interrupt vector for the interrupt handlers
+void CProfiler::FormatNode(uint32_t node, const CSymbolTable* pSymbols, char* buffer, size_t size) const
+{
+    const CallNode& callNode = m_pNodes[node];
+    if (node == 0)
+        snprintf(buffer, size, "[top]");
+    else if (pSymbols != nullptr)
+        pSymbols->FormatAddress(callNode.address, buffer, size);
+    else
+        snprintf(buffer, size, "%06o", callNode.address);
+    if (callNode.vector != CALLGRAPH_NOVECTOR)
+    {
+        size_t length = strlen(buffer);
+        snprintf(buffer + length, size - length, "[int %o]", callNode.vector);
+    }
+}
+
+struct CallReportLine
+{
+    uint64_t    key;        // Routine: vector, address and mode
+    uint32_t    node;
+    uint64_t    calls;
+    uint64_t    inclusive;
+    uint64_t    exclusive;
+};
+
+static int CompareCallReportKeys(const void* a, const void* b)
+{
+    const CallReportLine* pA = static_cast<const CallReportLine*>(a);
+    const CallReportLine* pB = static_cast<const CallReportLine*>(b);
+    if (pA->key != pB->key)
+        return (pA->key < pB->key) ? -1 : 1;
+    return (pA->node < pB->node) ? -1 : 1;
+}
+
+static int CompareCallReportLines(const void* a, const void* b)
+{
+    const CallReportLine* pA = static_cast<const CallReportLine*>(a);
+    const CallReportLine* pB = static_cast<const CallReportLine*>(b);
+    if (pA->inclusive != pB->inclusive)
+        return (pA->inclusive > pB->inclusive) ? -1 : 1;
+    return (pA->key < pB->key) ? -1 : 1;
+}
+
+// The call tree summed up by routine; recursive calls are counted in the inclusive cycles once
+void CProfiler::WriteCallReport(FILE* fpFile, const CSymbolTable* pSymbols, int maxLines, double percent) const
+{
+    uint32_t nodeCount = m_nNodeCount;
+    if (nodeCount <= 1)
+        return;
+
+    // Node inclusive cycles; a callee node always comes after its caller
+    uint64_t* pTotals = static_cast<uint64_t*>(::malloc(nodeCount * sizeof(uint64_t)));
+    for (uint32_t node = 0; node < nodeCount; node++)
+        pTotals[node] = m_pNodes[node].cycles;
+    for (uint32_t node = nodeCount - 1; node > 0; node--)
+        pTotals[m_pNodes[node].parent] += pTotals[node];
+
+    // Group the nodes by routine
+    CallReportLine* pLines = static_cast<CallReportLine*>(::malloc(nodeCount * sizeof(CallReportLine)));
+    for (uint32_t node = 0; node < nodeCount; node++)
+    {
+        const CallNode& callNode = m_pNodes[node];
+        CallReportLine& line = pLines[node];
+        line.key = (node == 0) ? 0 :
+                (static_cast<uint64_t>(callNode.vector) << 17) | (callNode.address << 1) | (callNode.okHaltMode ? 1 : 0);
+        line.node = node;
+        line.calls = callNode.calls;
+        line.exclusive = callNode.cycles;
+        line.inclusive = pTotals[node];
+        // The routine called recursively: the outer call has these cycles already
+        for (uint32_t parent = (node != 0) ? callNode.parent : 0; parent != 0; parent = m_pNodes[parent].parent)
+        {
+            const CallNode& parentNode = m_pNodes[parent];
+            if (parentNode.address == callNode.address && parentNode.vector == callNode.vector &&
+                parentNode.okHaltMode == callNode.okHaltMode)
+            {
+                line.inclusive = 0;
+                break;
+            }
+        }
+    }
+    ::qsort(pLines, nodeCount, sizeof(CallReportLine), CompareCallReportKeys);
+    uint32_t lineCount = 0;
+    for (uint32_t i = 0; i < nodeCount; i++)
+    {
+        if (lineCount > 0 && pLines[lineCount - 1].key == pLines[i].key)
+        {
+            CallReportLine& line = pLines[lineCount - 1];
+            line.calls += pLines[i].calls;
+            line.inclusive += pLines[i].inclusive;
+            line.exclusive += pLines[i].exclusive;
+        }
+        else
+            pLines[lineCount++] = pLines[i];
+    }
+    ::qsort(pLines, lineCount, sizeof(CallReportLine), CompareCallReportLines);
+
+    fprintf(fpFile, ";\n; Routines by inclusive cycles, %u call tree nodes\n", nodeCount);
+    fprintf(fpFile, ";   Inclusive       %%   Exclusive       Calls  Mode  Address  Routine\n");
+    char buffer[48];
+    for (uint32_t i = 0; i < lineCount && i < static_cast<uint32_t>(maxLines); i++)
+    {
+        const CallReportLine& line = pLines[i];
+        const CallNode& callNode = m_pNodes[line.node];
+        FormatNode(line.node, pSymbols, buffer, sizeof(buffer));
+        fprintf(fpFile, "%13llu  %6.2f%%  %10llu  %10llu  %s  %06o   %s\n",
+                static_cast<unsigned long long>(line.inclusive), line.inclusive * percent,
+                static_cast<unsigned long long>(line.exclusive), static_cast<unsigned long long>(line.calls),
+                (line.node == 0) ? "    " : callNode.okHaltMode ? "HALT" : "USER", callNode.address, buffer);
+    }
+
+    ::free(pLines);
+    ::free(pTotals);
+}
+
+bool CProfiler::SaveCollapsedStacks(LPCTSTR sFileName, const CSymbolTable* pSymbols) const
+{
+    FILE* fpFile = ::_tfopen(sFileName, _T("wt"));
+    if (fpFile == nullptr)
+        return false;
+
+    uint32_t path[CALLGRAPH_MAXDEPTH + 1];
+    char buffer[48];
+    for (uint32_t node = 0; node < m_nNodeCount; node++)
+    {
+        if (m_pNodes[node].cycles == 0)
+            continue;
+
+        int depth = 0;
+        for (uint32_t pathNode = node; pathNode != 0; pathNode = m_pNodes[pathNode].parent)
+            path[depth++] = pathNode;
+        path[depth++] = 0;
+
+        while (depth > 0)
+        {
+            FormatNode(path[--depth], pSymbols, buffer, sizeof(buffer));
+            fprintf(fpFile, (depth > 0) ? "%s;" : "%s", buffer);
+        }
+        fprintf(fpFile, " %llu\n", static_cast<unsigned long long>(m_pNodes[node].cycles));
+    }
+
+    ::fclose(fpFile);
+    return true;
+}
+
+
+//////////////////////////////////////////////////////////////////////
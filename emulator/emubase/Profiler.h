@@ -0,0 +1,128 @@
+﻿/*  This file is part of NEMIGABTL.
+    NEMIGABTL is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software Foundation,
+either version 3 of the License, or (at your option) any later version.
+    NEMIGABTL is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU Lesser General Public License for more details.
+    You should have received a copy of the GNU Lesser General Public License along with
+NEMIGABTL. If not, see <http://www.gnu.org/licenses/>. */
+
+// Profiler.h  CPU execution profiler, guest symbols
+//
+
+#pragma once
+
+#include "Defines.h"
+
+
+//////////////////////////////////////////////////////////////////////
+
+#define SYMBOL_MAXLENGTH    15  // Symbol name length limit
+
+// Call graph, see CProfiler::Call()
+#define CALLGRAPH_MAXDEPTH    256  // Shadow stack frames; deeper calls are counted in the caller
+#define CALLGRAPH_MAXNODES  65536  // Call tree nodes; new paths over the limit are counted in the caller
+#define CALLGRAPH_NOVECTOR 0177777 // Call node made by JSR, not by an interrupt
+
+// Guest symbols, taken from the disassembly listings like docs/nemiga-406.lst;
+// the same files are used as DisasmView subtitles
+class CSymbolTable
+{
+public:
+    CSymbolTable();
+    ~CSymbolTable();
+    // Add labels from the listing: "NAME:" line before the address line, or "; NAME - text" block comment
+    bool        LoadListing(LPCTSTR sFileName);
+    void        Clear();
+    int         GetCount() const { return m_nCount; }
+    // Find the nearest symbol at or before the address, in the same 4K page; nullptr if none
+    const char* Find(uint16_t address, uint16_t* pOffset) const;
+    int         FindIndex(uint16_t address) const;  // Index of the symbol found by Find(), -1 if none
+    uint16_t    GetAddress(int index) const { return m_pSymbols[index].address; }
+    const char* GetName(int index) const { return m_pSymbols[index].name; }
+    // Format "NAME+offset", or octal address when there is no symbol
+    void        FormatAddress(uint16_t address, char* buffer, size_t size) const;
+private:
+    struct Symbol
+    {
+        uint16_t    address;
+        char        name[SYMBOL_MAXLENGTH + 1];
+    };
+    Symbol*     m_pSymbols;  // Sorted by address, one symbol per address
+    int         m_nCount;
+private:
+    void        Add(uint16_t address, const char* name, size_t length);
+};
+
+
+// Counts instruction executions and cycles per instruction address, separately for HALT and USER mode;
+// see CProcessor::SetProfiler().
+// Also keeps the call tree: the shadow stack follows JSR, interrupts and returns, the instruction cycles
+// go to the current call tree node.
+class CProfiler
+{
+public:
+    CProfiler();
+    ~CProfiler();
+    void        Clear();
+    // Called by the processor after every instruction; cycles are the instruction timing
+    void        Count(uint16_t address, bool okHaltMode, int cycles)
+    {
+        ProfileEntry& entry = m_pEntries[(okHaltMode ? 0100000 : 0) | (address >> 1)];
+        entry.count++;
+        entry.cycles += cycles;
+        m_pNodes[m_nCurrentNode].cycles += cycles;
+    }
+    // Called by the processor on JSR and on interrupt entry: address is the new PC, sp is SP after the push
+    void        Call(uint16_t address, uint16_t sp, bool okHaltMode, uint16_t vector);
+    // Called by the processor on RTS, RTI, RTT and MARK: the frames below the new SP are left
+    void        Return(uint16_t sp)
+    {
+        if (m_nDepth > 0 && m_Frames[m_nDepth - 1].sp < sp)
+            Unwind(sp);
+    }
+    uint64_t    GetCount(uint16_t address, bool okHaltMode) const;
+    uint64_t    GetCycles(uint16_t address, bool okHaltMode) const;
+    // Write the hot spot report sorted by cycles: by address, by symbol, and by routine with the callees;
+    // pSymbols can be nullptr
+    bool        SaveReport(LPCTSTR sFileName, const CSymbolTable* pSymbols, int maxLines) const;
+    // Write the call tree as collapsed stacks, "caller;callee cycles" lines, the flame graph tools input
+    bool        SaveCollapsedStacks(LPCTSTR sFileName, const CSymbolTable* pSymbols) const;
+private:
+    struct ProfileEntry
+    {
+        uint64_t    count;
+        uint64_t    cycles;
+    };
+    ProfileEntry* m_pEntries;  // USER mode then HALT mode, 0100000 entries each, index is address / 2
+private:  // Call graph
+    struct CallNode
+    {
+        uint32_t    parent;
+        uint32_t    child;      // First callee, 0 = none
+        uint32_t    sibling;    // Next callee of the parent, 0 = none
+        uint16_t    address;    // Routine address
+        uint16_t    vector;     // Interrupt vector, CALLGRAPH_NOVECTOR for JSR
+        bool        okHaltMode; // Mode the routine runs in
+        uint64_t    calls;
+        uint64_t    cycles;     // Exclusive cycles
+    };
+    struct CallFrame
+    {
+        uint16_t    sp;         // SP after the call pushed the return address
+        uint32_t    node;
+    };
+    CallNode*   m_pNodes;       // Call tree, node 0 is the root: the code outside of any known call
+    uint32_t    m_nNodeCount;
+    uint32_t    m_nCurrentNode;
+    CallFrame   m_Frames[CALLGRAPH_MAXDEPTH];  // Shadow stack
+    int         m_nDepth;
+private:
+    void        Unwind(uint32_t sp);  // Leave the frames below the SP
+    void        FormatNode(uint32_t node, const CSymbolTable* pSymbols, char* buffer, size_t size) const;
+    void        WriteCallReport(FILE* fpFile, const CSymbolTable* pSymbols, int maxLines, double percent) const;
+};
+
+
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,153 @@
+﻿/*  This file is part of NEMIGABTL.
+    NEMIGABTL is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software Foundation,
+either version 3 of the License, or (at your option) any later version.
+    NEMIGABTL is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU Lesser General Public License for more details.
+    You should have received a copy of the GNU Lesser General Public License along with
+NEMIGABTL. If not, see <http://www.gnu.org/licenses/>. */
+
+// Screen.cpp  Screen image rendering, see Emulator_PrepareScreenXxx() in Emubase.h
+//
+
+#include "stdafx.h"
+#include "Emubase.h"
+
+
+//////////////////////////////////////////////////////////////////////
+
+#define AVERAGERGB(a, b)  ( (((a) & 0xfefefeffUL) + ((b) & 0xfefefeffUL)) >> 1 )
+
+void CALLBACK Emulator_PrepareScreenBW512x256(const uint8_t* pVideoBuffer, const uint32_t* palette, void* pImageBits)
+{
+    for (int y = 0; y < 256; y++)
+    {
+        const uint16_t* pVideo = (uint16_t*)(pVideoBuffer + y * 512 / 4);
+        uint32_t* pBits = static_cast<uint32_t*>(pImageBits) + (256 - 1 - y) * 512;
+        for (int x = 0; x < 512 / 8; x++)
+        {
+            uint16_t src = *pVideo;
+
+            for (int bit = 0; bit < 8; bit++)
+            {
+                int colorindex = (src & 0x80) >> 7 | (src & 0x8000) >> 14;
+                uint32_t color = palette[colorindex];
+                *pBits = color;
+                pBits++;
+                src = src << 1;
+            }
+
+            pVideo++;
+        }
+    }
+}
+
+void CALLBACK Emulator_PrepareScreenBW512x312(const uint8_t* pVideoBuffer, const uint32_t* palette, void* pImageBits)
+{
+    uint32_t * pImageStart = static_cast<uint32_t*>(pImageBits) + 512 * 28;
+    Emulator_PrepareScreenBW512x256(pVideoBuffer, palette, pImageStart);
+}
+
+void CALLBACK Emulator_PrepareScreenBW768x468(const uint8_t* pVideoBuffer, const uint32_t* palette, void* pImageBits)
+{
+    for (int y = 0; y < 256; y += 2)
+    {
+        const uint16_t* psrc1 = (uint16_t*)(pVideoBuffer + y * 512 / 4);
+        const uint16_t* psrc2 = (uint16_t*)(pVideoBuffer + (y + 1) * 512 / 4);
+        uint32_t* pdest1 = static_cast<uint32_t*>(pImageBits) + (426 - 1 - y / 2 * 3) * 768;
+        uint32_t* pdest2 = pdest1 - 768;
+        uint32_t* pdest3 = pdest2 - 768;
+        for (int x = 0; x < 512 / 8; x++)
+        {
+            uint16_t src1 = *psrc1;
+            uint16_t src2 = *psrc2;
+            for (int bit = 0; bit < 4; bit++)
+            {
+                int colorindex1a = (src1 & 0x80) >> 7 | (src1 & 0x8000) >> 14;  src1 = src1 << 1;
+                int colorindex1b = (src1 & 0x80) >> 7 | (src1 & 0x8000) >> 14;  src1 = src1 << 1;
+                uint32_t c1a = palette[colorindex1a];
+                uint32_t c1b = palette[colorindex1b];
+                int colorindex2a = (src2 & 0x80) >> 7 | (src2 & 0x8000) >> 14;  src2 = src2 << 1;
+                int colorindex2b = (src2 & 0x80) >> 7 | (src2 & 0x8000) >> 14;  src2 = src2 << 1;
+                uint32_t c2a = palette[colorindex2a];
+                uint32_t c2b = palette[colorindex2b];
+
+                uint32_t c1ab = AVERAGERGB(c1a, c1b);
+                uint32_t c2ab = AVERAGERGB(c2a, c2b);
+                uint32_t c12a = AVERAGERGB(c1a, c2a);
+                uint32_t c12b = AVERAGERGB(c1b, c2b);
+                uint32_t c12ab = AVERAGERGB(c1ab, c2ab);
+
+                (*pdest1++) = c1a;   (*pdest1++) = c1ab;  (*pdest1++) = c1b;
+                (*pdest2++) = c12a;  (*pdest2++) = c12ab; (*pdest2++) = c12b;
+                (*pdest3++) = c2a;   (*pdest3++) = c2ab;  (*pdest3++) = c2b;
+            }
+            psrc1++;
+            psrc2++;
+        }
+    }
+}
+
+void CALLBACK Emulator_PrepareScreenBW896x624(const uint8_t* pVideoBuffer, const uint32_t* palette, void* pImageBits)
+{
+    for (int y = 0; y < 256; y++)
+    {
+        const uint16_t* psrc1 = (uint16_t*)(pVideoBuffer + y * 512 / 4);
+        uint32_t* pdest1 = static_cast<uint32_t*>(pImageBits) + (568 - 1 - y * 2) * 896;
+        uint32_t* pdest2 = pdest1 - 896;
+        for (int x = 0; x < 512 / 8; x++)
+        {
+            uint16_t src1 = *psrc1;
+            for (int bit = 0; bit < 2; bit++)
+            {
+                int colorindex1 = (src1 & 0x80) >> 7 | (src1 & 0x8000) >> 14;  src1 = src1 << 1;
+                int colorindex2 = (src1 & 0x80) >> 7 | (src1 & 0x8000) >> 14;  src1 = src1 << 1;
+                int colorindex3 = (src1 & 0x80) >> 7 | (src1 & 0x8000) >> 14;  src1 = src1 << 1;
+                int colorindex4 = (src1 & 0x80) >> 7 | (src1 & 0x8000) >> 14;  src1 = src1 << 1;
+                uint32_t c1 = palette[colorindex1];
+                uint32_t c2 = palette[colorindex2];
+                uint32_t c3 = palette[colorindex3];
+                uint32_t c4 = palette[colorindex4];
+                *(pdest1++) = *(pdest2++) = c1;
+                *(pdest1++) = *(pdest2++) = AVERAGERGB(c1, c2);
+                *(pdest1++) = *(pdest2++) = c2;
+                *(pdest1++) = *(pdest2++) = AVERAGERGB(c2, c3);
+                *(pdest1++) = *(pdest2++) = c3;
+                *(pdest1++) = *(pdest2++) = AVERAGERGB(c3, c4);
+                *(pdest1++) = *(pdest2++) = c4;
+            }
+            psrc1++;
+        }
+    }
+}
+
+void CALLBACK Emulator_PrepareScreenBW1024x624(const uint8_t* pVideoBuffer, const uint32_t* palette, void* pImageBits)
+{
+    for (int y = 0; y < 256; y++)
+    {
+        const uint16_t* pVideo = (uint16_t*)(pVideoBuffer + y * 512 / 4);
+        uint32_t* pBits1 = static_cast<uint32_t*>(pImageBits) + (568 - 1 - y * 2) * 1024;
+        uint32_t* pBits2 = pBits1 - 1024;
+        for (int x = 0; x < 512 / 8; x++)
+        {
+            uint16_t src = *pVideo;
+
+            for (int bit = 0; bit < 8; bit++)
+            {
+                int colorindex = (src & 0x80) >> 7 | (src & 0x8000) >> 14;
+                uint32_t color = palette[colorindex];
+
+                (*pBits1++) = color;  (*pBits1++) = color;
+                (*pBits2++) = color;  (*pBits2++) = color;
+
+                src = src << 1;
+            }
+
+            pVideo++;
+        }
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////
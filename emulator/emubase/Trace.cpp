@@ -0,0 +1,729 @@
+﻿/*  This file is part of NEMIGABTL.
+    NEMIGABTL is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software Foundation,
+either version 3 of the License, or (at your option) any later version.
+    NEMIGABTL is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU Lesser General Public License for more details.
+    You should have received a copy of the GNU Lesser General Public License along with
+NEMIGABTL. If not, see <http://www.gnu.org/licenses/>. */
+
+// Trace.cpp
+//
+
+#include "stdafx.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <mutex>
+#include <thread>
+#include "Emubase.h"
+
+
+//////////////////////////////////////////////////////////////////////
+
+// Append formatted text at buffer + length, keep length within size - 1;
+// a failed or truncated output (MSVC returns -1 on truncation) fills the buffer, later calls do nothing
+static void TraceTextAppend(TCHAR* buffer, size_t size, int& length, LPCTSTR format, ...)
+{
+    int room = static_cast<int>(size) - 1 - length;
+    if (room <= 0)
+        return;
+    va_list ptr;
+    va_start(ptr, format);
+    int result = _vsntprintf(buffer + length, room, format, ptr);
+    va_end(ptr);
+    length = (result < 0 || result >= room) ? static_cast<int>(size) - 1 : length + result;
+}
+
+void TraceRecordToText(const TraceRecord& record, TCHAR* buffer, size_t size, uint32_t options)
+{
+    if (size == 0)
+        return;
+
+    uint16_t address = record.regs[7];
+    TCHAR instr[8];
+    TCHAR args[32];
+    DisassembleInstruction(record.memory, address, instr, args);
+
+    int length = 0;
+    if (options & TRACETEXT_CYCLE)
+        TraceTextAppend(buffer, size, length, _T("%10llu "), static_cast<unsigned long long>(record.cycle));
+    TraceTextAppend(buffer, size, length, _T("%06o: %s\t%s"), address, instr, args);
+    if (options & TRACETEXT_REGS)
+    {
+        TraceTextAppend(buffer, size, length,
+                _T("\tR0=%06o R1=%06o R2=%06o R3=%06o R4=%06o R5=%06o SP=%06o PS=%06o %s"),
+                record.regs[0], record.regs[1], record.regs[2], record.regs[3],
+                record.regs[4], record.regs[5], record.regs[6], record.psw,
+                (record.psw & PSW_P) ? _T("HALT") : _T("USER"));
+    }
+    if ((options & TRACETEXT_WRITES) && record.writecount > 0)
+    {
+        TraceTextAppend(buffer, size, length, _T("\t"));
+        for (int i = 0; i < record.writecount && i < TRACERECORD_WRITES; i++)
+        {
+            if (record.writebytes & (1 << i))
+                TraceTextAppend(buffer, size, length, _T(" %06o:=%03o"), record.writes[i][0], record.writes[i][1]);
+            else
+                TraceTextAppend(buffer, size, length, _T(" %06o:=%06o"), record.writes[i][0], record.writes[i][1]);
+        }
+        if (record.writecount > TRACERECORD_WRITES)
+            TraceTextAppend(buffer, size, length, _T(" +%d"), record.writecount - TRACERECORD_WRITES);
+    }
+    buffer[length] = 0;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Record encoding
+//   Flags byte, cycle delta, PC delta, then the optional parts marked in the flags byte.
+//   Deltas are against the previous record of the same block; numbers are variable-length,
+//   7 bits per byte, signed deltas are zigzag-encoded.
+
+#define TRACECODE_REGS      1   // Mask of changed R0..R6 and their deltas follow
+#define TRACECODE_PSW       2   // PSW follows
+#define TRACECODE_CODE      4   // Instruction words follow, they are not in the code cache
+#define TRACECODE_WRITES    8   // Write count, byte write mask, address and value pairs follow
+
+#define TRACECODE_MAXSIZE   64  // Encoded record size limit
+#define TRACECODE_CACHE   1024  // Code cache size, power of 2; entry is chosen by the instruction address
+
+// Delta coding state, the same on the writer and on the reader side; reset at every block start
+struct TraceCodec
+{
+    TraceRecord prev;
+    uint32_t    codeaddr[TRACECODE_CACHE];  // Address of the cached instruction words, 0xffffffff = empty
+    uint16_t    code[TRACECODE_CACHE][3];
+
+    void        Reset();
+    size_t      Encode(const TraceRecord& record, uint8_t* buffer);
+    // Returns size of the encoded record, 0 means broken data
+    size_t      Decode(const uint8_t* buffer, size_t size, TraceRecord* pRecord);
+};
+
+static uint8_t* TracePutNumber(uint8_t* p, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        *p++ = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+    *p++ = static_cast<uint8_t>(value);
+    return p;
+}
+
+static const uint8_t* TraceGetNumber(const uint8_t* p, const uint8_t* end, uint64_t* pValue)
+{
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        if (p == end)
+            return nullptr;
+        uint8_t byte = *p++;
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            *pValue = value;
+            return p;
+        }
+    }
+    return nullptr;
+}
+
+static uint8_t* TracePutDelta(uint8_t* p, uint16_t value, uint16_t prev)
+{
+    int delta = static_cast<int16_t>(value - prev);
+    uint32_t zigzag = (delta >= 0) ? (static_cast<uint32_t>(delta) << 1) : ((static_cast<uint32_t>(-delta) << 1) - 1);
+    return TracePutNumber(p, zigzag);
+}
+
+static const uint8_t* TraceGetDelta(const uint8_t* p, const uint8_t* end, uint16_t prev, uint16_t* pValue)
+{
+    uint64_t zigzag;
+    p = TraceGetNumber(p, end, &zigzag);
+    if (p == nullptr)
+        return nullptr;
+    int delta = (zigzag & 1) ? -static_cast<int>((zigzag + 1) >> 1) : static_cast<int>(zigzag >> 1);
+    *pValue = static_cast<uint16_t>(prev + delta);
+    return p;
+}
+
+static uint8_t* TracePutWord(uint8_t* p, uint16_t value)
+{
+    *p++ = LOBYTE(value);
+    *p++ = HIBYTE(value);
+    return p;
+}
+
+void TraceCodec::Reset()
+{
+    ::memset(&prev, 0, sizeof(prev));
+    ::memset(codeaddr, 0xff, sizeof(codeaddr));
+}
+
+size_t TraceCodec::Encode(const TraceRecord& record, uint8_t* buffer)
+{
+    uint8_t flags = 0;
+    uint8_t* p = buffer + 1;
+    p = TracePutNumber(p, record.cycle - prev.cycle);
+    p = TracePutDelta(p, record.regs[7], prev.regs[7]);
+
+    uint8_t regmask = 0;
+    for (int r = 0; r < 7; r++)
+    {
+        if (record.regs[r] != prev.regs[r])
+            regmask |= (1 << r);
+    }
+    if (regmask != 0)
+    {
+        flags |= TRACECODE_REGS;
+        *p++ = regmask;
+        for (int r = 0; r < 7; r++)
+        {
+            if (regmask & (1 << r))
+                p = TracePutDelta(p, record.regs[r], prev.regs[r]);
+        }
+    }
+
+    if (record.psw != prev.psw)
+    {
+        flags |= TRACECODE_PSW;
+        p = TracePutWord(p, record.psw);
+    }
+
+    int slot = (record.regs[7] >> 1) & (TRACECODE_CACHE - 1);
+    if (codeaddr[slot] != record.regs[7] || ::memcmp(code[slot], record.memory, sizeof(record.memory)) != 0)
+    {
+        flags |= TRACECODE_CODE;
+        codeaddr[slot] = record.regs[7];
+        ::memcpy(code[slot], record.memory, sizeof(record.memory));
+        for (int i = 0; i < 3; i++)
+            p = TracePutWord(p, record.memory[i]);
+    }
+
+    if (record.writecount > 0)
+    {
+        flags |= TRACECODE_WRITES;
+        *p++ = record.writecount;
+        *p++ = record.writebytes;
+        for (int i = 0; i < record.writecount && i < TRACERECORD_WRITES; i++)
+        {
+            p = TracePutWord(p, record.writes[i][0]);
+            p = TracePutWord(p, record.writes[i][1]);
+        }
+    }
+
+    buffer[0] = flags;
+    prev = record;
+    return p - buffer;
+}
+
+size_t TraceCodec::Decode(const uint8_t* buffer, size_t size, TraceRecord* pRecord)
+{
+    const uint8_t* p = buffer;
+    const uint8_t* end = buffer + size;
+    if (p == end)
+        return 0;
+    uint8_t flags = *p++;
+
+    TraceRecord record = prev;
+    record.writecount = record.writebytes = 0;
+    ::memset(record.writes, 0, sizeof(record.writes));
+    record.reserved = 0;
+
+    uint64_t delta;
+    p = TraceGetNumber(p, end, &delta);
+    if (p == nullptr)
+        return 0;
+    record.cycle += delta;
+    p = TraceGetDelta(p, end, prev.regs[7], &record.regs[7]);
+    if (p == nullptr)
+        return 0;
+
+    if (flags & TRACECODE_REGS)
+    {
+        if (p == end)
+            return 0;
+        uint8_t regmask = *p++;
+        for (int r = 0; r < 7 && p != nullptr; r++)
+        {
+            if (regmask & (1 << r))
+                p = TraceGetDelta(p, end, prev.regs[r], &record.regs[r]);
+        }
+        if (p == nullptr)
+            return 0;
+    }
+
+    if (flags & TRACECODE_PSW)
+    {
+        if (end - p < 2)
+            return 0;
+        record.psw = MAKEWORD(p[0], p[1]);  p += 2;
+    }
+
+    int slot = (record.regs[7] >> 1) & (TRACECODE_CACHE - 1);
+    if (flags & TRACECODE_CODE)
+    {
+        if (end - p < 6)
+            return 0;
+        for (int i = 0; i < 3; i++, p += 2)
+            record.memory[i] = MAKEWORD(p[0], p[1]);
+        codeaddr[slot] = record.regs[7];
+        ::memcpy(code[slot], record.memory, sizeof(record.memory));
+    }
+    else
+    {
+        if (codeaddr[slot] != record.regs[7])
+            return 0;
+        ::memcpy(record.memory, code[slot], sizeof(record.memory));
+    }
+
+    if (flags & TRACECODE_WRITES)
+    {
+        if (end - p < 2)
+            return 0;
+        record.writecount = *p++;
+        record.writebytes = *p++;
+        for (int i = 0; i < record.writecount && i < TRACERECORD_WRITES; i++, p += 4)
+        {
+            if (end - p < 4)
+                return 0;
+            record.writes[i][0] = MAKEWORD(p[0], p[1]);
+            record.writes[i][1] = MAKEWORD(p[2], p[3]);
+        }
+    }
+
+    prev = record;
+    *pRecord = record;
+    return p - buffer;
+}
+
+static bool TraceFileSeek(FILE* fpFile, uint64_t offset)
+{
+#if defined(_MSC_VER)
+    return ::_fseeki64(fpFile, static_cast<__int64>(offset), SEEK_SET) == 0;
+#else
+    return ::fseeko(fpFile, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+}
+
+
+//////////////////////////////////////////////////////////////////////
+
+struct CTraceWriter::ThreadState
+{
+    std::atomic<uint64_t> head;  // Records published by the producer
+    std::atomic<uint64_t> tail;  // Records encoded by the writer thread
+    std::atomic<bool> stop;
+    std::mutex  mutex;
+    std::condition_variable dataReady;
+    std::condition_variable spaceReady;
+    FILE*       fpFile;
+    std::thread thread;
+    // Owned by the writer thread
+    uint64_t    fileoffset;
+    TraceCodec  codec;
+    TraceBlockHeader block;
+    uint8_t*    blockdata;      // Encoded records of the current block
+    TraceIndexEntry* index;
+    uint32_t    indexcount;
+
+    void        WriteBlock();
+    void        WriteIndex();
+};
+
+void CTraceWriter::ThreadState::WriteBlock()
+{
+    ::fwrite(&block, 1, sizeof(block), fpFile);
+    ::fwrite(blockdata, 1, block.size, fpFile);
+
+    if ((indexcount & 255) == 0)
+        index = static_cast<TraceIndexEntry*>(::realloc(index, (indexcount + 256) * sizeof(TraceIndexEntry)));
+    TraceIndexEntry* pEntry = index + indexcount++;
+    pEntry->offset = fileoffset;
+    pEntry->record = block.record;
+    pEntry->cycle = block.cycle;
+    pEntry->count = block.count;
+    pEntry->reserved = 0;
+
+    fileoffset += sizeof(block) + block.size;
+    block.count = block.size = 0;
+}
+
+void CTraceWriter::ThreadState::WriteIndex()
+{
+    TraceIndexTrailer trailer;
+    trailer.magic = TRACEINDEX_MAGIC;
+    trailer.count = indexcount;
+    trailer.offset = fileoffset;
+    if (indexcount > 0)
+        ::fwrite(index, sizeof(TraceIndexEntry), indexcount, fpFile);
+    ::fwrite(&trailer, 1, sizeof(trailer), fpFile);
+}
+
+CTraceWriter::CTraceWriter()
+{
+    m_pState = nullptr;
+    m_pRecords = nullptr;
+    m_pSnapshots = nullptr;
+    m_head = m_tail = 0;
+}
+
+CTraceWriter::~CTraceWriter()
+{
+    Close();
+}
+
+bool CTraceWriter::Open(LPCTSTR sFileName)
+{
+    Close();
+
+    FILE* fpFile = ::_tfopen(sFileName, _T("wb"));
+    if (fpFile == nullptr)
+        return false;
+    uint32_t header[TRACEFILE_HEADER_SIZE / 4];
+    header[0] = TRACEFILE_MAGIC;
+    header[1] = TRACEFILE_VERSION;
+    header[2] = TRACEBLOCK_RECORDS;
+    header[3] = 0;
+    ::fwrite(header, 1, sizeof(header), fpFile);
+
+    m_pRecords = static_cast<TraceRecord*>(::calloc(TRACEBUFFER_RECORDS, sizeof(TraceRecord)));
+    m_pSnapshots = static_cast<uint8_t*>(::calloc(TRACESNAPSHOT_SLOTS, TRACESNAPSHOT_SIZE));
+    m_head = m_tail = 0;
+    m_pState = new ThreadState();
+    m_pState->head = 0;
+    m_pState->tail = 0;
+    m_pState->stop = false;
+    m_pState->fpFile = fpFile;
+    m_pState->fileoffset = TRACEFILE_HEADER_SIZE;
+    ::memset(&m_pState->block, 0, sizeof(m_pState->block));
+    m_pState->blockdata = static_cast<uint8_t*>(::malloc(TRACEBLOCK_RECORDS * TRACECODE_MAXSIZE));
+    m_pState->index = nullptr;
+    m_pState->indexcount = 0;
+    m_pState->thread = std::thread(WriterThread, m_pState, m_pRecords, m_pSnapshots);
+    return true;
+}
+
+void CTraceWriter::Close()
+{
+    if (m_pState == nullptr)
+        return;
+
+    Publish();
+    m_pState->stop = true;
+    m_pState->dataReady.notify_one();
+    m_pState->thread.join();  // The thread writes all the published records and the index before it exits
+    ::fclose(m_pState->fpFile);
+
+    ::free(m_pState->blockdata);
+    ::free(m_pState->index);
+    delete m_pState;  m_pState = nullptr;
+    ::free(m_pRecords);  m_pRecords = nullptr;
+    ::free(m_pSnapshots);  m_pSnapshots = nullptr;
+}
+
+void CTraceWriter::Publish()
+{
+    m_pState->head.store(m_head, std::memory_order_release);
+    m_pState->dataReady.notify_one();
+}
+
+void CTraceWriter::WaitForSpace()
+{
+    Publish();
+    std::unique_lock<std::mutex> lock(m_pState->mutex);
+    for (;;)
+    {
+        m_tail = m_pState->tail.load(std::memory_order_acquire);
+        if (m_head - m_tail < TRACEBUFFER_RECORDS)
+            break;
+        m_pState->spaceReady.wait_for(lock, std::chrono::milliseconds(1));
+    }
+}
+
+void CTraceWriter::WriterThread(ThreadState* pState, const TraceRecord* pRecords, const uint8_t* pSnapshots)
+{
+    TraceBlockHeader& block = pState->block;
+    uint64_t tail = 0;
+    for (;;)
+    {
+        uint64_t head = pState->head.load(std::memory_order_acquire);
+        if (head == tail)
+        {
+            if (pState->stop)  // Close() publishes before the stop flag, re-read the head to drain the last records
+            {
+                if (pState->head.load(std::memory_order_acquire) == tail)
+                    break;
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(pState->mutex);
+            pState->dataReady.wait_for(lock, std::chrono::milliseconds(10));
+            continue;
+        }
+
+        for (; tail < head; tail++)
+        {
+            const TraceRecord& record = pRecords[tail & (TRACEBUFFER_RECORDS - 1)];
+            if ((tail & (TRACEBLOCK_RECORDS - 1)) == 0)  // Block start: take the snapshot, reset the codec
+            {
+                block.magic = TRACEBLOCK_MAGIC;
+                block.record = tail;
+                block.cycle = record.cycle;
+                ::memcpy(block.snapshot, pSnapshots + (tail / TRACEBLOCK_RECORDS % TRACESNAPSHOT_SLOTS) * TRACESNAPSHOT_SIZE,
+                        TRACESNAPSHOT_SIZE);
+                pState->codec.Reset();
+            }
+            block.size += static_cast<uint32_t>(pState->codec.Encode(record, pState->blockdata + block.size));
+            block.count++;
+            if (block.count == TRACEBLOCK_RECORDS)
+            {
+                pState->WriteBlock();
+                pState->tail.store(tail + 1, std::memory_order_release);
+                pState->spaceReady.notify_one();
+            }
+        }
+
+        pState->tail.store(tail, std::memory_order_release);
+        pState->spaceReady.notify_one();
+    }
+
+    if (block.count > 0)
+        pState->WriteBlock();
+    pState->WriteIndex();
+}
+
+
+//////////////////////////////////////////////////////////////////////
+
+struct CTraceReader::DecoderState
+{
+    FILE*       fpFile;
+    int         block;          // Current block, -1 = none
+    TraceBlockHeader header;
+    uint8_t*    data;           // Encoded records of the current block
+    uint32_t    datasize;       // Size of the data buffer
+    uint32_t    position;       // Decoding position in the data
+    uint32_t    decoded;        // Records decoded in the current block
+    TraceCodec  codec;
+    bool        okPeeked;       // The record is read ahead by SeekToCycle()
+    TraceRecord peeked;
+};
+
+CTraceReader::CTraceReader()
+{
+    m_pState = nullptr;
+    m_pIndex = nullptr;
+    m_nBlockCount = 0;
+}
+
+CTraceReader::~CTraceReader()
+{
+    Close();
+}
+
+bool CTraceReader::Open(LPCTSTR sFileName)
+{
+    Close();
+
+    FILE* fpFile = ::_tfopen(sFileName, _T("rb"));
+    if (fpFile == nullptr)
+        return false;
+    uint32_t header[TRACEFILE_HEADER_SIZE / 4];
+    if (::fread(header, 1, sizeof(header), fpFile) != sizeof(header) ||
+        header[0] != TRACEFILE_MAGIC || header[1] != TRACEFILE_VERSION || header[2] != TRACEBLOCK_RECORDS)
+    {
+        ::fclose(fpFile);
+        return false;
+    }
+
+    m_pState = new DecoderState();
+    m_pState->fpFile = fpFile;
+    m_pState->block = -1;
+    m_pState->data = nullptr;
+    m_pState->datasize = 0;
+    m_pState->okPeeked = false;
+    ReadIndex();
+    if (m_nBlockCount > 0 && !LoadBlock(0))
+    {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void CTraceReader::Close()
+{
+    if (m_pState == nullptr)
+        return;
+
+    ::fclose(m_pState->fpFile);
+    ::free(m_pState->data);
+    delete m_pState;  m_pState = nullptr;
+    ::free(m_pIndex);  m_pIndex = nullptr;
+    m_nBlockCount = 0;
+}
+
+// Read the index at the file end; when the writer was not closed, rebuild the index from the block headers
+void CTraceReader::ReadIndex()
+{
+    FILE* fpFile = m_pState->fpFile;
+
+    TraceIndexTrailer trailer;
+    if (::fseek(fpFile, -static_cast<long>(sizeof(trailer)), SEEK_END) == 0 &&
+        ::fread(&trailer, 1, sizeof(trailer), fpFile) == sizeof(trailer) &&
+        trailer.magic == TRACEINDEX_MAGIC && TraceFileSeek(fpFile, trailer.offset))
+    {
+        m_pIndex = static_cast<TraceIndexEntry*>(::calloc(trailer.count + 1, sizeof(TraceIndexEntry)));
+        if (::fread(m_pIndex, sizeof(TraceIndexEntry), trailer.count, fpFile) == trailer.count)
+        {
+            m_nBlockCount = static_cast<int>(trailer.count);
+            return;
+        }
+        ::free(m_pIndex);  m_pIndex = nullptr;
+    }
+
+    uint64_t offset = TRACEFILE_HEADER_SIZE;
+    TraceBlockHeader block;
+    uint8_t lastbyte;
+    while (TraceFileSeek(fpFile, offset) &&
+           ::fread(&block, 1, sizeof(block), fpFile) == sizeof(block) && block.magic == TRACEBLOCK_MAGIC)
+    {
+        // Skip the block cut off at the file end
+        if (block.size > 0 && (!TraceFileSeek(fpFile, offset + sizeof(block) + block.size - 1) ||
+                ::fread(&lastbyte, 1, 1, fpFile) != 1))
+            break;
+        if ((m_nBlockCount & 255) == 0)
+            m_pIndex = static_cast<TraceIndexEntry*>(::realloc(m_pIndex, (m_nBlockCount + 256) * sizeof(TraceIndexEntry)));
+        TraceIndexEntry* pEntry = m_pIndex + m_nBlockCount++;
+        pEntry->offset = offset;
+        pEntry->record = block.record;
+        pEntry->cycle = block.cycle;
+        pEntry->count = block.count;
+        pEntry->reserved = 0;
+        offset += sizeof(block) + block.size;
+    }
+}
+
+bool CTraceReader::LoadBlock(int block)
+{
+    DecoderState* pState = m_pState;
+    pState->block = -1;
+    pState->okPeeked = false;
+    if (block >= m_nBlockCount)
+        return false;
+
+    if (!TraceFileSeek(pState->fpFile, m_pIndex[block].offset) ||
+        ::fread(&pState->header, 1, sizeof(pState->header), pState->fpFile) != sizeof(pState->header) ||
+        pState->header.magic != TRACEBLOCK_MAGIC)
+        return false;
+    if (pState->header.size > pState->datasize)
+    {
+        pState->datasize = pState->header.size;
+        pState->data = static_cast<uint8_t*>(::realloc(pState->data, pState->datasize));
+    }
+    if (::fread(pState->data, 1, pState->header.size, pState->fpFile) != pState->header.size)
+        return false;
+
+    pState->block = block;
+    pState->position = 0;
+    pState->decoded = 0;
+    pState->codec.Reset();
+    return true;
+}
+
+uint64_t CTraceReader::GetRecordCount() const
+{
+    if (m_nBlockCount == 0)
+        return 0;
+    const TraceIndexEntry* pLast = m_pIndex + m_nBlockCount - 1;
+    return pLast->record + pLast->count;
+}
+
+const TraceBlockHeader* CTraceReader::GetBlockHeader() const
+{
+    if (m_pState == nullptr || m_pState->block < 0)
+        return nullptr;
+    return &m_pState->header;
+}
+
+bool CTraceReader::SeekToRecord(uint64_t record)
+{
+    if (m_nBlockCount == 0)
+        return false;
+
+    int block = static_cast<int>(record / TRACEBLOCK_RECORDS);  // All the blocks but the last one are full
+    if (block >= m_nBlockCount || !LoadBlock(block))
+        return false;
+    TraceRecord temp;
+    for (uint64_t skip = record - m_pIndex[block].record; skip > 0; skip--)
+    {
+        if (!ReadRecord(&temp))
+            return false;
+    }
+    return true;
+}
+
+bool CTraceReader::SeekToCycle(uint64_t cycle)
+{
+    if (m_nBlockCount == 0)
+        return false;
+
+    // Binary search for the last block started at or before the cycle
+    int lo = 0, hi = m_nBlockCount - 1;
+    while (lo < hi)
+    {
+        int mid = (lo + hi + 1) / 2;
+        if (m_pIndex[mid].cycle <= cycle)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    if (!LoadBlock(lo))
+        return false;
+
+    TraceRecord record;
+    while (ReadRecord(&record))
+    {
+        if (record.cycle >= cycle)
+        {
+            m_pState->okPeeked = true;
+            m_pState->peeked = record;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CTraceReader::ReadRecord(TraceRecord* pRecord)
+{
+    DecoderState* pState = m_pState;
+    if (pState == nullptr || pState->block < 0)
+        return false;
+    if (pState->okPeeked)
+    {
+        pState->okPeeked = false;
+        *pRecord = pState->peeked;
+        return true;
+    }
+
+    if (pState->decoded == pState->header.count)  // Go to the next block
+    {
+        if (!LoadBlock(pState->block + 1))
+            return false;
+    }
+
+    size_t size = pState->codec.Decode(
+            pState->data + pState->position, pState->header.size - pState->position, pRecord);
+    if (size == 0)
+        return false;
+    pState->position += static_cast<uint32_t>(size);
+    pState->decoded++;
+    return true;
+}
+
+
+//////////////////////////////////////////////////////////////////////
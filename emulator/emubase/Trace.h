@@ -0,0 +1,156 @@
+﻿/*  This file is part of NEMIGABTL.
+    NEMIGABTL is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software Foundation,
+either version 3 of the License, or (at your option) any later version.
+    NEMIGABTL is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU Lesser General Public License for more details.
+    You should have received a copy of the GNU Lesser General Public License along with
+NEMIGABTL. If not, see <http://www.gnu.org/licenses/>. */
+
+// Trace.h  Binary CPU instruction trace
+//
+
+#pragma once
+
+#include "Defines.h"
+
+
+//////////////////////////////////////////////////////////////////////
+
+// Trace file layout: header, blocks, block index, index trailer
+//   Every block starts with a CPU snapshot, the records are delta-encoded against the previous one,
+//   so the reader can start decoding at any block; see CTraceWriter and CTraceReader
+#define TRACEFILE_MAGIC     0x52544D4E  // "NMTR"
+#define TRACEFILE_VERSION   2
+#define TRACEFILE_HEADER_SIZE  16
+#define TRACEBLOCK_MAGIC    0x42544D4E  // "NMTB"
+#define TRACEINDEX_MAGIC    0x49544D4E  // "NMTI"
+
+#define TRACEBUFFER_RECORDS  65536  // Ring buffer size, records; power of 2
+#define TRACEBUFFER_CHUNK     4096  // Wake up the writer thread every chunk of records
+#define TRACEBLOCK_RECORDS    4096  // Records in the file block; power of 2
+#define TRACESNAPSHOT_SIZE      64  // CPU snapshot size, see CProcessor::SaveToImage()
+#define TRACERECORD_WRITES       3  // Memory writes kept in the record
+
+// TraceRecordToText() options
+#define TRACETEXT_CYCLE     1   // Prefix the line with the cycle number
+#define TRACETEXT_REGS      2   // Append registers and PSW
+#define TRACETEXT_WRITES    4   // Append memory writes made by the instruction
+
+// One traced instruction, written at the instruction boundary before the instruction runs
+struct TraceRecord
+{
+    uint64_t    cycle;      // CPU cycle
+    uint16_t    regs[8];    // R0..R7, R7 is the instruction address
+    uint16_t    psw;        // PSW, HALT/USER mode is in PSW_P bit
+    uint16_t    memory[3];  // Instruction words
+    uint8_t     writecount; // Memory writes made by the instruction, only TRACERECORD_WRITES first are kept
+    uint8_t     writebytes; // Bit N set means the write N is a byte write
+    uint16_t    writes[TRACERECORD_WRITES][2];  // Address and value written
+    uint16_t    reserved;
+};
+
+// Block header; the encoded records follow
+struct TraceBlockHeader
+{
+    uint32_t    magic;      // TRACEBLOCK_MAGIC
+    uint32_t    size;       // Encoded records size, bytes
+    uint32_t    count;      // Number of records in the block
+    uint32_t    reserved;
+    uint64_t    record;     // Number of the first record
+    uint64_t    cycle;      // Cycle of the first record
+    uint8_t     snapshot[TRACESNAPSHOT_SIZE];  // CPU state at the first record, see CProcessor::LoadFromImage()
+};
+
+// Block index entry; the index is written at the end of the file, followed by TraceIndexTrailer
+struct TraceIndexEntry
+{
+    uint64_t    offset;     // Block header offset in the file
+    uint64_t    record;
+    uint64_t    cycle;
+    uint32_t    count;
+    uint32_t    reserved;
+};
+
+struct TraceIndexTrailer
+{
+    uint32_t    magic;      // TRACEINDEX_MAGIC
+    uint32_t    count;      // Number of index entries
+    uint64_t    offset;     // Index offset in the file
+};
+
+// Render the record in the text trace format: "PPPPPP: INSTR\tARGS"
+void TraceRecordToText(const TraceRecord& record, TCHAR* buffer, size_t size, uint32_t options);
+
+
+// Writes trace records to the file; the ring buffer is encoded and written by a background thread
+class CTraceWriter
+{
+public:
+    CTraceWriter();
+    ~CTraceWriter();
+    bool        Open(LPCTSTR sFileName);  // Create the file and start the writer thread
+    void        Close();    // Flush the buffer, write the block index, stop the thread and close the file
+    bool        IsOpen() const { return m_pState != nullptr; }
+    uint64_t    GetRecordCount() const { return m_head; }  // Records added since Open()
+    // Buffer for the CPU snapshot when the next record starts a block, nullptr otherwise
+    uint8_t*    GetBlockSnapshot()
+    {
+        if ((m_head & (TRACEBLOCK_RECORDS - 1)) != 0)
+            return nullptr;
+        return m_pSnapshots + (m_head / TRACEBLOCK_RECORDS % TRACESNAPSHOT_SLOTS) * TRACESNAPSHOT_SIZE;
+    }
+    // Add the record; waits for the writer thread if the ring buffer is full
+    void        Add(const TraceRecord& record)
+    {
+        if (m_head - m_tail == TRACEBUFFER_RECORDS)
+            WaitForSpace();
+        m_pRecords[m_head & (TRACEBUFFER_RECORDS - 1)] = record;
+        if ((++m_head & (TRACEBUFFER_CHUNK - 1)) == 0)
+            Publish();
+    }
+private:
+    // Snapshot slots cover twice the ring buffer, so the slot is never reused before the thread takes it
+    static const int TRACESNAPSHOT_SLOTS = 2 * TRACEBUFFER_RECORDS / TRACEBLOCK_RECORDS;
+    struct ThreadState;
+    ThreadState* m_pState;      // Writer thread, encoder and the shared counters
+    TraceRecord* m_pRecords;    // Ring buffer
+    uint8_t*    m_pSnapshots;   // CPU snapshots for the blocks in the ring buffer
+    uint64_t    m_head;         // Records added, the producer side copy
+    uint64_t    m_tail;         // Records written as the producer saw it last time
+private:
+    void        Publish();      // Make the added records visible to the writer thread
+    void        WaitForSpace();
+    static void WriterThread(ThreadState* pState, const TraceRecord* pRecords, const uint8_t* pSnapshots);
+};
+
+
+// Reads the trace file written by CTraceWriter; seeks using the block index
+class CTraceReader
+{
+public:
+    CTraceReader();
+    ~CTraceReader();
+    bool        Open(LPCTSTR sFileName);  // Read the index; for unfinished file, scan the block headers
+    void        Close();
+    uint64_t    GetRecordCount() const;
+    int         GetBlockCount() const { return m_nBlockCount; }
+    const TraceIndexEntry* GetBlockIndex() const { return m_pIndex; }
+    bool        SeekToRecord(uint64_t record);
+    bool        SeekToCycle(uint64_t cycle);  // Seek to the first record at or after the cycle
+    bool        ReadRecord(TraceRecord* pRecord);  // Read the next record; false at the end of the trace
+    // Header of the block the next record comes from, with the CPU snapshot
+    const TraceBlockHeader* GetBlockHeader() const;
+private:
+    struct DecoderState;
+    DecoderState* m_pState;     // File, current block and the decoder
+    TraceIndexEntry* m_pIndex;
+    int         m_nBlockCount;
+private:
+    void        ReadIndex();
+    bool        LoadBlock(int block);
+};
+
+
+//////////////////////////////////////////////////////////////////////
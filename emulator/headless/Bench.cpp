@@ -0,0 +1,571 @@
+﻿/*  This file is part of NEMIGABTL.
+    NEMIGABTL is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software Foundation,
+either version 3 of the License, or (at your option) any later version.
+    NEMIGABTL is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU Lesser General Public License for more details.
+    You should have received a copy of the GNU Lesser General Public License along with
+NEMIGABTL. If not, see <http://www.gnu.org/licenses/>. */
+
+// Bench.cpp  Headless frontend: micro-benchmarks for the emulator hot paths
+
+#include "stdafx.h"
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include "Emulator.h"
+#include "../emubase/Emubase.h"
+
+//////////////////////////////////////////////////////////////////////
+
+
+uint16_t Option_Configuration = EMU_CONF_NEMIGA406;
+LPCTSTR Option_RomFile = nullptr;
+int Option_Samples = 10;
+int Option_SampleTime = 20;  // Milliseconds per sample
+LPCTSTR Option_Filter = nullptr;
+LPCTSTR Option_JsonFile = nullptr;
+LPCTSTR Option_BaselineFile = nullptr;
+double Option_Threshold = 10.0;  // Percent slower than the baseline to report a regression
+
+const long BENCH_INIT_FRAMES = 100;  // Let the ROM initialize the machine before the benchmarks
+const int BENCH_MAXSAMPLES = 100;
+const int BENCH_MAXNAME = 32;
+
+volatile uint32_t g_BenchSink = 0;  // Results go here so the compiler keeps the benchmarked code
+
+
+//////////////////////////////////////////////////////////////////////
+
+
+void PrintUsage()
+{
+    printf("Usage: nemigabtl-bench [options]\n"
+            "  -conf 303|405|406   Machine configuration, default 406\n"
+            "  -rom <file>         ROM image file, default nemiga-XXX.rom\n"
+            "  -samples <n>        Samples per benchmark, default 10\n"
+            "  -time <ms>          Time per sample in milliseconds, default 20\n"
+            "  -filter <text>      Run only the benchmarks with the text in the name\n"
+            "  -json <file>        Write the results as JSON\n"
+            "  -baseline <file>    Compare with the results saved by -json before;\n"
+            "                      exit code 2 when a benchmark got slower than the threshold\n"
+            "  -threshold <pct>    Regression threshold in percent, default 10\n");
+}
+
+bool ParseCommandLine(int argc, char** argv)
+{
+    for (int argn = 1; argn < argc; argn++)
+    {
+        LPCTSTR arg = argv[argn];
+        LPCTSTR value = (argn + 1 < argc) ? argv[argn + 1] : nullptr;
+        if (_tcscmp(arg, _T("-help")) == 0 || _tcscmp(arg, _T("-h")) == 0)
+            return false;
+
+        if (value == nullptr)
+        {
+            fprintf(stderr, "Option %s requires a value.\n", arg);
+            return false;
+        }
+        if (_tcscmp(arg, _T("-conf")) == 0)
+        {
+            long conf = atol(value);
+            if (conf != EMU_CONF_NEMIGA303 && conf != EMU_CONF_NEMIGA405 && conf != EMU_CONF_NEMIGA406)
+            {
+                fprintf(stderr, "Unknown configuration: %s.\n", value);
+                return false;
+            }
+            Option_Configuration = static_cast<uint16_t>(conf);
+        }
+        else if (_tcscmp(arg, _T("-rom")) == 0)
+            Option_RomFile = value;
+        else if (_tcscmp(arg, _T("-samples")) == 0)
+        {
+            Option_Samples = atoi(value);
+            if (Option_Samples < 2 || Option_Samples > BENCH_MAXSAMPLES)
+            {
+                fprintf(stderr, "Samples should be from 2 to %d.\n", BENCH_MAXSAMPLES);
+                return false;
+            }
+        }
+        else if (_tcscmp(arg, _T("-time")) == 0)
+            Option_SampleTime = atoi(value);
+        else if (_tcscmp(arg, _T("-filter")) == 0)
+            Option_Filter = value;
+        else if (_tcscmp(arg, _T("-json")) == 0)
+            Option_JsonFile = value;
+        else if (_tcscmp(arg, _T("-baseline")) == 0)
+            Option_BaselineFile = value;
+        else if (_tcscmp(arg, _T("-threshold")) == 0)
+            Option_Threshold = atof(value);
+        else
+        {
+            fprintf(stderr, "Unknown option: %s.\n", arg);
+            return false;
+        }
+        argn++;
+    }
+
+    return Option_SampleTime > 0;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// Benchmarks
+
+struct Benchmark
+{
+    LPCTSTR     name;
+    void        (*setup)(const Benchmark* pBench);  // nullptr = no setup
+    uint64_t    (*run)(const Benchmark* pBench, int count);  // Do about count operations, returns operations done
+    uint16_t    address;
+    bool        okHaltMode;
+    uint16_t    param;  // Benchmark specific
+};
+
+// Synthetic instruction mixes, endless loops at 001000 running in USER mode
+const uint16_t BenchProgramALU[] =
+{
+    060102,             // 001000  ADD R1, R2
+    0160304,            // 001002  SUB R3, R4
+    005200,             // 001004  INC R0
+    006305,             // 001006  ASL R5
+    040103,             // 001010  BIC R1, R3
+    050204,             // 001012  BIS R2, R4
+    074005,             // 001014  XOR R0, R5
+    000770,             // 001016  BR 001000
+};
+const uint16_t BenchProgramMemory[] =
+{
+    012700, 002000,     // 001000  MOV #2000, R0
+    012701, 003000,     // 001004  MOV #3000, R1
+    012021,             // 001010  MOV (R0)+, (R1)+
+    012021,             // 001012  MOV (R0)+, (R1)+
+    016002, 000010,     // 001014  MOV 10(R0), R2
+    010261, 000002,     // 001020  MOV R2, 2(R1)
+    063703, 002100,     // 001024  ADD @#2100, R3
+    0111004,            // 001030  MOVB (R0), R4
+    000762,             // 001032  BR 001000
+};
+const uint16_t BenchProgramBranch[] =
+{
+    012700, 000020,     // 001000  MOV #20, R0
+    004767, 000006,     // 001004  JSR PC, 001016
+    005300,             // 001010  DEC R0
+    001374,             // 001012  BNE 001004
+    000771,             // 001014  BR 001000
+    005201,             // 001016  INC R1
+    000207,             // 001020  RTS PC
+};
+const uint16_t BENCH_PROGRAM_START = 001000;
+
+const uint16_t* BenchPrograms[] = { BenchProgramALU, BenchProgramMemory, BenchProgramBranch };
+const int BenchProgramSizes[] = { sizeof(BenchProgramALU), sizeof(BenchProgramMemory), sizeof(BenchProgramBranch) };
+
+uint8_t m_BenchTrackSource[23 * 128];
+uint8_t m_BenchTrackRaw[FLOPPY_RAWTRACKSIZE];
+uint8_t m_BenchTrackRawMX[FLOPPY_RAWTRACKSIZE];
+uint16_t m_BenchROM[4096 / 2];
+uint32_t m_BenchImage[1024 * 624];  // The largest screen mode
+
+// Screen modes, the same as in the Windows frontend
+const PREPARE_SCREEN_CALLBACK BenchScreenModes[] =
+{
+    Emulator_PrepareScreenBW512x256, Emulator_PrepareScreenBW512x312, Emulator_PrepareScreenBW768x468,
+    Emulator_PrepareScreenBW896x624, Emulator_PrepareScreenBW1024x624,
+};
+const uint32_t BenchPalette[4] = { 0x000000, 0xB0B0B0, 0x555555, 0xFFFFFF };
+
+// Memory map setup: port 177574 bit 0 maps the screen to 000000-077777
+static void BenchSetupMemory(const Benchmark* pBench)
+{
+    g_pBoard->SetWord(0177574, true, pBench->param);
+}
+
+static uint64_t BenchGetWord(const Benchmark* pBench, int count)
+{
+    uint32_t sum = 0;
+    for (int i = 0; i < count; i++)
+        sum += g_pBoard->GetWord(pBench->address, pBench->okHaltMode);
+    g_BenchSink += sum;
+    return count;
+}
+
+static uint64_t BenchSetWord(const Benchmark* pBench, int count)
+{
+    int addrtype;
+    uint16_t value = g_pBoard->GetWordView(pBench->address, pBench->okHaltMode, false, &addrtype);
+    for (int i = 0; i < count; i++)
+        g_pBoard->SetWord(pBench->address, pBench->okHaltMode, value);
+    return count;
+}
+
+static uint64_t BenchTranslateAddress(const Benchmark* /*pBench*/, int count)
+{
+    uint32_t sum = 0;
+    uint16_t address = 0;
+    for (int i = 0; i < count; i++)
+    {
+        uint16_t offset;
+        sum += g_pBoard->TranslateAddress(address, (i & 1) != 0, false, &offset) + offset;
+        address += 0402;  // Walks over all the areas
+    }
+    g_BenchSink += sum;
+    return count;
+}
+
+// Put the program to RAM and start it in USER mode; HALT requests are masked by port 170006
+static void BenchSetupProgram(const Benchmark* pBench)
+{
+    g_pBoard->SetWord(0177574, true, 0);
+    g_pBoard->SetWord(0170006, true, 3);
+    const uint16_t* pProgram = BenchPrograms[pBench->param];
+    for (int i = 0; i < BenchProgramSizes[pBench->param] / 2; i++)
+        g_pBoard->SetRAMWord(BENCH_PROGRAM_START + i * 2, pProgram[i]);
+    CProcessor* pCPU = g_pBoard->GetCPU();
+    pCPU->SetPC(BENCH_PROGRAM_START);
+    pCPU->SetPSW(0);
+    pCPU->SetSP(000700);
+    pCPU->ClearInternalTick();
+    pCPU->InvalidateDecodedAll();
+}
+
+// One operation is one instruction, executed tick by tick
+static uint64_t BenchExecute(const Benchmark* /*pBench*/, int count)
+{
+    CProcessor* pCPU = g_pBoard->GetCPU();
+    uint64_t start = pCPU->GetInstructionCount();
+    uint64_t end = start + count;
+    while (pCPU->GetInstructionCount() < end)
+        pCPU->Execute();
+    return pCPU->GetInstructionCount() - start;
+}
+
+// One operation is one instruction, executed the way SystemFrame() does
+static uint64_t BenchExecuteUntil(const Benchmark* /*pBench*/, int count)
+{
+    CProcessor* pCPU = g_pBoard->GetCPU();
+    uint64_t start = pCPU->GetInstructionCount();
+    uint64_t end = start + count;
+    while (pCPU->GetInstructionCount() < end)
+        pCPU->ExecuteUntil(pCPU->GetCycleCount() + 256);
+    return pCPU->GetInstructionCount() - start;
+}
+
+static void CALLBACK BenchSoundCallback(unsigned short L, unsigned short R)
+{
+    g_BenchSink += L + R;
+}
+
+// Sound at octave 7, volume 3
+static void BenchSetupSound(const Benchmark* /*pBench*/)
+{
+    g_pBoard->SetSoundGenCallback(BenchSoundCallback);
+    g_pBoard->SetWord(0170030, true, 037);
+}
+
+static uint64_t BenchDoSound(const Benchmark* /*pBench*/, int count)
+{
+    for (int i = 0; i < count; i++)
+        g_pBoard->DoSound();
+    return count;
+}
+
+static void BenchSetupTracks(const Benchmark* /*pBench*/)
+{
+    for (int i = 0; i < static_cast<int>(sizeof(m_BenchTrackSource)); i++)
+        m_BenchTrackSource[i] = static_cast<uint8_t>(i * 7 + (i >> 8));
+    EncodeTrackData(m_BenchTrackSource, m_BenchTrackRaw, 1, 0);
+    EncodeTrackDataMX(m_BenchTrackSource, m_BenchTrackRawMX, 1, 0);
+}
+
+static uint64_t BenchEncodeTrack(const Benchmark* pBench, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        uint16_t track = static_cast<uint16_t>(i % 80);
+        if (pBench->param == FLOPPY_TYPE_MX)
+            EncodeTrackDataMX(m_BenchTrackSource, m_BenchTrackRaw, track, 0);
+        else
+            EncodeTrackData(m_BenchTrackSource, m_BenchTrackRaw, track, 0);
+    }
+    g_BenchSink += m_BenchTrackRaw[FLOPPY_RAWTRACKSIZE / 2];
+    return count;
+}
+
+static uint64_t BenchDecodeTrack(const Benchmark* pBench, int count)
+{
+    uint8_t data[23 * 128];
+    for (int i = 0; i < count; i++)
+    {
+        bool decoded = (pBench->param == FLOPPY_TYPE_MX) ?
+                DecodeTrackDataMX(m_BenchTrackRawMX, data, 1) : DecodeTrackData(m_BenchTrackRaw, data, 1);
+        g_BenchSink += decoded ? data[i & 0377] : 0;
+    }
+    return count;
+}
+
+static void BenchSetupDisasm(const Benchmark* /*pBench*/)
+{
+    for (uint16_t i = 0; i < 4096 / 2; i++)
+        m_BenchROM[i] = g_pBoard->GetROMWord(i * 2);
+}
+
+// Disassemble the ROM instruction by instruction
+static uint64_t BenchDisassemble(const Benchmark* /*pBench*/, int count)
+{
+    TCHAR instr[8];
+    TCHAR args[32];
+    int index = 0;
+    for (int i = 0; i < count; i++)
+    {
+        index += DisassembleInstruction(m_BenchROM + index, static_cast<uint16_t>(0160000 + index * 2), instr, args);
+        if (index >= 4096 / 2 - 3)  // The longest instruction is 3 words
+            index = 0;
+    }
+    g_BenchSink += instr[0] + args[0];
+    return count;
+}
+
+// One operation is one screen image, the video memory holds the ROM monitor screen
+static uint64_t BenchPrepareScreen(const Benchmark* pBench, int count)
+{
+    const uint8_t* pVideoBuffer = g_pBoard->GetVideoBuffer();
+    PREPARE_SCREEN_CALLBACK callback = BenchScreenModes[pBench->param];
+    for (int i = 0; i < count; i++)
+        callback(pVideoBuffer, BenchPalette, m_BenchImage);
+    g_BenchSink += m_BenchImage[512 * 128];
+    return count;
+}
+
+const Benchmark Benchmarks[] =
+{
+    { _T("GetWord/ram"),        BenchSetupMemory,  BenchGetWord,       0001000, false, 0 },
+    { _T("GetWord/ram-halt"),   BenchSetupMemory,  BenchGetWord,       0177700, true,  0 },
+    { _T("GetWord/hiram"),      BenchSetupMemory,  BenchGetWord,       0001000, false, 1 },
+    { _T("GetWord/rom"),        BenchSetupMemory,  BenchGetWord,       0160000, true,  0 },
+    { _T("GetWord/io"),         BenchSetupMemory,  BenchGetWord,       0170020, true,  0 },
+    { _T("GetWord/term"),       BenchSetupMemory,  BenchGetWord,       0177564, false, 0 },
+    { _T("GetWord/deny"),       BenchSetupMemory,  BenchGetWord,       0170040, false, 0 },
+    { _T("SetWord/ram"),        BenchSetupMemory,  BenchSetWord,       0001000, false, 0 },
+    { _T("SetWord/ram-halt"),   BenchSetupMemory,  BenchSetWord,       0177700, true,  0 },
+    { _T("SetWord/hiram"),      BenchSetupMemory,  BenchSetWord,       0001000, false, 1 },
+    { _T("SetWord/io"),         BenchSetupMemory,  BenchSetWord,       0170006, true,  0 },
+    { _T("SetWord/term"),       BenchSetupMemory,  BenchSetWord,       0177566, false, 0 },
+    { _T("TranslateAddress"),   nullptr,           BenchTranslateAddress, 0, false, 0 },
+    { _T("Execute/alu"),        BenchSetupProgram, BenchExecute,       0, false, 0 },
+    { _T("Execute/memory"),     BenchSetupProgram, BenchExecute,       0, false, 1 },
+    { _T("Execute/branch"),     BenchSetupProgram, BenchExecute,       0, false, 2 },
+    { _T("ExecuteUntil/alu"),   BenchSetupProgram, BenchExecuteUntil,  0, false, 0 },
+    { _T("ExecuteUntil/memory"), BenchSetupProgram, BenchExecuteUntil, 0, false, 1 },
+    { _T("ExecuteUntil/branch"), BenchSetupProgram, BenchExecuteUntil, 0, false, 2 },
+    { _T("DoSound"),            BenchSetupSound,   BenchDoSound,       0, false, 0 },
+    { _T("EncodeTrackData/md"), BenchSetupTracks,  BenchEncodeTrack,   0, false, FLOPPY_TYPE_MD },
+    { _T("DecodeTrackData/md"), BenchSetupTracks,  BenchDecodeTrack,   0, false, FLOPPY_TYPE_MD },
+    { _T("EncodeTrackData/mx"), BenchSetupTracks,  BenchEncodeTrack,   0, false, FLOPPY_TYPE_MX },
+    { _T("DecodeTrackData/mx"), BenchSetupTracks,  BenchDecodeTrack,   0, false, FLOPPY_TYPE_MX },
+    { _T("DisassembleInstruction"), BenchSetupDisasm, BenchDisassemble, 0, false, 0 },
+    { _T("PrepareScreen/512x256"),  nullptr,      BenchPrepareScreen, 0, false, 0 },
+    { _T("PrepareScreen/512x312"),  nullptr,      BenchPrepareScreen, 0, false, 1 },
+    { _T("PrepareScreen/768x468"),  nullptr,      BenchPrepareScreen, 0, false, 2 },
+    { _T("PrepareScreen/896x624"),  nullptr,      BenchPrepareScreen, 0, false, 3 },
+    { _T("PrepareScreen/1024x624"), nullptr,      BenchPrepareScreen, 0, false, 4 },
+};
+const int BenchmarkCount = sizeof(Benchmarks) / sizeof(Benchmark);
+
+
+//////////////////////////////////////////////////////////////////////
+// Measurement
+
+struct BenchResult
+{
+    double      nsPerOp;    // Mean of the samples
+    double      median;     // Median of the samples, used for the baseline comparison as it is less noisy
+    double      stddev;     // Standard deviation of the samples
+    double      minimum;
+    int         count;      // Operations per sample
+};
+
+// Time one run, returns nanoseconds per operation
+static double BenchMeasure(const Benchmark* pBench, int count, double* pElapsed)
+{
+    std::chrono::steady_clock::time_point timeStart = std::chrono::steady_clock::now();
+    uint64_t ops = pBench->run(pBench, count);
+    std::chrono::steady_clock::time_point timeEnd = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double, std::nano>(timeEnd - timeStart).count();
+    if (pElapsed != nullptr)
+        *pElapsed = elapsed;
+    return ops > 0 ? elapsed / ops : 0.0;
+}
+
+static void BenchRun(const Benchmark* pBench, BenchResult* pResult)
+{
+    if (pBench->setup != nullptr)
+        pBench->setup(pBench);
+
+    // Calibrate the operation count to the sample time, this also warms up the caches
+    double sampleNanoseconds = Option_SampleTime * 1000000.0;
+    int count = 16;
+    for (;;)
+    {
+        double elapsed;
+        BenchMeasure(pBench, count, &elapsed);
+        if (elapsed >= sampleNanoseconds || count >= 0x40000000)
+            break;
+        double scale = (elapsed > 0) ? sampleNanoseconds / elapsed * 1.1 : 16.0;
+        if (scale > 16.0) scale = 16.0;
+        if (scale < 2.0) scale = 2.0;
+        double next = count * scale;
+        count = (next > 0x40000000) ? 0x40000000 : static_cast<int>(next);
+    }
+
+    double samples[BENCH_MAXSAMPLES];
+    double sum = 0.0;
+    double minimum = 0.0;
+    for (int i = 0; i < Option_Samples; i++)
+    {
+        samples[i] = BenchMeasure(pBench, count, nullptr);
+        sum += samples[i];
+        if (i == 0 || samples[i] < minimum)
+            minimum = samples[i];
+    }
+    double mean = sum / Option_Samples;
+    double variance = 0.0;
+    for (int i = 0; i < Option_Samples; i++)
+        variance += (samples[i] - mean) * (samples[i] - mean);
+    variance /= Option_Samples - 1;
+
+    std::sort(samples, samples + Option_Samples);
+    pResult->nsPerOp = mean;
+    pResult->median = (Option_Samples & 1) ? samples[Option_Samples / 2] :
+            (samples[Option_Samples / 2 - 1] + samples[Option_Samples / 2]) / 2;
+    pResult->stddev = sqrt(variance);
+    pResult->minimum = minimum;
+    pResult->count = count;
+}
+
+// Find the benchmark median in the JSON file written by -json, one benchmark per line; returns 0 if not found
+static double BenchFindBaseline(FILE* fpFile, LPCTSTR name)
+{
+    ::fseek(fpFile, 0, SEEK_SET);
+    char line[256];
+    while (::fgets(line, sizeof(line), fpFile) != nullptr)
+    {
+        char linename[BENCH_MAXNAME + 1];
+        double median;
+        if (sscanf(line, " { \"name\": \"%32[^\"]\", \"ns_per_op\": %*f, \"median\": %lf", linename, &median) == 2 &&
+            _tcscmp(linename, name) == 0)
+            return median;
+    }
+    return 0.0;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+
+
+int main(int argc, char** argv)
+{
+    if (!ParseCommandLine(argc, argv))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    FILE* fpBaseline = nullptr;
+    if (Option_BaselineFile != nullptr)
+    {
+        fpBaseline = ::_tfopen(Option_BaselineFile, _T("rt"));
+        if (fpBaseline == nullptr)
+        {
+            fprintf(stderr, "Failed to open baseline file %s.\n", Option_BaselineFile);
+            return 1;
+        }
+    }
+    FILE* fpJson = nullptr;
+    if (Option_JsonFile != nullptr)
+    {
+        fpJson = ::_tfopen(Option_JsonFile, _T("wt"));
+        if (fpJson == nullptr)
+        {
+            fprintf(stderr, "Failed to create file %s.\n", Option_JsonFile);
+            if (fpBaseline != nullptr) ::fclose(fpBaseline);
+            return 1;
+        }
+    }
+
+    if (!Emulator_Init())
+        return 1;
+    if (!Emulator_InitConfiguration(Option_Configuration, Option_RomFile))
+    {
+        Emulator_Done();
+        return 1;
+    }
+    while (Emulator_GetFrameCount() < BENCH_INIT_FRAMES)
+        Emulator_SystemFrame();
+
+    printf("Configuration: %s, %d samples of %d ms\n", Emulator_GetConfigurationName(), Option_Samples, Option_SampleTime);
+    printf("%-24s %10s %10s %8s %10s %11s%s\n", "Benchmark", "ns/op", "median", "stddev", "min", "ops/sample",
+            fpBaseline != nullptr ? "   baseline" : "");
+    if (fpJson != nullptr)
+    {
+        fprintf(fpJson, "{\n");
+        fprintf(fpJson, "  \"configuration\": \"%s\",\n", Emulator_GetConfigurationName());
+        fprintf(fpJson, "  \"samples\": %d,\n", Option_Samples);
+        fprintf(fpJson, "  \"benchmarks\": [");
+    }
+
+    int regressions = 0;
+    bool okFirst = true;
+    for (int i = 0; i < BenchmarkCount; i++)
+    {
+        const Benchmark* pBench = Benchmarks + i;
+        if (Option_Filter != nullptr && strstr(pBench->name, Option_Filter) == nullptr)
+            continue;
+
+        BenchResult result;
+        BenchRun(pBench, &result);
+        printf("%-24s %10.2f %10.2f %7.1f%% %10.2f %11d", pBench->name, result.nsPerOp, result.median,
+                result.nsPerOp > 0 ? result.stddev * 100.0 / result.nsPerOp : 0.0, result.minimum, result.count);
+        if (fpBaseline != nullptr)
+        {
+            double baseline = BenchFindBaseline(fpBaseline, pBench->name);
+            if (baseline > 0)
+            {
+                double change = (result.median - baseline) * 100.0 / baseline;
+                bool okRegression = change > Option_Threshold;
+                printf("   %+6.1f%%%s", change, okRegression ? "  SLOWER" : "");
+                if (okRegression)
+                    regressions++;
+            }
+        }
+        printf("\n");
+        fflush(stdout);
+
+        if (fpJson != nullptr)
+        {
+            fprintf(fpJson, "%s\n    { \"name\": \"%s\", \"ns_per_op\": %.3f, \"median\": %.3f, \"stddev\": %.3f, \"min\": %.3f, \"ops\": %d }",
+                    okFirst ? "" : ",", pBench->name, result.nsPerOp, result.median, result.stddev, result.minimum, result.count);
+        }
+        okFirst = false;
+    }
+
+    if (fpJson != nullptr)
+    {
+        fprintf(fpJson, "%s]\n}\n", okFirst ? "" : "\n  ");
+        ::fclose(fpJson);
+    }
+    if (fpBaseline != nullptr)
+        ::fclose(fpBaseline);
+    Emulator_Done();
+
+    if (regressions > 0)
+    {
+        printf("%d benchmark(s) slower than the baseline by more than %.1f%%.\n", regressions, Option_Threshold);
+        return 2;
+    }
+    return 0;
+}
+
+
+//////////////////////////////////////////////////////////////////////
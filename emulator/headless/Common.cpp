@@ -0,0 +1,152 @@
+﻿/*  This file is part of NEMIGABTL.
+    NEMIGABTL is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software Foundation,
+either version 3 of the License, or (at your option) any later version.
+    NEMIGABTL is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU Lesser General Public License for more details.
+    You should have received a copy of the GNU Lesser General Public License along with
+NEMIGABTL. If not, see <http://www.gnu.org/licenses/>. */
+
+// Common.cpp  Headless frontend: alerts, debug log, helpers
+
+#include "stdafx.h"
+
+//////////////////////////////////////////////////////////////////////
+
+
+BOOL AssertFailedLine(LPCSTR lpszFileName, int nLine)
+{
+    fprintf(stderr, "ASSERTION FAILED: File: %s Line: %d\n", lpszFileName, nLine);
+    return TRUE;
+}
+
+void AlertWarning(LPCTSTR sMessage)
+{
+    fprintf(stderr, "%s\n", sMessage);
+}
+void AlertWarningFormat(LPCTSTR sFormat, ...)
+{
+    const size_t buffersize = 512;
+    TCHAR buffer[buffersize];
+
+    va_list ptr;
+    va_start(ptr, sFormat);
+    _vsntprintf(buffer, buffersize - 1, sFormat, ptr);
+    va_end(ptr);
+
+    AlertWarning(buffer);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// DebugPrint and DebugLog
+
+void DebugPrint(LPCTSTR message)
+{
+    fputs(message, stdout);
+}
+
+void DebugPrintFormat(LPCTSTR pszFormat, ...)
+{
+    const size_t buffersize = 512;
+    TCHAR buffer[buffersize];
+
+    va_list ptr;
+    va_start(ptr, pszFormat);
+    _vsntprintf(buffer, buffersize - 1, pszFormat, ptr);
+    va_end(ptr);
+
+    DebugPrint(buffer);
+}
+
+// The log is written only after DebugLogOpenFile(), a batch run leaves no files behind by default
+LPCTSTR Common_LogFileName = nullptr;
+FILE* Common_LogFile = nullptr;
+
+bool DebugLogOpenFile(LPCTSTR sFileName)
+{
+    DebugLogCloseFile();
+    Common_LogFileName = sFileName;
+    Common_LogFile = ::fopen(sFileName, "wb");
+    return Common_LogFile != nullptr;
+}
+
+void DebugLogCloseFile()
+{
+    if (Common_LogFile == nullptr)
+        return;
+
+    ::fclose(Common_LogFile);
+    Common_LogFile = nullptr;
+}
+
+void DebugLogClear()
+{
+    if (Common_LogFile == nullptr)
+        return;
+    DebugLogOpenFile(Common_LogFileName);
+}
+
+void DebugLog(LPCTSTR message)
+{
+    if (Common_LogFile == nullptr)
+        return;
+
+    ::fputs(message, Common_LogFile);
+}
+
+void DebugLogFormat(LPCTSTR pszFormat, ...)
+{
+    const size_t buffersize = 512;
+    TCHAR buffer[buffersize];
+
+    va_list ptr;
+    va_start(ptr, pszFormat);
+    _vsntprintf(buffer, buffersize - 1, pszFormat, ptr);
+    va_end(ptr);
+
+    DebugLog(buffer);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+
+
+// Названия регистров процессора
+const TCHAR* REGISTER_NAME[] = { _T("R0"), _T("R1"), _T("R2"), _T("R3"), _T("R4"), _T("R5"), _T("SP"), _T("PC") };
+
+// Print octal 16-bit value to buffer
+// buffer size at least 7 characters
+void PrintOctalValue(TCHAR* buffer, WORD value)
+{
+    for (int p = 0; p < 6; p++)
+    {
+        int digit = value & 7;
+        buffer[5 - p] = _T('0') + (TCHAR)digit;
+        value = (value >> 3);
+    }
+    buffer[6] = 0;
+}
+
+// Parse octal value from text
+bool ParseOctalValue(LPCTSTR text, WORD* pValue)
+{
+    WORD value = 0;
+    TCHAR* pChar = (TCHAR*)text;
+    for (int p = 0; ; p++)
+    {
+        if (p > 6) return false;
+        TCHAR ch = *pChar;  pChar++;
+        if (ch == 0) break;
+        if (ch < _T('0') || ch > _T('7')) return false;
+        value = (value << 3);
+        TCHAR digit = ch - _T('0');
+        value += digit;
+    }
+    *pValue = value;
+    return true;
+}
+
+
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,61 @@
+﻿/*  This file is part of NEMIGABTL.
+    NEMIGABTL is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software Foundation,
+either version 3 of the License, or (at your option) any later version.
+    NEMIGABTL is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU Lesser General Public License for more details.
+    You should have received a copy of the GNU Lesser General Public License along with
+NEMIGABTL. If not, see <http://www.gnu.org/licenses/>. */
+
+// Common.h  Headless frontend: common declarations
+
+#pragma once
+
+//////////////////////////////////////////////////////////////////////
+// Assertions checking - MFC-like ASSERT macro
+
+#ifdef _DEBUG
+
+BOOL AssertFailedLine(LPCSTR lpszFileName, int nLine);
+#define ASSERT(f)          (void) ((f) || !AssertFailedLine(__FILE__, __LINE__) || (abort(), 0))
+#define VERIFY(f)          ASSERT(f)
+
+#else   // _DEBUG
+
+#define ASSERT(f)          ((void)0)
+#define VERIFY(f)          ((void)f)
+
+#endif // !_DEBUG
+
+
+//////////////////////////////////////////////////////////////////////
+// Alerts
+
+void AlertWarning(LPCTSTR sMessage);
+void AlertWarningFormat(LPCTSTR sFormat, ...);
+
+
+//////////////////////////////////////////////////////////////////////
+// DebugPrint and DebugLog
+
+void DebugPrint(LPCTSTR message);
+void DebugPrintFormat(LPCTSTR pszFormat, ...);
+bool DebugLogOpenFile(LPCTSTR sFileName);  // Start writing the log, there is no log by default
+void DebugLogClear();
+void DebugLogCloseFile();
+void DebugLog(LPCTSTR message);
+void DebugLogFormat(LPCTSTR pszFormat, ...);
+
+
+//////////////////////////////////////////////////////////////////////
+
+
+// Processor register names
+extern const TCHAR* REGISTER_NAME[];
+
+void PrintOctalValue(TCHAR* buffer, WORD value);
+bool ParseOctalValue(LPCTSTR text, WORD* pValue);
+
+
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,632 @@
+﻿/*  This file is part of NEMIGABTL.
+    NEMIGABTL is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software Foundation,
+either version 3 of the License, or (at your option) any later version.
+    NEMIGABTL is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU Lesser General Public License for more details.
+    You should have received a copy of the GNU Lesser General Public License along with
+NEMIGABTL. If not, see <http://www.gnu.org/licenses/>. */
+
+// Emulator.cpp  Headless frontend: emulator control
+
+#include "stdafx.h"
+#include "Emulator.h"
+#include "../emubase/Emubase.h"
+
+//////////////////////////////////////////////////////////////////////
+
+
+CMotherboard* g_pBoard = nullptr;
+int g_nEmulatorConfiguration = 0;  // Current configuration
+
+CBreakpointList m_EmulatorStopBps;  // Stop address, as breakpoint list
+CWatchpointList m_EmulatorWatches;
+CTraceWriter m_EmulatorTraceWriter;
+CProfiler* m_pEmulatorProfiler = nullptr;
+const int PROFILE_REPORT_LINES = 100;  // Hot spot lines in the profile report
+// HALT monitor call causes, bits of port 170007 then HALTCAUSE_NONE
+const LPCTSTR HaltCauseNames[HALTCAUSE_COUNT] =
+{
+    _T("bit0"), _T("bit1"), _T("keyboard"), _T("bit3"), _T("timer"), _T("kbd_read"), _T("ttd_write"), _T("bit7"), _T("other")
+};
+
+long m_nFrameCount = 0;
+
+const int KEYBOARD_QUEUE_SIZE = 256;
+char m_EmulatorKeyQueue[KEYBOARD_QUEUE_SIZE];
+int m_nEmulatorKeyQueueTop = 0;
+int m_nEmulatorKeyQueueBottom = 0;
+int m_nEmulatorKeyQueueCount = 0;
+const int KEYBOARD_FRAMES_PER_KEY = 4;  // Frames to wait after every key press
+
+
+//////////////////////////////////////////////////////////////////////
+
+
+const LPCTSTR FILENAME_ROM_303 = _T("nemiga-303.rom");
+const LPCTSTR FILENAME_ROM_405 = _T("nemiga-405.rom");
+const LPCTSTR FILENAME_ROM_406 = _T("nemiga-406.rom");
+const LPCTSTR FILENAME_LST_303 = _T("nemiga-303.lst");
+const LPCTSTR FILENAME_LST_405 = _T("nemiga-405.lst");
+const LPCTSTR FILENAME_LST_406 = _T("nemiga-406.lst");
+
+
+//////////////////////////////////////////////////////////////////////
+
+bool Emulator_LoadRomFile(LPCTSTR strFileName, uint8_t* buffer, uint32_t fileOffset, uint32_t bytesToRead)
+{
+    FILE* fpRomFile = ::_tfopen(strFileName, _T("rb"));
+    if (fpRomFile == nullptr)
+        return false;
+
+    ::memset(buffer, 0, bytesToRead);
+
+    if (fileOffset > 0)
+    {
+        ::fseek(fpRomFile, fileOffset, SEEK_SET);
+    }
+
+    size_t dwBytesRead = ::fread(buffer, 1, bytesToRead, fpRomFile);
+    if (dwBytesRead != bytesToRead)
+    {
+        ::fclose(fpRomFile);
+        return false;
+    }
+
+    ::fclose(fpRomFile);
+
+    return true;
+}
+
+bool Emulator_Init()
+{
+    ASSERT(g_pBoard == nullptr);
+
+    g_pBoard = new CMotherboard();
+
+    g_pBoard->Reset();
+
+    return true;
+}
+
+void Emulator_Done()
+{
+    ASSERT(g_pBoard != nullptr);
+
+    g_pBoard->SetTraceWriter(nullptr);
+    m_EmulatorTraceWriter.Close();
+    g_pBoard->GetCPU()->SetProfiler(nullptr);
+    delete m_pEmulatorProfiler;
+    m_pEmulatorProfiler = nullptr;
+
+    delete g_pBoard;
+    g_pBoard = nullptr;
+
+    DebugLogCloseFile();
+}
+
+bool Emulator_InitConfiguration(uint16_t configuration, LPCTSTR sRomFileName)
+{
+    g_pBoard->SetConfiguration(configuration);
+
+    LPCTSTR szRomFileName = nullptr;
+    switch (configuration)
+    {
+    default:
+    case EMU_CONF_NEMIGA303:
+        szRomFileName = FILENAME_ROM_303;
+        break;
+    case EMU_CONF_NEMIGA405:
+        szRomFileName = FILENAME_ROM_405;
+        break;
+    case EMU_CONF_NEMIGA406:
+        szRomFileName = FILENAME_ROM_406;
+        break;
+    }
+
+    uint8_t buffer[4096];
+
+    // Load ROM file: given path, then current directory, then the ROM directory of the source tree
+    bool okLoaded;
+    if (sRomFileName != nullptr)
+        okLoaded = Emulator_LoadRomFile(sRomFileName, buffer, 0, 4096);
+    else
+    {
+        okLoaded = Emulator_LoadRomFile(szRomFileName, buffer, 0, 4096);
+#ifdef NEMIGABTL_ROM_DIR
+        if (!okLoaded)
+        {
+            TCHAR rompath[1024];
+            _sntprintf(rompath, sizeof(rompath) / sizeof(TCHAR) - 1, _T("%s/%s"), NEMIGABTL_ROM_DIR, szRomFileName);
+            okLoaded = Emulator_LoadRomFile(rompath, buffer, 0, 4096);
+        }
+#endif
+    }
+    if (!okLoaded)
+    {
+        AlertWarningFormat(_T("Failed to load the ROM file %s."), sRomFileName != nullptr ? sRomFileName : szRomFileName);
+        return false;
+    }
+    g_pBoard->LoadROM(buffer);
+
+    g_nEmulatorConfiguration = configuration;
+
+    g_pBoard->Reset();
+
+    m_nFrameCount = 0;
+
+    return true;
+}
+
+LPCTSTR Emulator_GetConfigurationName()
+{
+    uint16_t configuration = g_pBoard->GetConfiguration();
+
+    switch (configuration)
+    {
+    default:
+    case EMU_CONF_NEMIGA303:  return _T("NEMIGA 3.03");
+    case EMU_CONF_NEMIGA405:  return _T("NEMIGA 4.05");
+    case EMU_CONF_NEMIGA406:  return _T("NEMIGA 4.06");
+    }
+}
+
+bool Emulator_AttachFloppyImage(int slot, LPCTSTR sFileName)
+{
+    if (slot < 0 || slot > 3)
+        return false;
+    return g_pBoard->AttachFloppyImage(slot, sFileName);
+}
+
+bool Emulator_AttachFloppyMXImage(int slot, LPCTSTR sFileName)
+{
+    if (slot != 0 && slot != 2)
+        return false;
+    return g_pBoard->AttachFloppyMXImage(slot, sFileName);
+}
+
+bool Emulator_SetStopAddress(uint16_t address, LPCTSTR condition)
+{
+    m_EmulatorStopBps.RemoveAll();
+    if (address != 0177777 && !m_EmulatorStopBps.Add(address, condition))
+        return false;
+    g_pBoard->SetCPUBreakpoints(address != 0177777 ? &m_EmulatorStopBps : nullptr);
+    return true;
+}
+
+bool Emulator_AddWatchpoint(uint16_t start, uint16_t end, uint8_t flags)
+{
+    if (!m_EmulatorWatches.Add(start, end, flags))
+        return false;
+    g_pBoard->SetWatchpoints(&m_EmulatorWatches);
+    return true;
+}
+
+bool Emulator_StartTrace(LPCTSTR sFileName)
+{
+    if (!m_EmulatorTraceWriter.Open(sFileName))
+        return false;
+    g_pBoard->SetTraceWriter(&m_EmulatorTraceWriter);
+    g_pBoard->SetTrace(g_pBoard->GetTrace() | TRACE_CPU);
+    return true;
+}
+
+uint64_t Emulator_GetTraceRecordCount()
+{
+    return m_EmulatorTraceWriter.GetRecordCount();
+}
+
+void Emulator_StartProfile()
+{
+    if (m_pEmulatorProfiler == nullptr)
+        m_pEmulatorProfiler = new CProfiler();
+    m_pEmulatorProfiler->Clear();
+    g_pBoard->GetCPU()->SetProfiler(m_pEmulatorProfiler);
+}
+
+// Load the symbols: given listings, or the listing for the configuration from the current directory
+// or from the docs directory of the source tree
+static void Emulator_LoadSymbols(CSymbolTable* pSymbols, const LPCTSTR* pSymbolFiles, int symbolFileCount)
+{
+    for (int i = 0; i < symbolFileCount; i++)
+    {
+        if (!pSymbols->LoadListing(pSymbolFiles[i]))
+            AlertWarningFormat(_T("Failed to load the symbols file %s."), pSymbolFiles[i]);
+    }
+    if (symbolFileCount > 0)
+        return;
+
+    LPCTSTR szListingFileName;
+    switch (g_nEmulatorConfiguration)
+    {
+    default:
+    case EMU_CONF_NEMIGA303:
+        szListingFileName = FILENAME_LST_303;
+        break;
+    case EMU_CONF_NEMIGA405:
+        szListingFileName = FILENAME_LST_405;
+        break;
+    case EMU_CONF_NEMIGA406:
+        szListingFileName = FILENAME_LST_406;
+        break;
+    }
+    if (pSymbols->LoadListing(szListingFileName))
+        return;
+#ifdef NEMIGABTL_DOCS_DIR
+    TCHAR lstpath[1024];
+    _sntprintf(lstpath, sizeof(lstpath) / sizeof(TCHAR) - 1, _T("%s/%s"), NEMIGABTL_DOCS_DIR, szListingFileName);
+    pSymbols->LoadListing(lstpath);
+#endif
+}
+
+bool Emulator_SaveProfile(LPCTSTR sFileName, LPCTSTR sStacksFileName, const LPCTSTR* pSymbolFiles, int symbolFileCount)
+{
+    if (m_pEmulatorProfiler == nullptr)
+        return false;
+
+    CSymbolTable symbols;
+    Emulator_LoadSymbols(&symbols, pSymbolFiles, symbolFileCount);
+    if (sFileName != nullptr && !m_pEmulatorProfiler->SaveReport(sFileName, &symbols, PROFILE_REPORT_LINES))
+        return false;
+    return sStacksFileName == nullptr || m_pEmulatorProfiler->SaveCollapsedStacks(sStacksFileName, &symbols);
+}
+
+bool Emulator_SaveCounters(LPCTSTR sFileName, uint64_t hostNanoseconds)
+{
+    FILE* fpFile = ::_tfopen(sFileName, _T("wt"));
+    if (fpFile == nullptr)
+        return false;
+
+    const BoardCounters& counters = g_pBoard->GetCounters();
+    const CProcessor* pCPU = g_pBoard->GetCPU();
+    const ProcessorCounters& cpucounters = pCPU->GetCounters();
+    uint64_t cycles = pCPU->GetCycleCount();
+    uint64_t modecycles = cpucounters.modecycles[0] + cpucounters.modecycles[1];
+
+    fprintf(fpFile, "{\n");
+    fprintf(fpFile, "  \"configuration\": \"%s\",\n", Emulator_GetConfigurationName());
+    fprintf(fpFile, "  \"frames\": %ld,\n", m_nFrameCount);
+    fprintf(fpFile, "  \"cpu\": {\n");
+    fprintf(fpFile, "    \"instructions\": %llu,\n", static_cast<unsigned long long>(pCPU->GetInstructionCount()));
+    fprintf(fpFile, "    \"cycles\": %llu,\n", static_cast<unsigned long long>(cycles));
+    fprintf(fpFile, "    \"user_cycles\": %llu,\n", static_cast<unsigned long long>(cpucounters.modecycles[0]));
+    fprintf(fpFile, "    \"halt_cycles\": %llu,\n", static_cast<unsigned long long>(cpucounters.modecycles[1]));
+    // The rest is WAIT and the interrupt entry ticks
+    fprintf(fpFile, "    \"wait_cycles\": %llu,\n", static_cast<unsigned long long>(cycles > modecycles ? cycles - modecycles : 0));
+    fprintf(fpFile, "    \"idle_skipped\": %llu,\n", static_cast<unsigned long long>(pCPU->GetIdleCycleCount()));
+    fprintf(fpFile, "    \"interrupts\": [");
+    bool okFirst = true;
+    for (int mode = 0; mode < 2; mode++)
+    {
+        for (int i = 0; i < 0200; i++)
+        {
+            if (cpucounters.interrupts[mode][i] == 0)
+                continue;
+            fprintf(fpFile, "%s\n      { \"mode\": \"%s\", \"vector\": \"%06o\", \"count\": %llu }",
+                    okFirst ? "" : ",", mode ? "halt" : "user", (mode ? 0160000 : 0) + i * 2,
+                    static_cast<unsigned long long>(cpucounters.interrupts[mode][i]));
+            okFirst = false;
+        }
+    }
+    fprintf(fpFile, "%s]\n", okFirst ? "" : "\n    ");
+    fprintf(fpFile, "  },\n");
+    fprintf(fpFile, "  \"halt_monitor\": [");
+    okFirst = true;
+    for (int cause = 0; cause < HALTCAUSE_COUNT; cause++)
+    {
+        uint64_t entries = cpucounters.haltentries[cause];
+        if (entries == 0)
+            continue;
+        fprintf(fpFile, "%s\n    { \"cause\": \"%s\", \"entries\": %llu, \"cycles\": %llu, \"share\": %.4f,",
+                okFirst ? "" : ",", HaltCauseNames[cause], static_cast<unsigned long long>(entries),
+                static_cast<unsigned long long>(cpucounters.haltcycles[cause]),
+                cycles > 0 ? static_cast<double>(cpucounters.haltcycles[cause]) / cycles : 0.0);
+        // Latency histogram up to the last non-empty bucket, bucket N is 2^N to 2^(N+1)-1 cycles
+        const uint64_t* latency = cpucounters.haltlatency[cause];
+        int bucketCount = HALTLATENCY_BUCKETS;
+        while (bucketCount > 0 && latency[bucketCount - 1] == 0)
+            bucketCount--;
+        fprintf(fpFile, " \"latency_log2\": [");
+        for (int bucket = 0; bucket < bucketCount; bucket++)
+            fprintf(fpFile, "%s%llu", bucket > 0 ? ", " : "", static_cast<unsigned long long>(latency[bucket]));
+        fprintf(fpFile, "] }");
+        okFirst = false;
+    }
+    fprintf(fpFile, "%s],\n", okFirst ? "" : "\n  ");
+    // Plain RAM and ROM pages and the decoded instruction cache bypass TranslateAddress(), they are not counted
+    fprintf(fpFile, "  \"slow_path_accesses\": {\n");
+    fprintf(fpFile, "    \"ram\": %llu,\n", static_cast<unsigned long long>(counters.addrtypes[ADDRTYPE_RAM]));
+    fprintf(fpFile, "    \"hiram\": %llu,\n", static_cast<unsigned long long>(counters.addrtypes[ADDRTYPE_HIRAM]));
+    fprintf(fpFile, "    \"rom\": %llu,\n", static_cast<unsigned long long>(counters.addrtypes[ADDRTYPE_ROM]));
+    fprintf(fpFile, "    \"io\": %llu,\n", static_cast<unsigned long long>(counters.addrtypes[ADDRTYPE_IO]));
+    fprintf(fpFile, "    \"term\": %llu,\n", static_cast<unsigned long long>(counters.addrtypes[ADDRTYPE_TERM]));
+    fprintf(fpFile, "    \"deny\": %llu\n", static_cast<unsigned long long>(counters.addrtypes[ADDRTYPE_DENY]));
+    fprintf(fpFile, "  },\n");
+    fprintf(fpFile, "  \"ports\": [");
+    okFirst = true;
+    for (int i = 0; i < BOARDCOUNTERS_PORTS; i++)
+    {
+        if (counters.portreads[i] == 0 && counters.portwrites[i] == 0)
+            continue;
+        fprintf(fpFile, "%s\n    { \"port\": \"%06o\", \"reads\": %llu, \"writes\": %llu }",
+                okFirst ? "" : ",", 0170000 + i * 2,
+                static_cast<unsigned long long>(counters.portreads[i]), static_cast<unsigned long long>(counters.portwrites[i]));
+        okFirst = false;
+    }
+    fprintf(fpFile, "%s],\n", okFirst ? "" : "\n  ");
+    fprintf(fpFile, "  \"floppy\": { \"track_loads\": %llu, \"track_flushes\": %llu },\n",
+            static_cast<unsigned long long>(counters.trackloads), static_cast<unsigned long long>(counters.trackflushes));
+    uint64_t boardNanoseconds = counters.hostcpu + counters.hostdevices;
+    fprintf(fpFile, "  \"host_ns\": { \"total\": %llu, \"cpu\": %llu, \"devices\": %llu, \"frontend\": %llu }\n",
+            static_cast<unsigned long long>(hostNanoseconds),
+            static_cast<unsigned long long>(counters.hostcpu), static_cast<unsigned long long>(counters.hostdevices),
+            static_cast<unsigned long long>(hostNanoseconds > boardNanoseconds ? hostNanoseconds - boardNanoseconds : 0));
+    fprintf(fpFile, "}\n");
+
+    ::fclose(fpFile);
+    return true;
+}
+
+void Emulator_KeyboardSequence(const char* str)
+{
+    while (*str != 0 && m_nEmulatorKeyQueueCount < KEYBOARD_QUEUE_SIZE)
+    {
+        char ch = *str++;
+        if (ch == '\n') ch = '\r';
+        m_EmulatorKeyQueue[m_nEmulatorKeyQueueTop] = ch;
+        m_nEmulatorKeyQueueTop = (m_nEmulatorKeyQueueTop + 1) % KEYBOARD_QUEUE_SIZE;
+        m_nEmulatorKeyQueueCount++;
+    }
+}
+
+bool Emulator_IsKeyboardQueueEmpty()
+{
+    return m_nEmulatorKeyQueueCount == 0;
+}
+
+static void Emulator_ProcessKeyboardQueue()
+{
+    if (m_nEmulatorKeyQueueCount == 0 || m_nFrameCount % KEYBOARD_FRAMES_PER_KEY != 0)
+        return;
+
+    uint8_t ch = static_cast<uint8_t>(m_EmulatorKeyQueue[m_nEmulatorKeyQueueBottom]);
+    m_nEmulatorKeyQueueBottom = (m_nEmulatorKeyQueueBottom + 1) % KEYBOARD_QUEUE_SIZE;
+    m_nEmulatorKeyQueueCount--;
+
+    g_pBoard->KeyboardEvent(ch, true);
+}
+
+bool Emulator_SystemFrame()
+{
+    Emulator_ProcessKeyboardQueue();
+
+    if (!g_pBoard->SystemFrame())
+        return false;
+
+    m_nFrameCount++;
+
+    return true;
+}
+
+long Emulator_GetFrameCount()
+{
+    return m_nFrameCount;
+}
+
+uint32_t Emulator_GetStateHash()
+{
+    // FNV-1a hash
+    uint32_t hash = 2166136261u;
+    for (uint32_t offset = 0; offset < 0x10000; offset++)
+    {
+        hash = (hash ^ g_pBoard->GetRAMByte(static_cast<uint16_t>(offset))) * 16777619u;
+        hash = (hash ^ g_pBoard->GetHIRAMByte(static_cast<uint16_t>(offset))) * 16777619u;
+    }
+    const CProcessor* pCPU = g_pBoard->GetCPU();
+    for (int r = 0; r < 8; r++)
+    {
+        uint16_t value = pCPU->GetReg(r);
+        hash = (hash ^ (value & 0xff)) * 16777619u;
+        hash = (hash ^ (value >> 8)) * 16777619u;
+    }
+    hash = (hash ^ (pCPU->GetPSW() & 0xff)) * 16777619u;
+    hash = (hash ^ (pCPU->GetPSW() >> 8)) * 16777619u;
+
+    return hash;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+//
+// Emulator image format - see CMotherboard::SaveToImage(), same as the Windows frontend
+// Image header format (32 bytes):
+//   4 bytes        NEMIGAIMAGE_HEADER1
+//   4 bytes        NEMIGAIMAGE_HEADER2
+//   4 bytes        NEMIGAIMAGE_VERSION
+//   4 bytes        NEMIGAIMAGE_SIZE
+//   4 bytes        NEMIGA uptime
+//   12 bytes       Not used
+
+bool Emulator_SaveImage(LPCTSTR sFileName)
+{
+    FILE* fpFile = ::_tfopen(sFileName, _T("wb"));
+    if (fpFile == nullptr)
+        return false;
+
+    uint8_t* pImage = static_cast<uint8_t*>(::calloc(NEMIGAIMAGE_SIZE, 1));
+    if (pImage == nullptr)
+    {
+        ::fclose(fpFile);
+        return false;
+    }
+    uint32_t* pHeader = reinterpret_cast<uint32_t*>(pImage);
+    *pHeader++ = NEMIGAIMAGE_HEADER1;
+    *pHeader++ = NEMIGAIMAGE_HEADER2;
+    *pHeader++ = NEMIGAIMAGE_VERSION;
+    *pHeader++ = NEMIGAIMAGE_SIZE;
+    g_pBoard->SaveToImage(pImage);
+    *reinterpret_cast<uint32_t*>(pImage + 16) = static_cast<uint32_t>(m_nFrameCount / 25);
+
+    size_t dwBytesWritten = ::fwrite(pImage, 1, NEMIGAIMAGE_SIZE, fpFile);
+    ::free(pImage);
+    ::fclose(fpFile);
+    return dwBytesWritten == NEMIGAIMAGE_SIZE;
+}
+
+bool Emulator_LoadImage(LPCTSTR sFileName)
+{
+    FILE* fpFile = ::_tfopen(sFileName, _T("rb"));
+    if (fpFile == nullptr)
+        return false;
+
+    uint8_t* pImage = static_cast<uint8_t*>(::calloc(NEMIGAIMAGE_SIZE, 1));
+    if (pImage == nullptr)
+    {
+        ::fclose(fpFile);
+        return false;
+    }
+    size_t dwBytesRead = ::fread(pImage, 1, NEMIGAIMAGE_SIZE, fpFile);
+    ::fclose(fpFile);
+    const uint32_t* pHeader = reinterpret_cast<const uint32_t*>(pImage);
+    if (dwBytesRead != NEMIGAIMAGE_SIZE || pHeader[0] != NEMIGAIMAGE_HEADER1 || pHeader[1] != NEMIGAIMAGE_HEADER2 ||
+        pHeader[2] != NEMIGAIMAGE_VERSION || pHeader[3] != NEMIGAIMAGE_SIZE)
+    {
+        ::free(pImage);
+        return false;
+    }
+
+    g_pBoard->Reset();
+    g_pBoard->LoadFromImage(pImage);
+    g_nEmulatorConfiguration = g_pBoard->GetConfiguration();
+    ::free(pImage);
+
+    return true;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+//
+// RT-11 .SAV image: memory image from address 0, block 0 holds the system communication area:
+//   040            Start address, odd means no start address
+//   042            Initial stack pointer, 0 means 1000
+//   044            Job status word
+//   050            Highest address used by the program
+//   054            Resident monitor base address, filled by the monitor
+
+#define SAVFILE_MAXSIZE     0157000  // Program area, the monitor stub is above
+#define SAVFILE_STUB        0157400  // Monitor stub address, see SavMonitorStub
+#define SAVFILE_RMON        0157000  // Empty resident monitor area for the @#54 offsets
+
+// Minimal monitor for the programs started without RT-11: EMT handler for .EXIT, .TTYOUT, .PRINT
+// and .TTYIN through the terminal registers served by the ROM, other requests return success
+const uint16_t SavMonitorStub[] =
+{
+    010046,                   // 157400  MOV R0, -(SP)
+    010146,                   // 157402  MOV R1, -(SP)
+    016601, 000004,           // 157404  MOV 4(SP), R1        ; Return address
+    016101, 0177776,          // 157410  MOV -2(R1), R1       ; EMT instruction
+    042701, 0177400,          // 157414  BIC #177400, R1
+    020127, 000350,           // 157420  CMP R1, #350         ; .EXIT
+    001417,                   // 157424  BEQ 157464
+    020127, 000341,           // 157426  CMP R1, #341         ; .TTYOUT
+    001416,                   // 157432  BEQ 157470
+    020127, 000351,           // 157434  CMP R1, #351         ; .PRINT
+    001416,                   // 157440  BEQ 157476
+    020127, 000340,           // 157442  CMP R1, #340         ; .TTYIN
+    001433,                   // 157446  BEQ 157536
+    012601,                   // 157450  MOV (SP)+, R1
+    012600,                   // 157452  MOV (SP)+, R0
+    042766, 000001, 000002,   // 157454  BIC #1, 2(SP)        ; Clear carry - success
+    000002,                   // 157462  RTI
+    000000,                   // 157464  HALT                 ; Exit to the ROM monitor
+    000776,                   // 157466  BR 157464
+    0110037, 0177566,         // 157470  MOVB R0, @#177566
+    000765,                   // 157474  BR 157450
+    010001,                   // 157476  MOV R0, R1
+    0112100,                  // 157500  MOVB (R1)+, R0
+    001406,                   // 157502  BEQ 157520
+    0120027, 000200,          // 157504  CMPB R0, #200
+    001757,                   // 157510  BEQ 157450
+    0110037, 0177566,         // 157512  MOVB R0, @#177566
+    000770,                   // 157516  BR 157500
+    0112737, 000015, 0177566, // 157520  MOVB #15, @#177566
+    0112737, 000012, 0177566, // 157526  MOVB #12, @#177566
+    000745,                   // 157534  BR 157450
+    0105737, 0177560,         // 157536  TSTB @#177560
+    0100375,                  // 157542  BPL 157536
+    0113700, 0177562,         // 157544  MOVB @#177562, R0
+    012601,                   // 157550  MOV (SP)+, R1
+    005726,                   // 157552  TST (SP)+            ; Keep the character in R0
+    000737,                   // 157554  BR 157454
+};
+
+// Write the word as the program sees it, the ROM 4.0x screen mapping included
+static void Emulator_SetUserWord(uint16_t address, uint16_t word)
+{
+    uint16_t offset;
+    if (g_pBoard->TranslateAddress(address, false, false, &offset) == ADDRTYPE_HIRAM)
+        g_pBoard->SetHIRAMWord(offset, word);
+    else
+        g_pBoard->SetRAMWord(offset, word);
+}
+
+bool Emulator_RunSavFile(LPCTSTR sFileName, bool okMonitorStub)
+{
+    FILE* fpFile = ::_tfopen(sFileName, _T("rb"));
+    if (fpFile == nullptr)
+    {
+        AlertWarningFormat(_T("Failed to open the file %s."), sFileName);
+        return false;
+    }
+    uint16_t* pImage = static_cast<uint16_t*>(::calloc(SAVFILE_MAXSIZE / 2, 2));
+    if (pImage == nullptr)
+    {
+        ::fclose(fpFile);
+        return false;
+    }
+    size_t size = ::fread(pImage, 1, SAVFILE_MAXSIZE, fpFile);
+    bool okTooBig = (::fgetc(fpFile) != EOF);
+    ::fclose(fpFile);
+
+    uint16_t start = pImage[040 / 2];
+    uint16_t stack = pImage[042 / 2] != 0 ? pImage[042 / 2] : 01000;
+    if (size < 01000 || (size & 0777) != 0 || okTooBig || (start & 1) != 0 || start >= size ||
+        (okMonitorStub && pImage[050 / 2] >= SAVFILE_RMON))
+    {
+        AlertWarningFormat(_T("The file %s is not an RT-11 .SAV image or does not fit the memory."), sFileName);
+        ::free(pImage);
+        return false;
+    }
+
+    // Block 0: the communication area 040-053 and the stack area, vectors and 054-377 belong to the monitor
+    for (uint16_t address = 040; address < 054; address += 2)
+        Emulator_SetUserWord(address, pImage[address / 2]);
+    for (uint16_t address = 0400; address < size; address += 2)
+        Emulator_SetUserWord(address, pImage[address / 2]);
+    Emulator_SetUserWord(042, stack);
+    ::free(pImage);
+
+    if (okMonitorStub)
+    {
+        for (int i = 0; i < 0400 / 2; i++)
+            Emulator_SetUserWord(static_cast<uint16_t>(SAVFILE_RMON + i * 2), 0);
+        for (int i = 0; i < static_cast<int>(sizeof(SavMonitorStub) / sizeof(uint16_t)); i++)
+            Emulator_SetUserWord(static_cast<uint16_t>(SAVFILE_STUB + i * 2), SavMonitorStub[i]);
+        Emulator_SetUserWord(030, SAVFILE_STUB);  // EMT vector
+        Emulator_SetUserWord(032, 0);
+        Emulator_SetUserWord(054, SAVFILE_RMON);
+    }
+
+    // Start in USER mode, as the monitor RUN command does
+    CProcessor* pCPU = g_pBoard->GetCPU();
+    pCPU->SetPC(start);
+    pCPU->SetSP(stack);
+    pCPU->SetPSW(0);
+    pCPU->ClearInternalTick();
+
+    return true;
+}
+
+
+//////////////////////////////////////////////////////////////////////
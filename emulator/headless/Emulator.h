@@ -0,0 +1,81 @@
+﻿/*  This file is part of NEMIGABTL.
+    NEMIGABTL is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software Foundation,
+either version 3 of the License, or (at your option) any later version.
+    NEMIGABTL is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU Lesser General Public License for more details.
+    You should have received a copy of the GNU Lesser General Public License along with
+NEMIGABTL. If not, see <http://www.gnu.org/licenses/>. */
+
+// Emulator.h  Headless frontend: emulator control
+
+#pragma once
+
+#include "../emubase/Board.h"
+
+//////////////////////////////////////////////////////////////////////
+
+
+enum EmulatorConfiguration
+{
+    EMU_CONF_NEMIGA303 = 303,
+    EMU_CONF_NEMIGA405 = 405,
+    EMU_CONF_NEMIGA406 = 406,
+};
+
+
+//////////////////////////////////////////////////////////////////////
+
+extern CMotherboard* g_pBoard;
+extern int g_nEmulatorConfiguration;  // Current configuration
+
+
+//////////////////////////////////////////////////////////////////////
+
+
+bool Emulator_Init();
+// Select configuration and load the ROM
+//   sRomFileName - ROM file path; nullptr means use default file name for the configuration
+bool Emulator_InitConfiguration(uint16_t configuration, LPCTSTR sRomFileName);
+LPCTSTR Emulator_GetConfigurationName();
+void Emulator_Done();
+
+bool Emulator_AttachFloppyImage(int slot, LPCTSTR sFileName);    // MD image, slot 0..3
+bool Emulator_AttachFloppyMXImage(int slot, LPCTSTR sFileName);  // MX image, slot 0 or 2
+
+// 177777 means no stop address; condition is optional, see CBreakpointList::CompileCondition()
+bool Emulator_SetStopAddress(uint16_t address, LPCTSTR condition);
+// Stop on access to the address range, see WATCH_Xxx flags
+bool Emulator_AddWatchpoint(uint16_t start, uint16_t end, uint8_t flags);
+// Write CPU instruction trace to the binary file, see CTraceWriter; decode it with nemigabtl-tracedump
+bool Emulator_StartTrace(LPCTSTR sFileName);
+uint64_t Emulator_GetTraceRecordCount();
+// Count instructions and cycles per address and per call path, see CProfiler
+void Emulator_StartProfile();
+// Write the profile report and/or the collapsed call stacks, file names can be nullptr;
+// symbols are taken from the listing files, default is docs/nemiga-XXX.lst
+bool Emulator_SaveProfile(LPCTSTR sFileName, LPCTSTR sStacksFileName, const LPCTSTR* pSymbolFiles, int symbolFileCount);
+// Write the board and CPU performance counters as JSON;
+// hostNanoseconds is the whole run time, the part not spent in the board is reported as the frontend time
+bool Emulator_SaveCounters(LPCTSTR sFileName, uint64_t hostNanoseconds);
+// Put text to keyboard queue; keys are fed one by one, see Emulator_SystemFrame()
+void Emulator_KeyboardSequence(const char* str);
+bool Emulator_IsKeyboardQueueEmpty();
+
+// Run one frame; returns false when stopped at the stop address
+bool Emulator_SystemFrame();
+
+long Emulator_GetFrameCount();
+// Calculate hash of RAM and CPU registers - to compare runs
+uint32_t Emulator_GetStateHash();
+
+// Save/restore the whole machine state, the image format of the Windows frontend; disks are not included
+bool Emulator_SaveImage(LPCTSTR sFileName);
+bool Emulator_LoadImage(LPCTSTR sFileName);
+// Load RT-11 .SAV program to the memory and start it in USER mode, the resident monitor is expected
+// in the memory (restored RT-11 state); okMonitorStub puts the minimal monitor for the ROM-only start
+bool Emulator_RunSavFile(LPCTSTR sFileName, bool okMonitorStub);
+
+
+//////////////////////////////////////////////////////////////////////
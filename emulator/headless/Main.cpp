@@ -0,0 +1,434 @@
+﻿/*  This file is part of NEMIGABTL.
+    NEMIGABTL is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software Foundation,
+either version 3 of the License, or (at your option) any later version.
+    NEMIGABTL is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU Lesser General Public License for more details.
+    You should have received a copy of the GNU Lesser General Public License along with
+NEMIGABTL. If not, see <http://www.gnu.org/licenses/>. */
+
+// Main.cpp  Headless frontend: command line runner
+// Runs the emulator without any UI at full host speed, for batch jobs and benchmarking
+
+#include "stdafx.h"
+#include <chrono>
+#include <sys/resource.h>
+#include "Emulator.h"
+#include "../emubase/Emubase.h"
+
+//////////////////////////////////////////////////////////////////////
+
+
+uint16_t Option_Configuration = EMU_CONF_NEMIGA406;
+LPCTSTR Option_RomFile = nullptr;
+LPCTSTR Option_FloppyMD[4] = { nullptr, nullptr, nullptr, nullptr };
+LPCTSTR Option_FloppyMX[4] = { nullptr, nullptr, nullptr, nullptr };
+long Option_Frames = 250;
+uint16_t Option_StopAddress = 0177777;
+LPCTSTR Option_StopCondition = nullptr;
+const int MAX_WATCH_OPTIONS = 16;
+LPCTSTR Option_Watches[MAX_WATCH_OPTIONS];
+int Option_WatchCount = 0;
+bool Option_AutoBoot = false;
+LPCTSTR Option_Keys = nullptr;
+long Option_KeysFrame = 3 * 25;  // Start typing after the ROM initialization
+bool Option_ShowHash = false;
+LPCTSTR Option_TraceFile = nullptr;
+LPCTSTR Option_LogFile = nullptr;
+LPCTSTR Option_ProfileFile = nullptr;
+LPCTSTR Option_StacksFile = nullptr;
+LPCTSTR Option_StatsFile = nullptr;
+LPCTSTR Option_StateFile = nullptr;
+LPCTSTR Option_SaveStateFile = nullptr;
+LPCTSTR Option_SavFile = nullptr;
+long Option_SavFrame = -1;  // -1 means at once with -state, else after the ROM initialization
+const int MAX_SYMBOLS_OPTIONS = 8;
+LPCTSTR Option_SymbolFiles[MAX_SYMBOLS_OPTIONS];
+int Option_SymbolFileCount = 0;
+
+const long AUTOBOOT_FRAME = 2 * 25 + 16;  // Same moment as "/boot" option of the Windows frontend
+const uint8_t AUTOBOOT_KEY = 68;  // "D" - boot from disk
+const long RUNSAV_FRAME = 25;  // ROM monitor is ready to serve the terminal
+
+
+//////////////////////////////////////////////////////////////////////
+
+
+void PrintUsage()
+{
+    printf("Usage: nemigabtl-headless [options]\n"
+            "  -conf 303|405|406   Machine configuration, default 406\n"
+            "  -rom <file>         ROM image file, default nemiga-XXX.rom\n"
+            "  -md0..-md3 <file>   Attach MD floppy image to the slot\n"
+            "  -mx0, -mx2 <file>   Attach MX floppy image to the slot\n"
+            "  -frames <n>         Number of frames to run, 25 frames per second, default 250\n"
+            "  -until-pc <octal>   Stop when the CPU reaches the address\n"
+            "  -until-if <cond>    Stop at -until-pc address only if the condition is true,\n"
+            "                      for example \"r0 == 177 && hits > 3\"\n"
+            "  -watch <range>      Stop on access to the octal range like 1000-1777:rw,\n"
+            "                      r/w/x = read/write/fetch, default w; may be repeated\n"
+            "  -boot               Boot from disk: press D in the ROM menu\n"
+            "  -keys <text>        Type the text on the keyboard, \\n means Enter\n"
+            "  -keys-at <n>        Frame number to start typing at, default 75\n"
+            "  -hash               Print hash of RAM and CPU state at the end\n"
+            "  -trace <file>       Write binary CPU instruction trace, see nemigabtl-tracedump\n"
+            "  -log <file>         Write the emulator debug log: resets, floppy and port events\n"
+            "  -profile <file>     Write CPU hot spots report: cycles by address, by symbol, by routine\n"
+            "  -stacks <file>      Write call stacks with cycles, the flame graph tools input\n"
+            "  -symbols <file>     Listing file to take the profile symbols from,\n"
+            "                      default nemiga-XXX.lst; may be repeated\n"
+            "  -stats <file>       Write performance counters as JSON: CPU modes, interrupts,\n"
+            "                      slow path memory and port accesses, floppy, host time;\n"
+            "                      the device host time is sampled, the run speed is not affected\n"
+            "  -state <file>       Start from the saved machine state instead of the cold boot\n"
+            "  -save-state <file>  Save the machine state at the end, for example after RT-11 boot\n"
+            "  -run <file>         Load RT-11 .SAV program and start it; without -state a minimal\n"
+            "                      monitor serves .EXIT, .PRINT, .TTYOUT, .TTYIN\n"
+            "  -run-at <n>         Frame number to start the program at, default 0 with -state,\n"
+            "                      25 without\n");
+}
+
+// Parse watchpoint option value like "1000-1777:rw"
+static bool ParseWatchOption(LPCTSTR text, uint16_t* pStart, uint16_t* pEnd, uint8_t* pFlags)
+{
+    char buffer[32];
+    if (strlen(text) >= sizeof(buffer))
+        return false;
+    strcpy(buffer, text);
+
+    *pFlags = WATCH_WRITE;
+    char* pColon = strchr(buffer, ':');
+    if (pColon != nullptr)
+    {
+        *pColon = 0;
+        *pFlags = 0;
+        for (const char* pch = pColon + 1; *pch != 0; pch++)
+        {
+            if (*pch == 'r') *pFlags |= WATCH_READ;
+            else if (*pch == 'w') *pFlags |= WATCH_WRITE;
+            else if (*pch == 'x') *pFlags |= WATCH_EXEC;
+            else return false;
+        }
+    }
+    char* pDash = strchr(buffer, '-');
+    if (pDash != nullptr)
+        *pDash = 0;
+    if (!ParseOctalValue(buffer, pStart))
+        return false;
+    *pEnd = *pStart;
+    if (pDash != nullptr && !ParseOctalValue(pDash + 1, pEnd))
+        return false;
+    return *pFlags != 0 && *pEnd >= *pStart;
+}
+
+// Replace "\n" sequences with new line characters
+static char* ParseKeysOption(const char* text)
+{
+    char* result = static_cast<char*>(::malloc(strlen(text) + 1));
+    char* pdest = result;
+    while (*text != 0)
+    {
+        if (text[0] == '\\' && text[1] == 'n')
+        {
+            *pdest++ = '\n';  text += 2;
+        }
+        else
+            *pdest++ = *text++;
+    }
+    *pdest = 0;
+    return result;
+}
+
+bool ParseCommandLine(int argc, char** argv)
+{
+    for (int argn = 1; argn < argc; argn++)
+    {
+        LPCTSTR arg = argv[argn];
+        LPCTSTR value = (argn + 1 < argc) ? argv[argn + 1] : nullptr;
+
+        if (_tcscmp(arg, _T("-boot")) == 0)
+            Option_AutoBoot = true;
+        else if (_tcscmp(arg, _T("-hash")) == 0)
+            Option_ShowHash = true;
+        else if (_tcscmp(arg, _T("-help")) == 0 || _tcscmp(arg, _T("-h")) == 0)
+            return false;
+        else if (value == nullptr)
+        {
+            fprintf(stderr, "Option %s: value expected.\n", arg);
+            return false;
+        }
+        else if (_tcscmp(arg, _T("-conf")) == 0)
+        {
+            int conf = atoi(value);
+            if (conf != EMU_CONF_NEMIGA303 && conf != EMU_CONF_NEMIGA405 && conf != EMU_CONF_NEMIGA406)
+            {
+                fprintf(stderr, "Unknown configuration: %s.\n", value);
+                return false;
+            }
+            Option_Configuration = static_cast<uint16_t>(conf);
+            argn++;
+        }
+        else if (_tcscmp(arg, _T("-rom")) == 0)
+        {
+            Option_RomFile = value;  argn++;
+        }
+        else if (strncmp(arg, "-md", 3) == 0 && arg[3] >= '0' && arg[3] <= '3' && arg[4] == 0)
+        {
+            Option_FloppyMD[arg[3] - '0'] = value;  argn++;
+        }
+        else if (strncmp(arg, "-mx", 3) == 0 && (arg[3] == '0' || arg[3] == '2') && arg[4] == 0)
+        {
+            Option_FloppyMX[arg[3] - '0'] = value;  argn++;
+        }
+        else if (_tcscmp(arg, _T("-frames")) == 0)
+        {
+            Option_Frames = atol(value);  argn++;
+        }
+        else if (_tcscmp(arg, _T("-until-pc")) == 0)
+        {
+            if (!ParseOctalValue(value, &Option_StopAddress))
+            {
+                fprintf(stderr, "Wrong octal address: %s.\n", value);
+                return false;
+            }
+            argn++;
+        }
+        else if (_tcscmp(arg, _T("-until-if")) == 0)
+        {
+            Option_StopCondition = value;  argn++;
+        }
+        else if (_tcscmp(arg, _T("-watch")) == 0)
+        {
+            if (Option_WatchCount == MAX_WATCH_OPTIONS)
+            {
+                fprintf(stderr, "Too many watchpoints.\n");
+                return false;
+            }
+            Option_Watches[Option_WatchCount++] = value;  argn++;
+        }
+        else if (_tcscmp(arg, _T("-keys")) == 0)
+        {
+            Option_Keys = value;  argn++;
+        }
+        else if (_tcscmp(arg, _T("-keys-at")) == 0)
+        {
+            Option_KeysFrame = atol(value);  argn++;
+        }
+        else if (_tcscmp(arg, _T("-trace")) == 0)
+        {
+            Option_TraceFile = value;  argn++;
+        }
+        else if (_tcscmp(arg, _T("-log")) == 0)
+        {
+            Option_LogFile = value;  argn++;
+        }
+        else if (_tcscmp(arg, _T("-profile")) == 0)
+        {
+            Option_ProfileFile = value;  argn++;
+        }
+        else if (_tcscmp(arg, _T("-stacks")) == 0)
+        {
+            Option_StacksFile = value;  argn++;
+        }
+        else if (_tcscmp(arg, _T("-stats")) == 0)
+        {
+            Option_StatsFile = value;  argn++;
+        }
+        else if (_tcscmp(arg, _T("-state")) == 0)
+        {
+            Option_StateFile = value;  argn++;
+        }
+        else if (_tcscmp(arg, _T("-save-state")) == 0)
+        {
+            Option_SaveStateFile = value;  argn++;
+        }
+        else if (_tcscmp(arg, _T("-run")) == 0)
+        {
+            Option_SavFile = value;  argn++;
+        }
+        else if (_tcscmp(arg, _T("-run-at")) == 0)
+        {
+            Option_SavFrame = atol(value);  argn++;
+        }
+        else if (_tcscmp(arg, _T("-symbols")) == 0)
+        {
+            if (Option_SymbolFileCount == MAX_SYMBOLS_OPTIONS)
+            {
+                fprintf(stderr, "Too many symbols files.\n");
+                return false;
+            }
+            Option_SymbolFiles[Option_SymbolFileCount++] = value;  argn++;
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option: %s.\n", arg);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    if (!ParseCommandLine(argc, argv))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    if (Option_LogFile != nullptr && !DebugLogOpenFile(Option_LogFile))
+    {
+        fprintf(stderr, "Failed to create log file %s.\n", Option_LogFile);
+        return 1;
+    }
+    if (!Emulator_Init())
+        return 1;
+    if (!Emulator_InitConfiguration(Option_Configuration, Option_RomFile))
+    {
+        Emulator_Done();
+        return 1;
+    }
+
+    for (int slot = 0; slot < 4; slot++)
+    {
+        if (Option_FloppyMD[slot] != nullptr && !Emulator_AttachFloppyImage(slot, Option_FloppyMD[slot]))
+        {
+            fprintf(stderr, "Failed to attach MD image %s.\n", Option_FloppyMD[slot]);
+            Emulator_Done();
+            return 1;
+        }
+        if (Option_FloppyMX[slot] != nullptr && !Emulator_AttachFloppyMXImage(slot, Option_FloppyMX[slot]))
+        {
+            fprintf(stderr, "Failed to attach MX image %s.\n", Option_FloppyMX[slot]);
+            Emulator_Done();
+            return 1;
+        }
+    }
+
+    if (Option_StateFile != nullptr && !Emulator_LoadImage(Option_StateFile))
+    {
+        fprintf(stderr, "Failed to load state file %s.\n", Option_StateFile);
+        Emulator_Done();
+        return 1;
+    }
+    if (Option_SavFrame < 0)
+        Option_SavFrame = (Option_StateFile != nullptr) ? 0 : RUNSAV_FRAME;
+
+    if (!Emulator_SetStopAddress(Option_StopAddress, Option_StopCondition))
+    {
+        fprintf(stderr, "Wrong stop condition: %s.\n", Option_StopCondition);
+        Emulator_Done();
+        return 1;
+    }
+    for (int i = 0; i < Option_WatchCount; i++)
+    {
+        uint16_t start, end;
+        uint8_t flags;
+        if (!ParseWatchOption(Option_Watches[i], &start, &end, &flags) || !Emulator_AddWatchpoint(start, end, flags))
+        {
+            fprintf(stderr, "Wrong watchpoint: %s.\n", Option_Watches[i]);
+            Emulator_Done();
+            return 1;
+        }
+    }
+
+    if (Option_TraceFile != nullptr && !Emulator_StartTrace(Option_TraceFile))
+    {
+        fprintf(stderr, "Failed to create trace file %s.\n", Option_TraceFile);
+        Emulator_Done();
+        return 1;
+    }
+    if (Option_ProfileFile != nullptr || Option_StacksFile != nullptr)
+        Emulator_StartProfile();
+    if (Option_StatsFile != nullptr)
+        g_pBoard->SetHostTiming(true);
+
+    printf("Configuration: %s\n", Emulator_GetConfigurationName());
+
+    // Run the frames at full speed
+    bool okStopped = false;
+    std::chrono::steady_clock::time_point timeStart = std::chrono::steady_clock::now();
+    while (Emulator_GetFrameCount() < Option_Frames)
+    {
+        if (Option_AutoBoot && Emulator_GetFrameCount() == AUTOBOOT_FRAME)
+            g_pBoard->KeyboardEvent(AUTOBOOT_KEY, true);
+        if (Option_Keys != nullptr && Emulator_GetFrameCount() == Option_KeysFrame)
+        {
+            char* keys = ParseKeysOption(Option_Keys);
+            Emulator_KeyboardSequence(keys);
+            ::free(keys);
+        }
+        if (Option_SavFile != nullptr && Emulator_GetFrameCount() == Option_SavFrame &&
+            !Emulator_RunSavFile(Option_SavFile, Option_StateFile == nullptr))
+        {
+            Emulator_Done();
+            return 1;
+        }
+
+        if (!Emulator_SystemFrame())
+        {
+            okStopped = true;
+            break;
+        }
+    }
+    std::chrono::steady_clock::time_point timeEnd = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(timeEnd - timeStart).count();
+
+    // Print statistics
+    long frames = Emulator_GetFrameCount();
+    uint64_t instructions = g_pBoard->GetCPU()->GetInstructionCount();
+    uint64_t cycles = g_pBoard->GetCPU()->GetCycleCount();
+    uint64_t idleCycles = g_pBoard->GetCPU()->GetIdleCycleCount();
+    printf("Frames:        %ld (%.2f s emulated)\n", frames, frames / 25.0);
+    printf("Host time:     %.3f s\n", elapsed);
+    if (elapsed > 0)
+    {
+        double fps = frames / elapsed;
+        printf("Frames/sec:    %.1f (%.0f%% of real speed)\n", fps, fps / 25.0 * 100.0);
+        printf("Instructions:  %llu\n", static_cast<unsigned long long>(instructions));
+        printf("Emulated MIPS: %.2f\n", instructions / elapsed / 1000000.0);
+        printf("Emulated MHz:  %.2f (CPU cycles per host second)\n", cycles / elapsed / 1000000.0);
+    }
+    struct rusage usage;
+    if (::getrusage(RUSAGE_SELF, &usage) == 0)
+        printf("Peak RSS:      %ld KB\n", usage.ru_maxrss);  // Kilobytes on Linux
+    if (cycles > 0)
+        printf("Idle skipped:  %.1f%% of CPU ticks\n", idleCycles * 100.0 / cycles);
+    const WatchpointHit* pHit = g_pBoard->GetWatchpointHit();
+    if (pHit != nullptr)
+    {
+        LPCTSTR access = (pHit->access == WATCH_READ) ? "read" : (pHit->access == WATCH_WRITE) ? "write" : "fetch";
+        printf("Watchpoint:    PC=%06o %s %s %06o: %06o -> %06o\n", pHit->pc, access, pHit->okByte ? "byte" : "word",
+                pHit->address, pHit->oldvalue, pHit->newvalue);
+    }
+    else if (Option_StopAddress != 0177777)
+    {
+        if (okStopped)
+            printf("Stopped at:    %06o\n", g_pBoard->GetCPU()->GetPC());
+        else
+            printf("Stop address %06o was not reached.\n", Option_StopAddress);
+    }
+    if (Option_ShowHash)
+        printf("State hash:    %08x\n", Emulator_GetStateHash());
+    if (Option_SaveStateFile != nullptr && !Emulator_SaveImage(Option_SaveStateFile))
+        fprintf(stderr, "Failed to write state file %s.\n", Option_SaveStateFile);
+    if ((Option_ProfileFile != nullptr || Option_StacksFile != nullptr) &&
+        !Emulator_SaveProfile(Option_ProfileFile, Option_StacksFile, Option_SymbolFiles, Option_SymbolFileCount))
+        fprintf(stderr, "Failed to write profile files.\n");
+    if (Option_StatsFile != nullptr &&
+        !Emulator_SaveCounters(Option_StatsFile, std::chrono::duration_cast<std::chrono::nanoseconds>(timeEnd - timeStart).count()))
+        fprintf(stderr, "Failed to write stats file %s.\n", Option_StatsFile);
+
+    Emulator_Done();  // Closes the trace file
+    if (Option_TraceFile != nullptr)
+        printf("Traced:        %llu instructions\n", static_cast<unsigned long long>(Emulator_GetTraceRecordCount()));
+
+    if (Option_StopAddress != 0177777 && !okStopped)
+        return 2;
+    return 0;
+}
+
+
+//////////////////////////////////////////////////////////////////////
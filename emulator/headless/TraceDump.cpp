@@ -0,0 +1,274 @@
+﻿/*  This file is part of NEMIGABTL.
+    NEMIGABTL is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software Foundation,
+either version 3 of the License, or (at your option) any later version.
+    NEMIGABTL is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU Lesser General Public License for more details.
+    You should have received a copy of the GNU Lesser General Public License along with
+NEMIGABTL. If not, see <http://www.gnu.org/licenses/>. */
+
+// TraceDump.cpp  Headless frontend: binary CPU trace decoder and query tool, see CTraceReader
+
+#include "stdafx.h"
+#include "../emubase/Emubase.h"
+
+//////////////////////////////////////////////////////////////////////
+
+
+uint32_t Option_TextOptions = 0;
+uint64_t Option_From = 0;           // First record to look at
+uint64_t Option_AtCycle = 0;        // First cycle to look at, 0 = use Option_From
+uint64_t Option_Count = UINT64_MAX; // Records to print
+uint16_t Option_PCStart = 0;        // PC range filter
+uint16_t Option_PCEnd = 0177777;
+int Option_Mode = -1;               // HALT/USER mode filter: -1 = any, 0 = USER, 1 = HALT
+uint16_t Option_RegMask = 0;        // Register value filter: bit N = check register N, bit 8 = check PSW
+uint16_t Option_RegValues[9];
+bool Option_ShowInfo = false;
+bool Option_ShowSnapshot = false;
+LPCTSTR Option_FileName = nullptr;
+
+
+//////////////////////////////////////////////////////////////////////
+
+
+void PrintUsage()
+{
+    printf("Usage: nemigabtl-tracedump [options] <trace file>\n"
+            "  -cycles             Show CPU cycle of every instruction\n"
+            "  -regs               Show registers and PSW before every instruction\n"
+            "  -writes             Show memory writes made by every instruction\n"
+            "  -from <n>           Start at record number n\n"
+            "  -at <cycle>         Start at the first record at or after the CPU cycle\n"
+            "  -count <n>          Print at most n records\n"
+            "  -pc <range>         Only instructions in the octal address range like 1000-1777\n"
+            "  -halt, -user        Only instructions executed in HALT or USER mode\n"
+            "  -reg <reg>=<octal>  Only when the register has the value, like r0=177 or ps=340;\n"
+            "                      may be repeated\n"
+            "  -info               Print the trace file summary\n"
+            "  -snapshot           Print the CPU snapshot the decoding starts from\n");
+}
+
+// Parse octal address range like "1000-1777", or a single address
+static bool ParseRangeOption(LPCTSTR text, uint16_t* pStart, uint16_t* pEnd)
+{
+    char buffer[16];
+    if (strlen(text) >= sizeof(buffer))
+        return false;
+    strcpy(buffer, text);
+
+    char* pEndText = strchr(buffer, '-');
+    if (pEndText != nullptr)
+        *pEndText++ = 0;
+    if (!ParseOctalValue(buffer, pStart))
+        return false;
+    if (pEndText == nullptr)
+    {
+        *pEnd = *pStart;
+        return true;
+    }
+    return ParseOctalValue(pEndText, pEnd) && *pStart <= *pEnd;
+}
+
+// Parse register filter like "r0=177"; sp, pc and ps are the names for R6, R7 and PSW
+static bool ParseRegOption(LPCTSTR text)
+{
+    static const LPCTSTR names[] = { "r0", "r1", "r2", "r3", "r4", "r5", "r6", "r7", "ps" };
+    char buffer[16];
+    if (strlen(text) >= sizeof(buffer))
+        return false;
+    strcpy(buffer, text);
+
+    char* pValueText = strchr(buffer, '=');
+    if (pValueText == nullptr)
+        return false;
+    *pValueText++ = 0;
+    int reg = -1;
+    for (int i = 0; i < 9; i++)
+    {
+        if (_tcsicmp(buffer, names[i]) == 0)
+            reg = i;
+    }
+    if (_tcsicmp(buffer, "sp") == 0)
+        reg = 6;
+    else if (_tcsicmp(buffer, "pc") == 0)
+        reg = 7;
+    if (reg < 0 || !ParseOctalValue(pValueText, Option_RegValues + reg))
+        return false;
+    Option_RegMask |= (1 << reg);
+    return true;
+}
+
+bool ParseCommandLine(int argc, char** argv)
+{
+    for (int argn = 1; argn < argc; argn++)
+    {
+        LPCTSTR arg = argv[argn];
+        LPCTSTR value = (argn + 1 < argc) ? argv[argn + 1] : nullptr;
+
+        if (_tcscmp(arg, _T("-cycles")) == 0)
+            Option_TextOptions |= TRACETEXT_CYCLE;
+        else if (_tcscmp(arg, _T("-regs")) == 0)
+            Option_TextOptions |= TRACETEXT_REGS;
+        else if (_tcscmp(arg, _T("-writes")) == 0)
+            Option_TextOptions |= TRACETEXT_WRITES;
+        else if (_tcscmp(arg, _T("-halt")) == 0)
+            Option_Mode = 1;
+        else if (_tcscmp(arg, _T("-user")) == 0)
+            Option_Mode = 0;
+        else if (_tcscmp(arg, _T("-info")) == 0)
+            Option_ShowInfo = true;
+        else if (_tcscmp(arg, _T("-snapshot")) == 0)
+            Option_ShowSnapshot = true;
+        else if (_tcscmp(arg, _T("-help")) == 0 || _tcscmp(arg, _T("-h")) == 0)
+            return false;
+        else if (arg[0] != '-')
+        {
+            if (Option_FileName != nullptr)
+            {
+                fprintf(stderr, "Only one trace file expected: %s.\n", arg);
+                return false;
+            }
+            Option_FileName = arg;
+        }
+        else if (value == nullptr)
+        {
+            fprintf(stderr, "Option %s: value expected.\n", arg);
+            return false;
+        }
+        else if (_tcscmp(arg, _T("-from")) == 0)
+        {
+            Option_From = strtoull(value, nullptr, 10);  argn++;
+        }
+        else if (_tcscmp(arg, _T("-at")) == 0)
+        {
+            Option_AtCycle = strtoull(value, nullptr, 10);  argn++;
+        }
+        else if (_tcscmp(arg, _T("-count")) == 0)
+        {
+            Option_Count = strtoull(value, nullptr, 10);  argn++;
+        }
+        else if (_tcscmp(arg, _T("-pc")) == 0)
+        {
+            if (!ParseRangeOption(value, &Option_PCStart, &Option_PCEnd))
+            {
+                fprintf(stderr, "Wrong address range: %s.\n", value);
+                return false;
+            }
+            argn++;
+        }
+        else if (_tcscmp(arg, _T("-reg")) == 0)
+        {
+            if (!ParseRegOption(value))
+            {
+                fprintf(stderr, "Wrong register value: %s.\n", value);
+                return false;
+            }
+            argn++;
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option: %s.\n", arg);
+            return false;
+        }
+    }
+
+    return Option_FileName != nullptr;
+}
+
+static bool IsRecordMatching(const TraceRecord& record)
+{
+    uint16_t pc = record.regs[7];
+    if (pc < Option_PCStart || pc > Option_PCEnd)
+        return false;
+    if (Option_Mode >= 0 && ((record.psw & PSW_P) != 0) != (Option_Mode == 1))
+        return false;
+    for (int reg = 0; reg < 9; reg++)
+    {
+        if ((Option_RegMask & (1 << reg)) == 0)
+            continue;
+        uint16_t value = (reg < 8) ? record.regs[reg] : record.psw;
+        if (value != Option_RegValues[reg])
+            return false;
+    }
+    return true;
+}
+
+static void PrintInfo(const CTraceReader& reader)
+{
+    int blocks = reader.GetBlockCount();
+    const TraceIndexEntry* pIndex = reader.GetBlockIndex();
+    printf("Records:       %llu\n", static_cast<unsigned long long>(reader.GetRecordCount()));
+    printf("Blocks:        %d, %d records per block\n", blocks, TRACEBLOCK_RECORDS);
+    if (blocks > 0)
+    {
+        printf("Cycles:        %llu - %llu\n", static_cast<unsigned long long>(pIndex[0].cycle),
+                static_cast<unsigned long long>(pIndex[blocks - 1].cycle));
+        uint64_t bytes = pIndex[blocks - 1].offset - pIndex[0].offset;  // All the blocks but the last one
+        uint64_t records = pIndex[blocks - 1].record;
+        if (records > 0)
+            printf("Block size:    %.2f bytes per record\n", static_cast<double>(bytes) / records);
+    }
+}
+
+static void PrintSnapshot(const TraceBlockHeader* pHeader)
+{
+    // See CProcessor::SaveToImage() for the layout
+    const uint16_t* pwImage = reinterpret_cast<const uint16_t*>(pHeader->snapshot);
+    uint16_t psw = pwImage[0];
+    const uint16_t* pRegs = pwImage + 1;
+    printf("Snapshot at record %llu, cycle %llu:\n",
+            static_cast<unsigned long long>(pHeader->record), static_cast<unsigned long long>(pHeader->cycle));
+    printf("  R0=%06o R1=%06o R2=%06o R3=%06o R4=%06o R5=%06o SP=%06o PC=%06o PS=%06o %s%s\n",
+            pRegs[0], pRegs[1], pRegs[2], pRegs[3], pRegs[4], pRegs[5], pRegs[6], pRegs[7], psw,
+            (psw & PSW_P) ? _T("HALT") : _T("USER"), pwImage[9] != 0 ? _T(" STOPPED") : _T(""));
+}
+
+int main(int argc, char** argv)
+{
+    if (!ParseCommandLine(argc, argv))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    CTraceReader reader;
+    if (!reader.Open(Option_FileName))
+    {
+        fprintf(stderr, "Failed to open trace file %s.\n", Option_FileName);
+        return 1;
+    }
+
+    if (Option_ShowInfo)
+        PrintInfo(reader);
+
+    bool okSeek = (Option_AtCycle > 0) ? reader.SeekToCycle(Option_AtCycle) : reader.SeekToRecord(Option_From);
+    if (!okSeek)
+    {
+        if (!Option_ShowInfo)
+            fprintf(stderr, "The start point is out of the trace.\n");
+        return Option_ShowInfo ? 0 : 1;
+    }
+    if (Option_ShowSnapshot)
+        PrintSnapshot(reader.GetBlockHeader());
+    if (Option_ShowInfo && Option_Count == UINT64_MAX)
+        return 0;
+
+    TCHAR buffer[256];
+    TraceRecord record;
+    uint64_t printed = 0;
+    while (printed < Option_Count && reader.ReadRecord(&record))
+    {
+        if (!IsRecordMatching(record))
+            continue;
+        TraceRecordToText(record, buffer, sizeof(buffer) / sizeof(TCHAR), Option_TextOptions);
+        puts(buffer);
+        printed++;
+    }
+
+    return 0;
+}
+
+
+//////////////////////////////////////////////////////////////////////
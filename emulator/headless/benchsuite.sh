@@ -0,0 +1,117 @@
+#!/bin/sh
+# benchsuite.sh  Macro benchmarks on top of nemigabtl-headless: ROM cold boot, RT-11 boot, test programs.
+# Prints wall time, emulated CPU cycles per host second and peak RSS for every scenario,
+# and appends them to the history file to track the numbers over time.
+#
+# RT-11 scenarios need the reference disk images, they are not in the repository:
+#   NEMIGA_RT11_MD  MD image with RT-11 and MUL01.SAV, MUL10.SAV, NTSMUL.SAV (tests/MULRR, tests/NTSMUL)
+#   NEMIGA_RT11_MX  MX image with RT-11
+# The images are copied before every run as the programs write to the disk.
+# The -sav scenarios start the test programs directly with the minimal monitor, no disk needed.
+
+usage()
+{
+    echo "Usage: benchsuite.sh [-b <nemigabtl-headless>] [-o <history.csv>] [-f <filter>]"
+    echo "  -b <file>    Headless runner, default build/nemigabtl-headless"
+    echo "  -o <file>    Append the results to the CSV file"
+    echo "  -f <text>    Run only the scenarios with the text in the name"
+}
+
+BIN=build/nemigabtl-headless
+HISTORY=
+FILTER=
+while getopts "b:o:f:h" opt; do
+    case $opt in
+        b) BIN=$OPTARG ;;
+        o) HISTORY=$OPTARG ;;
+        f) FILTER=$OPTARG ;;
+        *) usage; exit 1 ;;
+    esac
+done
+if [ ! -x "$BIN" ]; then
+    echo "Headless runner not found: $BIN" >&2
+    usage
+    exit 1
+fi
+case $BIN in /*) ;; *) BIN=$(pwd)/$BIN ;; esac
+TESTS=$(cd "$(dirname "$0")/../../tests" && pwd)
+
+# Frames to run, 25 frames per second of emulated time
+ROM_FRAMES=250              # Limit for the cold boot, the prompt comes much earlier
+RT11_BOOT_FRAMES=${RT11_BOOT_FRAMES:-500}
+PROGRAM_FRAMES=${PROGRAM_FRAMES:-3000}
+KEYS_FRAME=$((RT11_BOOT_FRAMES - 50))  # Type the command when RT-11 is up
+
+# ROM monitor prompt: the address of the command input call after "Пульт>", see docs/nemiga-XXX.lst.
+# -until-pc stops are checked by the CPU in its batch loop, the run keeps the translated blocks and
+# the idle loop skipping, so these scenarios measure the same speed as the runs without a stop address.
+PROMPT_303=161436
+PROMPT_405=161452
+PROMPT_406=161474
+
+REVISION=$(git -C "$(dirname "$0")" rev-parse --short HEAD 2>/dev/null || echo unknown)
+DATE=$(date +%Y-%m-%dT%H:%M:%S)
+TMPDIR=$(mktemp -d)
+trap 'rm -rf "$TMPDIR"' EXIT
+FAILED=0
+
+if [ -n "$HISTORY" ] && [ ! -s "$HISTORY" ]; then
+    echo "date,revision,scenario,frames,wall_s,emulated_mhz,peak_rss_kb" > "$HISTORY"
+fi
+printf "%-10s %8s %10s %14s %12s\n" "Scenario" "Frames" "Wall, s" "Emulated MHz" "Peak RSS KB"
+
+# run <scenario> <image or -> <headless options...>; the image is copied to $TMPDIR/disk.img
+run()
+{
+    name=$1; image=$2; shift 2
+    case $name in *"$FILTER"*) ;; *) return ;; esac
+    if [ "$image" != "-" ]; then
+        if [ -z "$image" ] || [ ! -f "$image" ]; then
+            printf "%-10s skipped, no disk image\n" "$name"
+            return
+        fi
+        cp "$image" "$TMPDIR/disk.img"
+    fi
+
+    start=$(date +%s.%N)
+    (cd "$TMPDIR" && "$BIN" "$@") > "$TMPDIR/out.txt" 2>&1
+    status=$?
+    end=$(date +%s.%N)
+    if [ $status -ne 0 ]; then
+        printf "%-10s failed, exit code %d\n" "$name" $status
+        FAILED=1
+        return
+    fi
+
+    wall=$(echo "$start $end" | awk '{ printf "%.3f", $2 - $1 }')
+    frames=$(awk '/^Frames:/ { print $2 }' "$TMPDIR/out.txt")
+    mhz=$(awk '/^Emulated MHz:/ { print $3 }' "$TMPDIR/out.txt")
+    rss=$(awk '/^Peak RSS:/ { print $3 }' "$TMPDIR/out.txt")
+    printf "%-10s %8s %10s %14s %12s\n" "$name" "$frames" "$wall" "$mhz" "$rss"
+    if [ -n "$HISTORY" ]; then
+        echo "$DATE,$REVISION,$name,$frames,$wall,$mhz,$rss" >> "$HISTORY"
+    fi
+}
+
+run rom-303 - -conf 303 -until-pc $PROMPT_303 -frames $ROM_FRAMES
+run rom-405 - -conf 405 -until-pc $PROMPT_405 -frames $ROM_FRAMES
+run rom-406 - -conf 406 -until-pc $PROMPT_406 -frames $ROM_FRAMES
+
+run rt11-md "$NEMIGA_RT11_MD" -conf 406 -md0 disk.img -boot -frames $RT11_BOOT_FRAMES
+run rt11-mx "$NEMIGA_RT11_MX" -conf 303 -mx0 disk.img -keys "X" -keys-at 50 -frames $RT11_BOOT_FRAMES
+
+PROGRAM_END=$((RT11_BOOT_FRAMES + PROGRAM_FRAMES))
+run mul01 "$NEMIGA_RT11_MD" -conf 406 -md0 disk.img -boot \
+    -keys "RUN MUL01\n" -keys-at $KEYS_FRAME -frames $PROGRAM_END
+run mul10 "$NEMIGA_RT11_MD" -conf 406 -md0 disk.img -boot \
+    -keys "RUN MUL10\n" -keys-at $KEYS_FRAME -frames $PROGRAM_END
+run ntsmul "$NEMIGA_RT11_MD" -conf 406 -md0 disk.img -boot \
+    -keys "RUN NTSMUL\n \n \n \n" -keys-at $KEYS_FRAME -frames $PROGRAM_END
+
+# .EXIT halts to the ROM monitor, the second prompt hit
+run mul01-sav - -conf 406 -run "$TESTS/MULRR/MUL01.SAV" \
+    -until-pc $PROMPT_406 -until-if "hits > 1" -frames $PROGRAM_FRAMES
+run mul10-sav - -conf 406 -run "$TESTS/MULRR/MUL10.SAV" \
+    -until-pc $PROMPT_406 -until-if "hits > 1" -frames $PROGRAM_FRAMES
+
+exit $FAILED
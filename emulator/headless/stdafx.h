@@ -0,0 +1,64 @@
+﻿/*  This file is part of NEMIGABTL.
+    NEMIGABTL is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software Foundation,
+either version 3 of the License, or (at your option) any later version.
+    NEMIGABTL is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU Lesser General Public License for more details.
+    You should have received a copy of the GNU Lesser General Public License along with
+NEMIGABTL. If not, see <http://www.gnu.org/licenses/>. */
+
+// stdafx.h : include file for standard system include files,
+// used by emubase and the headless frontend in non-Windows builds.
+// Provides the subset of Win32 types and TCHAR routines emubase relies on.
+
+#pragma once
+
+// C RunTime Header Files
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdint.h>
+
+typedef char            TCHAR;
+typedef char*           LPTSTR;
+typedef const char*     LPCTSTR;
+typedef const char*     LPCSTR;
+typedef int             BOOL;
+typedef uint8_t         BYTE;
+typedef uint16_t        WORD;
+typedef uint32_t        DWORD;
+typedef int32_t         LONG;
+
+#ifndef TRUE
+#define TRUE  1
+#define FALSE 0
+#endif
+
+#define CALLBACK
+
+#define _T(x)           x
+#define _sntprintf      snprintf
+#define _vsntprintf     vsnprintf
+#define _tcscpy         strcpy
+#define _tcscmp         strcmp
+#define _tcsicmp        strcasecmp
+#define _tcslen         strlen
+#define _tfopen         fopen
+
+inline int _tcscpy_s(TCHAR* dest, size_t size, const TCHAR* src)
+{
+    strncpy(dest, src, size - 1);
+    dest[size - 1] = 0;
+    return 0;
+}
+
+#define LOBYTE(w)       ((BYTE)((w) & 0xff))
+#define HIBYTE(w)       ((BYTE)(((w) >> 8) & 0xff))
+#define LOWORD(l)       ((WORD)((l) & 0xffff))
+#define HIWORD(l)       ((WORD)(((DWORD)(l) >> 16) & 0xffff))
+#define MAKEWORD(a, b)  ((WORD)(((BYTE)((a) & 0xff)) | ((WORD)((BYTE)((b) & 0xff))) << 8))
+#define MAKELONG(a, b)  ((LONG)(((WORD)((a) & 0xffff)) | ((DWORD)((WORD)((b) & 0xffff))) << 16))
+
+#include "Common.h"